@@ -0,0 +1,154 @@
+#include "BenchRunner.h"
+
+#include "CorpusGenerator.h"
+#include "DirectoryWalker.h"
+#include "KeywordSearch.h"
+#include "PathTable.h"
+#include "TextReport.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    double SecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Runs the measurement repeatCount times and returns the fastest time in seconds.
+    double Fastest(size_t repeatCount, const std::function<void()>& measurement) {
+        double best = 0.0;
+        for (size_t run = 0; run < std::max<size_t>(repeatCount, 1); ++run) {
+            const Clock::time_point start = Clock::now();
+            measurement();
+            const double elapsed = SecondsSince(start);
+            if (run == 0 || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        return best;
+    }
+
+    double MegabytesPerSecond(uint64_t bytes, double seconds) {
+        return seconds > 0.0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0.0;
+    }
+
+    double PerSecond(size_t count, double seconds) {
+        return seconds > 0.0 ? static_cast<double>(count) / seconds : 0.0;
+    }
+
+}
+
+int RunBenchmark(const BenchOptions& options)
+{
+    // Phase 1: enumeration, the same walk the scanner does, at every thread count.
+    PathTable files;
+    std::vector<double> enumerationSeconds;
+    for (size_t threadCount : options.threadCounts) {
+        enumerationSeconds.push_back(Fastest(options.repeatCount, [&] {
+            files = PathTable();
+            WalkHtmlFiles(options.corpusDirectory, threadCount, FileFilter(),
+                [&](const std::filesystem::path& filePath) { files.Add(filePath); }, nullptr);
+        }));
+    }
+
+    if (files.Size() == 0) {
+        std::cerr << "Error: No HTML files found under " << options.corpusDirectory.string() << std::endl;
+        return 1;
+    }
+
+    uint64_t totalBytes = 0;
+    for (FileId fileId = 0; fileId < files.Size(); ++fileId) {
+        std::error_code error;
+        totalBytes += std::filesystem::file_size(files.Path(fileId), error);
+    }
+
+    std::printf("Corpus: %zu files, %.1f MiB\n", files.Size(), static_cast<double>(totalBytes) / (1024.0 * 1024.0));
+    for (size_t i = 0; i < options.threadCounts.size(); ++i) {
+        std::printf("Enumeration, %zu threads: %.1f ms (%.0f files/s)\n", options.threadCounts[i],
+            enumerationSeconds[i] * 1000.0, PerSecond(files.Size(), enumerationSeconds[i]));
+    }
+    std::printf("\n");
+    std::printf("%8s %7s %-28s %10s %10s %10s %12s %10s\n",
+        "keywords", "threads", "engine", "read MB/s", "match MB/s", "scan MB/s", "scan files/s", "output ms");
+
+    // File contents for the matching phase, so it can be timed without any I/O.
+    std::vector<std::string> contents(files.Size());
+
+    for (size_t threadCount : options.threadCounts) {
+        WorkStealingPool pool(threadCount);
+
+        // Phase 2: I/O only. Reads every file into memory.
+        const double readSeconds = Fastest(options.repeatCount, [&] {
+            for (FileId fileId = 0; fileId < files.Size(); ++fileId) {
+                pool.Submit([&, fileId](size_t) {
+                    std::ifstream stream(files.Path(fileId), std::ios::binary | std::ios::ate);
+                    std::string& content = contents[fileId];
+                    content.resize(static_cast<size_t>(std::max<std::streamoff>(stream.tellg(), 0)));
+                    stream.seekg(0);
+                    stream.read(content.data(), static_cast<std::streamsize>(content.size()));
+                });
+            }
+            pool.Wait();
+        });
+
+        for (size_t keywordCount : options.keywordCounts) {
+            const std::vector<std::string> keywords = BenchmarkKeywords(keywordCount);
+            const KeywordSearch matcher(keywords);
+
+            // Phase 3: matching only, over the buffers loaded above.
+            std::vector<KeywordHits> workerHits(pool.ThreadCount());
+            const double matchSeconds = Fastest(options.repeatCount, [&] {
+                for (FileId fileId = 0; fileId < files.Size(); ++fileId) {
+                    pool.Submit([&, fileId](size_t workerIndex) {
+                        KeywordHits& hits = workerHits[workerIndex];
+                        hits.Reset(matcher.KeywordCount());
+                        matcher.Scan(contents[fileId].data(), contents[fileId].size(), hits);
+                    });
+                }
+                pool.Wait();
+            });
+
+            // Phase 4: the real per-file scan, reading and matching together.
+            std::vector<ScanContext> workerContexts(pool.ThreadCount());
+            std::vector<KeywordHits> fileHits(files.Size());
+            const double scanSeconds = Fastest(options.repeatCount, [&] {
+                for (FileId fileId = 0; fileId < files.Size(); ++fileId) {
+                    pool.Submit([&, fileId](size_t workerIndex) {
+                        ScanContext& context = workerContexts[workerIndex];
+                        ScanFile(files.Path(fileId), matcher, options.readMode, ScanScope::All, context);
+                        fileHits[fileId] = context.hits;
+                    });
+                }
+                pool.Wait();
+            });
+
+            // Phase 5: grouping the hits and writing the text report.
+            const double outputSeconds = Fastest(options.repeatCount, [&] {
+                std::vector<std::vector<FileId>> filesByKeyword(keywords.size());
+                for (FileId fileId = 0; fileId < files.Size(); ++fileId) {
+                    fileHits[fileId].ForEach([&](size_t keywordIndex) { filesByKeyword[keywordIndex].push_back(fileId); });
+                }
+                WriteTextReport(options.reportPath, options.corpusDirectory.string(), files, keywords, filesByKeyword);
+            });
+
+            std::printf("%8zu %7zu %-28s %10.1f %10.1f %10.1f %12.0f %10.1f\n",
+                keywordCount, pool.ThreadCount(), matcher.EngineName().c_str(),
+                MegabytesPerSecond(totalBytes, readSeconds), MegabytesPerSecond(totalBytes, matchSeconds),
+                MegabytesPerSecond(totalBytes, scanSeconds), PerSecond(files.Size(), scanSeconds),
+                outputSeconds * 1000.0);
+        }
+    }
+
+    return 0;
+}
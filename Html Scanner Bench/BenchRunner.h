@@ -0,0 +1,27 @@
+// Benchmark runner that times the scanner's phases separately.
+// Enumeration, reading, matching, the end-to-end scan and report writing are each measured on
+// their own, for every combination of keyword-set size and thread count.
+
+#pragma once
+
+#include "Scanner.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+
+struct BenchOptions {
+    std::filesystem::path corpusDirectory;
+    // Keyword-set sizes to measure. Keywords come from BenchmarkKeywords(), so they match what the
+    // generator planted.
+    std::vector<size_t> keywordCounts{ 1, 3, 10, 100, 300 };
+    std::vector<size_t> threadCounts{ 1 };
+    ReadMode readMode = ReadMode::Lines;
+    // Each measurement is repeated and the fastest run is reported.
+    size_t repeatCount = 3;
+    std::filesystem::path reportPath = "bench_output.txt";
+};
+
+// Runs the benchmark and prints one result row per configuration. Returns the process exit code.
+int RunBenchmark(const BenchOptions& options);
@@ -0,0 +1,166 @@
+#include "CorpusGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <set>
+
+
+namespace {
+
+    class SplitMix64 {
+    public:
+        explicit SplitMix64(uint64_t seed) : m_state(seed) {}
+
+        uint64_t Next() {
+            uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // Uniform in [0, bound).
+        size_t Below(size_t bound) {
+            return bound == 0 ? 0 : static_cast<size_t>(Next() % bound);
+        }
+
+        // Uniform in [0, 1).
+        double Unit() {
+            return static_cast<double>(Next() >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+        // Standard normal, via Box-Muller.
+        double Normal() {
+            const double u1 = std::max(Unit(), 1e-12);
+            const double u2 = Unit();
+            return std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+        }
+
+    private:
+        uint64_t m_state;
+    };
+
+    // Filler vocabulary. None of these words contains a benchmark keyword, so every hit in the
+    // corpus comes from a planted occurrence.
+    const char* const kFillerWords[] = {
+        "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "do",
+        "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore", "magna", "aliqua", "enim",
+        "ad", "minim", "veniam", "quis", "nostrud", "exercitation", "ullamco", "laboris", "nisi",
+        "aliquip", "ex", "ea", "commodo", "consequat", "duis", "aute", "irure", "in", "reprehenderit",
+    };
+    constexpr size_t kFillerWordCount = sizeof(kFillerWords) / sizeof(kFillerWords[0]);
+
+    const char* const kBlockTags[] = { "p", "div", "section", "article", "li", "span" };
+    constexpr size_t kBlockTagCount = sizeof(kBlockTags) / sizeof(kBlockTags[0]);
+
+    std::filesystem::path RandomDirectory(SplitMix64& random, const CorpusOptions& options) {
+        std::filesystem::path directory;
+        const size_t depth = random.Below(options.directoryDepth + 1);
+        for (size_t level = 0; level < depth; ++level) {
+            directory /= "d" + std::to_string(random.Below(std::max<size_t>(options.directoryFanout, 1)));
+        }
+        return directory;
+    }
+
+    size_t RandomFileSize(SplitMix64& random, const CorpusOptions& options) {
+        const double size = static_cast<double>(options.medianFileSize) * std::exp(options.sizeSpread * random.Normal());
+        return std::clamp<size_t>(static_cast<size_t>(size), 256, std::max<size_t>(options.maxFileSize, 256));
+    }
+
+    // Builds one HTML page of roughly targetSize bytes.
+    std::string BuildPage(SplitMix64& random, size_t targetSize, const CorpusOptions& options,
+        const std::vector<std::string>& vocabulary, size_t& plantedKeywords) {
+        std::string page = "<!DOCTYPE html>\n<html>\n<head><title>Synthetic page</title></head>\n<body>\n";
+        page.reserve(targetSize + 512);
+
+        // Chance of planting a keyword after each word, from the density per KiB and an average
+        // word length of about seven bytes.
+        const double plantChance = options.keywordDensity * 7.0 / 1024.0;
+
+        while (page.size() < targetSize) {
+            const char* tag = kBlockTags[random.Below(kBlockTagCount)];
+            page += '<';
+            page += tag;
+            page += '>';
+
+            const size_t wordCount = 8 + random.Below(40);
+            for (size_t word = 0; word < wordCount; ++word) {
+                if (word > 0) {
+                    page += ' ';
+                }
+                if (!vocabulary.empty() && random.Unit() < plantChance) {
+                    page += vocabulary[random.Below(vocabulary.size())];
+                    ++plantedKeywords;
+                }
+                else {
+                    page += kFillerWords[random.Below(kFillerWordCount)];
+                }
+            }
+
+            page += "</";
+            page += tag;
+            page += ">\n";
+        }
+
+        page += "</body>\n</html>\n";
+        return page;
+    }
+
+}
+
+std::vector<std::string> BenchmarkKeywords(size_t count)
+{
+    static const char* const kNamedKeywords[] = {
+        "form", "gallery", "table", "iframe", "video", "canvas", "button", "textarea",
+    };
+    constexpr size_t kNamedKeywordCount = sizeof(kNamedKeywords) / sizeof(kNamedKeywords[0]);
+
+    std::vector<std::string> keywords;
+    for (size_t i = 0; i < count; ++i) {
+        if (i < kNamedKeywordCount) {
+            keywords.push_back(kNamedKeywords[i]);
+        }
+        else {
+            char name[32];
+            std::snprintf(name, sizeof(name), "data-kw-%04zu", i - kNamedKeywordCount);
+            keywords.push_back(name);
+        }
+    }
+    return keywords;
+}
+
+bool GenerateCorpus(const std::filesystem::path& root, const CorpusOptions& options,
+    CorpusSummary& summary, std::string& error)
+{
+    summary = CorpusSummary();
+    SplitMix64 random(options.seed);
+    const std::vector<std::string> vocabulary = BenchmarkKeywords(options.keywordVocabulary);
+    std::set<std::filesystem::path> directories;
+
+    for (size_t fileIndex = 0; fileIndex < options.fileCount; ++fileIndex) {
+        const std::filesystem::path directory = root / RandomDirectory(random, options);
+        if (directories.insert(directory).second) {
+            std::error_code createError;
+            std::filesystem::create_directories(directory, createError);
+            if (createError) {
+                error = "Could not create directory " + directory.string() + ": " + createError.message();
+                return false;
+            }
+        }
+
+        const std::string page = BuildPage(random, RandomFileSize(random, options), options, vocabulary, summary.plantedKeywords);
+        const std::filesystem::path filePath = directory / ("page" + std::to_string(fileIndex) + (fileIndex % 5 == 0 ? ".htm" : ".html"));
+        std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+        if (!file.write(page.data(), static_cast<std::streamsize>(page.size()))) {
+            error = "Could not write " + filePath.string();
+            return false;
+        }
+
+        ++summary.fileCount;
+        summary.totalBytes += page.size();
+    }
+
+    summary.directoryCount = directories.size();
+    return true;
+}
@@ -0,0 +1,46 @@
+// Generator for reproducible synthetic HTML trees used by the benchmark.
+// The same options and seed always produce the same tree: all random numbers come from a
+// SplitMix64 generator and are shaped by hand rather than with the <random> distributions,
+// whose output differs between standard library implementations.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+struct CorpusOptions {
+    size_t fileCount = 1000;
+    // File sizes follow a log-normal distribution around this median, clamped to maxFileSize.
+    size_t medianFileSize = 16 * 1024;
+    double sizeSpread = 1.0;
+    size_t maxFileSize = 4 * 1024 * 1024;
+    // Files are spread over a tree at most directoryDepth levels deep with directoryFanout
+    // subdirectories per level.
+    size_t directoryDepth = 3;
+    size_t directoryFanout = 8;
+    // Average number of planted keyword occurrences per KiB of HTML.
+    double keywordDensity = 0.05;
+    // Planted keywords are drawn from the first keywordVocabulary entries of BenchmarkKeywords().
+    size_t keywordVocabulary = 300;
+    uint64_t seed = 1;
+};
+
+struct CorpusSummary {
+    size_t fileCount = 0;
+    size_t directoryCount = 0;
+    uint64_t totalBytes = 0;
+    size_t plantedKeywords = 0;
+};
+
+// Writes the corpus under root, creating directories as needed.
+// Returns false and sets error if a file could not be written.
+bool GenerateCorpus(const std::filesystem::path& root, const CorpusOptions& options,
+    CorpusSummary& summary, std::string& error);
+
+// The deterministic keyword vocabulary shared by the generator and the runner: a few real tag
+// and attribute names first, then numbered data attributes. Returns the first count entries.
+std::vector<std::string> BenchmarkKeywords(size_t count);
@@ -0,0 +1,158 @@
+// Benchmark harness for Html Scanner.
+// "generate" writes a reproducible synthetic HTML tree, and "run" times the scanner's phases on a
+// tree across keyword-set sizes and thread counts, so hot-loop regressions show up as numbers.
+
+#include "BenchRunner.h"
+#include "CorpusGenerator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+void PrintUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " generate <directory> [options]" << std::endl;
+    std::cerr << "       " << programName << " run <directory> [options]" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "generate options:" << std::endl;
+    std::cerr << "  /files N       number of files (default 1000)" << std::endl;
+    std::cerr << "  /size BYTES    median file size (default 16384)" << std::endl;
+    std::cerr << "  /spread S      log-normal spread of file sizes (default 1.0)" << std::endl;
+    std::cerr << "  /maxsize BYTES largest file size (default 4194304)" << std::endl;
+    std::cerr << "  /depth D       maximum directory depth (default 3)" << std::endl;
+    std::cerr << "  /fanout F      subdirectories per level (default 8)" << std::endl;
+    std::cerr << "  /density X     planted keywords per KiB (default 0.05)" << std::endl;
+    std::cerr << "  /vocab N       number of distinct planted keywords (default 300)" << std::endl;
+    std::cerr << "  /seed S        random seed (default 1)" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "run options:" << std::endl;
+    std::cerr << "  /keywords LIST keyword-set sizes, comma separated (default 1,3,10,100,300)" << std::endl;
+    std::cerr << "  /j LIST        thread counts, comma separated, 0 = all cores (default 1)" << std::endl;
+    std::cerr << "  /mmap          scan with memory-mapped files" << std::endl;
+    std::cerr << "  /repeat N      repetitions per measurement, fastest is reported (default 3)" << std::endl;
+    std::cerr << "  /o FILE        report file written by the output phase (default bench_output.txt)" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Example: " << programName << " generate corpus /files 20000 /depth 4" << std::endl;
+    std::cerr << "Example: " << programName << " run corpus /keywords 1,3,300 /j 1,8" << std::endl;
+}
+
+// Parses a comma-separated list of counts. Returns false if any entry is not a number.
+bool ParseCountList(const std::string& text, std::vector<size_t>& counts) {
+    counts.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        try {
+            counts.push_back(std::stoul(item));
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+    }
+    return !counts.empty();
+}
+
+int main(int argCount, char* argValues[])
+{
+    if (argCount < 3) {
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    const std::string command = argValues[1];
+    const std::filesystem::path directory = argValues[2];
+
+    CorpusOptions corpusOptions;
+    BenchOptions benchOptions;
+    benchOptions.corpusDirectory = directory;
+
+    // --- Argument Parsing Logic ---
+    // Every option except /mmap takes a value, so options are read in flag/value pairs.
+    for (int i = 3; i < argCount; ++i) {
+        const std::string flag = argValues[i];
+
+        if (flag == "/mmap" || flag == "/MMAP") {
+            benchOptions.readMode = ReadMode::Mapped;
+            continue;
+        }
+
+        if (i + 1 >= argCount) {
+            std::cerr << "Error: " << flag << " flag specified without a value." << std::endl;
+            PrintUsage(argValues[0]);
+            return 1;
+        }
+        const std::string value = argValues[++i];
+
+        try {
+            if (flag == "/files") { corpusOptions.fileCount = std::stoul(value); }
+            else if (flag == "/size") { corpusOptions.medianFileSize = std::stoul(value); }
+            else if (flag == "/spread") { corpusOptions.sizeSpread = std::stod(value); }
+            else if (flag == "/maxsize") { corpusOptions.maxFileSize = std::stoul(value); }
+            else if (flag == "/depth") { corpusOptions.directoryDepth = std::stoul(value); }
+            else if (flag == "/fanout") { corpusOptions.directoryFanout = std::stoul(value); }
+            else if (flag == "/density") { corpusOptions.keywordDensity = std::stod(value); }
+            else if (flag == "/vocab") { corpusOptions.keywordVocabulary = std::stoul(value); }
+            else if (flag == "/seed") { corpusOptions.seed = std::stoull(value); }
+            else if (flag == "/repeat") { benchOptions.repeatCount = std::stoul(value); }
+            else if (flag == "/o" || flag == "/O") { benchOptions.reportPath = value; }
+            else if (flag == "/keywords") {
+                if (!ParseCountList(value, benchOptions.keywordCounts)) {
+                    throw std::invalid_argument(value);
+                }
+            }
+            else if (flag == "/j" || flag == "/J") {
+                if (!ParseCountList(value, benchOptions.threadCounts)) {
+                    throw std::invalid_argument(value);
+                }
+                for (size_t& threadCount : benchOptions.threadCounts) {
+                    if (threadCount == 0) {
+                        threadCount = std::max(1u, std::thread::hardware_concurrency());
+                    }
+                }
+            }
+            else {
+                std::cerr << "Error: Unknown flag " << flag << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+        }
+        catch (const std::exception&) {
+            std::cerr << "Error: Invalid value \"" << value << "\" for " << flag << std::endl;
+            PrintUsage(argValues[0]);
+            return 1;
+        }
+    }
+
+    if (command == "generate") {
+        CorpusSummary summary;
+        std::string error;
+        if (!GenerateCorpus(directory, corpusOptions, summary, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Generated " << summary.fileCount << " files in " << summary.directoryCount << " directories, "
+            << summary.totalBytes / 1024 << " KiB, " << summary.plantedKeywords << " planted keywords." << std::endl;
+        return 0;
+    }
+
+    if (command == "run") {
+        if (!std::filesystem::is_directory(directory)) {
+            std::cerr << "Error: " << directory.string() << " is not a directory." << std::endl;
+            return 1;
+        }
+        try {
+            return RunBenchmark(benchOptions);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "An error occurred: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cerr << "Error: Unknown command \"" << command << "\"." << std::endl;
+    PrintUsage(argValues[0]);
+    return 1;
+}
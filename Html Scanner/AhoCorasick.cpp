@@ -0,0 +1,117 @@
+#include "AhoCorasick.h"
+
+#include "CaseFold.h"
+
+#include <queue>
+
+
+AhoCorasick::AhoCorasick(const std::vector<std::string>& keywords)
+    : m_keywordCount(keywords.size())
+{
+    // State 0 is the root of the trie.
+    m_transitions.assign(kAlphabetSize, -1);
+    m_outputs.emplace_back();
+
+    // Insert every keyword into the trie.
+    for (size_t keywordIndex = 0; keywordIndex < keywords.size(); ++keywordIndex) {
+        int32_t state = 0;
+        for (unsigned char c : keywords[keywordIndex]) {
+            const unsigned char lowered = CaseFold::Fold(c);
+            int32_t& next = m_transitions[static_cast<size_t>(state) * kAlphabetSize + lowered];
+            if (next == -1) {
+                next = static_cast<int32_t>(m_outputs.size());
+                m_outputs.emplace_back();
+                m_transitions.resize(m_transitions.size() + kAlphabetSize, -1);
+                // The resize may have invalidated the reference above, so look the edge up again.
+                state = m_transitions[static_cast<size_t>(state) * kAlphabetSize + lowered];
+            }
+            else {
+                state = next;
+            }
+        }
+        m_outputs[state].push_back(keywordIndex);
+    }
+
+    // Breadth-first pass to compute failure links and turn the trie into a full DFA.
+    std::vector<int32_t> failure(m_outputs.size(), 0);
+    std::queue<int32_t> pending;
+
+    for (int c = 0; c < kAlphabetSize; ++c) {
+        int32_t& next = m_transitions[c];
+        if (next == -1) {
+            next = 0;
+        }
+        else {
+            failure[next] = 0;
+            pending.push(next);
+        }
+    }
+
+    while (!pending.empty()) {
+        const int32_t state = pending.front();
+        pending.pop();
+
+        // A state reports everything its failure state reports as well.
+        const std::vector<size_t>& inherited = m_outputs[failure[state]];
+        m_outputs[state].insert(m_outputs[state].end(), inherited.begin(), inherited.end());
+
+        for (int c = 0; c < kAlphabetSize; ++c) {
+            int32_t& next = m_transitions[static_cast<size_t>(state) * kAlphabetSize + c];
+            const int32_t fallback = m_transitions[static_cast<size_t>(failure[state]) * kAlphabetSize + c];
+            if (next == -1) {
+                next = fallback;
+            }
+            else {
+                failure[next] = fallback;
+                pending.push(next);
+            }
+        }
+    }
+
+    // Keywords were inserted lowercase, so uppercase input follows the lowercase edges.
+    for (size_t state = 0; state < m_outputs.size(); ++state) {
+        int32_t* row = &m_transitions[state * kAlphabetSize];
+        for (int c = 'A'; c <= 'Z'; ++c) {
+            row[c] = row[CaseFold::Fold(static_cast<unsigned char>(c))];
+        }
+    }
+
+    m_outputMasks.assign(m_outputs.size(), 0);
+    for (size_t state = 0; state < m_outputs.size(); ++state) {
+        for (size_t keywordIndex : m_outputs[state]) {
+            m_outputMasks[state] |= uint64_t{ 1 } << (keywordIndex % 64);
+        }
+    }
+}
+
+AhoCorasick::State AhoCorasick::Scan(State state, const char* data, size_t size, KeywordHits& hits) const
+{
+    uint64_t pending = hits.PendingMask();
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size && pending != 0; ++i) {
+        state = m_transitions[static_cast<size_t>(state) * kAlphabetSize + bytes[i]];
+        if ((m_outputMasks[state] & pending) == 0) {
+            continue;
+        }
+        bool marked = false;
+        for (size_t keywordIndex : m_outputs[state]) {
+            marked |= hits.Mark(keywordIndex);
+        }
+        if (marked) {
+            pending = hits.PendingMask();
+        }
+    }
+    return state;
+}
+
+AhoCorasick::State AhoCorasick::FindAll(State state, const char* data, size_t size, const MatchFound& found) const
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        state = m_transitions[static_cast<size_t>(state) * kAlphabetSize + bytes[i]];
+        for (size_t keywordIndex : m_outputs[state]) {
+            found(keywordIndex, i + 1);
+        }
+    }
+    return state;
+}
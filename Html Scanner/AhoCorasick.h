@@ -0,0 +1,54 @@
+// Multi-pattern keyword matcher built on the Aho-Corasick automaton.
+// The automaton is compiled once from the keyword list, after which every byte of the
+// scanned text is looked at exactly once regardless of how many keywords there are.
+
+#pragma once
+
+#include "KeywordHits.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+class AhoCorasick {
+public:
+    // Position in the automaton. Carrying it from one buffer to the next lets a keyword
+    // match across buffer boundaries.
+    using State = int32_t;
+    static constexpr State kInitialState = 0;
+
+    // Builds the automaton from the given keywords. Keywords are matched case-insensitively.
+    explicit AhoCorasick(const std::vector<std::string>& keywords);
+
+    // Scans the text starting from the given state and marks every keyword it contains in hits.
+    // Returns the state after the last byte examined, so a file can be fed through in several buffers.
+    // Case folding is built into the goto table, so the text is scanned as-is without making a
+    // lowered copy. Keywords already marked are not reported again, and the scan returns early
+    // once every keyword has been found; check hits.Complete() to stop reading the file.
+    State Scan(State state, const char* data, size_t size, KeywordHits& hits) const;
+
+    // Like Scan, but reports every match to found instead of marking the first one of each keyword.
+    State FindAll(State state, const char* data, size_t size, const MatchFound& found) const;
+
+    size_t KeywordCount() const { return m_keywordCount; }
+
+private:
+    static constexpr int kAlphabetSize = 256;
+
+    // Dense goto table: m_transitions[state * kAlphabetSize + byte] is the next state.
+    // Missing trie edges are filled in from the failure links, so the scan never backtracks,
+    // and uppercase ASCII edges mirror their lowercase counterparts.
+    std::vector<int32_t> m_transitions;
+
+    // Keyword indices that end at each state, including those inherited through failure links.
+    std::vector<std::vector<size_t>> m_outputs;
+
+    // Per state, bit b is set if any of its outputs has an index that is b modulo 64. Scan skips a
+    // state whose mask shares no bit with KeywordHits::PendingMask(), so passing through a state
+    // whose keywords have all been found costs one test.
+    std::vector<uint64_t> m_outputMasks;
+
+    size_t m_keywordCount = 0;
+};
@@ -0,0 +1,404 @@
+#include "AsyncReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <system_error>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HTMLSCANNER_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+#endif
+
+
+// One read in flight. Requests are owned by the reader and recycled, so the kernel can hold on
+// to their addresses until the read completes.
+struct AsyncReader::Request {
+#ifdef _WIN32
+    // Must stay the first member: completions hand back a pointer to it.
+    OVERLAPPED overlapped;
+#elif defined(HTMLSCANNER_HAS_IO_URING)
+    iovec vector;
+#endif
+    void* userData = nullptr;
+};
+
+#ifdef _WIN32
+
+struct AsyncReader::Ring {
+    HANDLE port = nullptr;
+
+    ~Ring() {
+        if (port != nullptr) {
+            CloseHandle(port);
+        }
+    }
+};
+
+#elif defined(HTMLSCANNER_HAS_IO_URING)
+
+// The submission and completion rings shared with the kernel. Only this thread touches them, so
+// the only ordering needed is against the kernel: tails are published with release stores and
+// the kernel's side is read with acquire loads.
+struct AsyncReader::Ring {
+    int fd = -1;
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    // Entries written to the submission ring but not yet handed to the kernel.
+    unsigned pendingSubmit = 0;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing != MAP_FAILED && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != MAP_FAILED) {
+            munmap(sqRing, sqRingSize);
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    bool Setup(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            fd = -1;
+            return false;
+        }
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMapping) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            return false;
+        }
+        cqRing = singleMapping
+            ? sqRing
+            : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            return false;
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char* sqBase = static_cast<char*>(sqRing);
+        char* cqBase = static_cast<char*>(cqRing);
+        sqTail = reinterpret_cast<unsigned*>(sqBase + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sqBase + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sqBase + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cqBase + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cqBase + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cqBase + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cqBase + params.cq_off.cqes);
+        return true;
+    }
+};
+
+#else
+
+struct AsyncReader::Ring {
+};
+
+#endif
+
+AsyncReader::AsyncReader(size_t queueDepth)
+{
+    queueDepth = std::clamp<size_t>(queueDepth, 1, 4096);
+    for (size_t i = 0; i < queueDepth; ++i) {
+        m_requests.push_back(std::make_unique<Request>());
+        m_freeRequests.push_back(m_requests.back().get());
+    }
+
+#ifdef _WIN32
+    m_ring = std::make_unique<Ring>();
+    m_ring->port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+    if (m_ring->port == nullptr) {
+        m_ring.reset();
+    }
+#elif defined(HTMLSCANNER_HAS_IO_URING)
+    m_ring = std::make_unique<Ring>();
+    if (!m_ring->Setup(static_cast<unsigned>(queueDepth))) {
+        m_ring.reset();
+    }
+#endif
+}
+
+AsyncReader::~AsyncReader()
+{
+    // The kernel may still write into buffers and requests of reads nobody waited for.
+    Completion completion;
+    while (WaitCompletion(completion)) {
+    }
+}
+
+const char* AsyncReader::BackendName() const
+{
+#ifdef _WIN32
+    return m_ring ? "IOCP" : "ReadFile";
+#else
+    return m_ring ? "io_uring" : "pread";
+#endif
+}
+
+AsyncReader::Request* AsyncReader::AcquireRequest(void* userData)
+{
+    Request* request = m_freeRequests.back();
+    m_freeRequests.pop_back();
+    request->userData = userData;
+    ++m_inFlight;
+    return request;
+}
+
+void AsyncReader::ReleaseRequest(Request* request)
+{
+    m_freeRequests.push_back(request);
+    --m_inFlight;
+}
+
+void AsyncReader::PushReady(const Completion& completion)
+{
+    m_ready.push_back(completion);
+    ++m_inFlight;
+}
+
+#ifdef _WIN32
+
+bool AsyncReader::OpenFile(const std::filesystem::path& filePath, FileHandle& file, uint64_t& fileSize)
+{
+    const DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | (m_ring ? FILE_FLAG_OVERLAPPED : 0);
+    HANDLE handle = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, flags, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)
+        || (m_ring && CreateIoCompletionPort(handle, m_ring->port, 0, 0) == nullptr)) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    file = handle;
+    fileSize = static_cast<uint64_t>(size.QuadPart);
+    return true;
+}
+
+void AsyncReader::CloseFile(FileHandle file)
+{
+    CloseHandle(file);
+}
+
+void AsyncReader::Submit(FileHandle file, uint64_t offset, char* buffer, size_t size, void* userData)
+{
+    if (!m_ring) {
+        ReadNow(file, offset, buffer, size, userData);
+        return;
+    }
+
+    Request* request = AcquireRequest(userData);
+    std::memset(&request->overlapped, 0, sizeof(request->overlapped));
+    request->overlapped.Offset = static_cast<DWORD>(offset);
+    request->overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    const DWORD toRead = static_cast<DWORD>(std::min<size_t>(size, MAXDWORD));
+    if (!ReadFile(file, buffer, toRead, nullptr, &request->overlapped)) {
+        const DWORD error = GetLastError();
+        if (error != ERROR_IO_PENDING) {
+            // Nothing was queued on the port, so the request completes right here.
+            ReleaseRequest(request);
+            PushReady({ userData, 0, error != ERROR_HANDLE_EOF });
+        }
+    }
+}
+
+void AsyncReader::ReadNow(FileHandle file, uint64_t offset, char* buffer, size_t size, void* userData)
+{
+    OVERLAPPED position;
+    std::memset(&position, 0, sizeof(position));
+    position.Offset = static_cast<DWORD>(offset);
+    position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD bytesRead = 0;
+    const BOOL ok = ReadFile(file, buffer, static_cast<DWORD>(std::min<size_t>(size, MAXDWORD)), &bytesRead, &position);
+    PushReady({ userData, ok ? bytesRead : 0, !ok && GetLastError() != ERROR_HANDLE_EOF });
+}
+
+bool AsyncReader::WaitCompletion(Completion& completion)
+{
+    if (!m_ready.empty()) {
+        completion = m_ready.front();
+        m_ready.pop_front();
+        --m_inFlight;
+        return true;
+    }
+    if (m_inFlight == 0) {
+        return false;
+    }
+
+    DWORD bytesRead = 0;
+    ULONG_PTR key = 0;
+    OVERLAPPED* overlapped = nullptr;
+    const BOOL ok = GetQueuedCompletionStatus(m_ring->port, &bytesRead, &key, &overlapped, INFINITE);
+    if (overlapped == nullptr) {
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "GetQueuedCompletionStatus");
+    }
+
+    Request* request = reinterpret_cast<Request*>(overlapped);
+    completion.userData = request->userData;
+    completion.bytesRead = ok ? bytesRead : 0;
+    completion.failed = !ok && GetLastError() != ERROR_HANDLE_EOF;
+    ReleaseRequest(request);
+    return true;
+}
+
+#else
+
+bool AsyncReader::OpenFile(const std::filesystem::path& filePath, FileHandle& file, uint64_t& fileSize)
+{
+    const int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) != 0) {
+        close(fd);
+        return false;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    file = fd;
+    fileSize = static_cast<uint64_t>(fileInfo.st_size);
+    return true;
+}
+
+void AsyncReader::CloseFile(FileHandle file)
+{
+    close(file);
+}
+
+void AsyncReader::Submit(FileHandle file, uint64_t offset, char* buffer, size_t size, void* userData)
+{
+#ifdef HTMLSCANNER_HAS_IO_URING
+    if (m_ring) {
+        Request* request = AcquireRequest(userData);
+        request->vector.iov_base = buffer;
+        request->vector.iov_len = size;
+
+        // Only this thread produces submissions, so the tail can be read without synchronization.
+        const unsigned tail = *m_ring->sqTail;
+        const unsigned index = tail & m_ring->sqMask;
+        io_uring_sqe& entry = m_ring->sqes[index];
+        std::memset(&entry, 0, sizeof(entry));
+        // READV rather than READ so kernels from 5.1 on are supported.
+        entry.opcode = IORING_OP_READV;
+        entry.fd = file;
+        entry.off = offset;
+        entry.addr = reinterpret_cast<uint64_t>(&request->vector);
+        entry.len = 1;
+        entry.user_data = reinterpret_cast<uint64_t>(request);
+        m_ring->sqArray[index] = index;
+        __atomic_store_n(m_ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++m_ring->pendingSubmit;
+        return;
+    }
+#endif
+    ReadNow(file, offset, buffer, size, userData);
+}
+
+void AsyncReader::ReadNow(FileHandle file, uint64_t offset, char* buffer, size_t size, void* userData)
+{
+    ssize_t bytesRead;
+    do {
+        bytesRead = pread(file, buffer, size, static_cast<off_t>(offset));
+    } while (bytesRead < 0 && errno == EINTR);
+    PushReady({ userData, bytesRead > 0 ? static_cast<size_t>(bytesRead) : 0, bytesRead < 0 });
+}
+
+bool AsyncReader::WaitCompletion(Completion& completion)
+{
+    if (!m_ready.empty()) {
+        completion = m_ready.front();
+        m_ready.pop_front();
+        --m_inFlight;
+        return true;
+    }
+    if (m_inFlight == 0) {
+        return false;
+    }
+
+#ifdef HTMLSCANNER_HAS_IO_URING
+    for (;;) {
+        const unsigned head = *m_ring->cqHead;
+        if (head != __atomic_load_n(m_ring->cqTail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe& entry = m_ring->cqes[head & m_ring->cqMask];
+            Request* request = reinterpret_cast<Request*>(entry.user_data);
+            completion.userData = request->userData;
+            completion.bytesRead = entry.res > 0 ? static_cast<size_t>(entry.res) : 0;
+            completion.failed = entry.res < 0;
+            __atomic_store_n(m_ring->cqHead, head + 1, __ATOMIC_RELEASE);
+            ReleaseRequest(request);
+            return true;
+        }
+
+        // Hand over everything queued since the last call and wait for at least one completion,
+        // all in one system call.
+        const long submitted = syscall(__NR_io_uring_enter, m_ring->fd, m_ring->pendingSubmit, 1,
+            IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+        }
+        m_ring->pendingSubmit -= static_cast<unsigned>(submitted);
+    }
+#else
+    // Without a kernel queue every read completes inside Submit.
+    return false;
+#endif
+}
+
+#endif
@@ -0,0 +1,78 @@
+// Completion-based file reads with many requests in flight at once.
+// Uses io_uring on Linux and overlapped I/O with a completion port on Windows, so a single thread
+// can keep a deep queue of reads outstanding against fast storage instead of blocking on one read
+// at a time. Where neither is available (an old kernel, or io_uring disabled by a sandbox), reads
+// fall back to pread and complete immediately, so callers work the same either way.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+
+class AsyncReader {
+public:
+#ifdef _WIN32
+    using FileHandle = void*;
+#else
+    using FileHandle = int;
+#endif
+
+    struct Completion {
+        // The value passed to Submit.
+        void* userData = nullptr;
+        size_t bytesRead = 0;
+        // The read failed rather than reaching the end of the file; bytesRead is 0.
+        bool failed = false;
+    };
+
+    // Sets up a queue with room for queueDepth reads in flight.
+    explicit AsyncReader(size_t queueDepth);
+    ~AsyncReader();
+
+    AsyncReader(const AsyncReader&) = delete;
+    AsyncReader& operator=(const AsyncReader&) = delete;
+
+    // Opens a file for asynchronous reads and reports its size. Returns false if it cannot be opened.
+    bool OpenFile(const std::filesystem::path& filePath, FileHandle& file, uint64_t& fileSize);
+    void CloseFile(FileHandle file);
+
+    // Queues a read of up to size bytes at offset into buffer; the buffer must stay valid until the
+    // read completes. Requires InFlight() < QueueDepth(). Reads may be held back and handed to the
+    // kernel as one batch on the next call to WaitCompletion.
+    void Submit(FileHandle file, uint64_t offset, char* buffer, size_t size, void* userData);
+
+    // Submits anything still queued and waits until a read completes.
+    // Returns false if there is nothing in flight.
+    bool WaitCompletion(Completion& completion);
+
+    size_t InFlight() const { return m_inFlight; }
+    size_t QueueDepth() const { return m_requests.size(); }
+
+    // "io_uring" or "IOCP", or "pread" / "ReadFile" for the synchronous fallback. For diagnostics.
+    const char* BackendName() const;
+
+private:
+    struct Request;
+    struct Ring;
+
+    Request* AcquireRequest(void* userData);
+    void ReleaseRequest(Request* request);
+    // Runs a read on the calling thread and queues its completion, for the fallback path.
+    void ReadNow(FileHandle file, uint64_t offset, char* buffer, size_t size, void* userData);
+    // Queues a completion that is already known. It counts as in flight until it is waited for.
+    void PushReady(const Completion& completion);
+
+    std::vector<std::unique_ptr<Request>> m_requests;
+    std::vector<Request*> m_freeRequests;
+    // Completions that are already known without asking the kernel.
+    std::deque<Completion> m_ready;
+    size_t m_inFlight = 0;
+
+    // Kernel queue state; null when reads fall back to pread.
+    std::unique_ptr<Ring> m_ring;
+};
@@ -0,0 +1,338 @@
+#include "BinaryIndex.h"
+
+#include "CaseFold.h"
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+#include <tuple>
+
+
+namespace {
+
+    constexpr char kMagic[4] = { 'H', 'S', 'B', 'I' };
+    constexpr uint32_t kVersion = 4;
+    constexpr size_t kHeaderSize = 88;
+    // Version 3 has the same header, but its keyword entries are sorted by their bytes.
+    constexpr uint32_t kByteOrderVersion = 3;
+    // Version 2 headers end before the signature fields, version 1 headers before the shard fields.
+    constexpr uint32_t kUnsignedVersion = 2;
+    constexpr size_t kUnsignedHeaderSize = 72;
+    constexpr uint32_t kUnshardedVersion = 1;
+    constexpr size_t kUnshardedHeaderSize = 64;
+    constexpr size_t kKeywordEntrySize = 32;
+
+    // The format is meant to be shared between machines, so integers are encoded byte by byte
+    // instead of being written in native order.
+    void PutU32(std::string& out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    void PutU64(std::string& out, uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    void PutVarint(std::string& out, uint32_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    uint32_t GetU32(const char* data) {
+        uint32_t value = 0;
+        for (int i = 3; i >= 0; --i) {
+            value = (value << 8) | static_cast<unsigned char>(data[i]);
+        }
+        return value;
+    }
+
+    uint64_t GetU64(const char* data) {
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; --i) {
+            value = (value << 8) | static_cast<unsigned char>(data[i]);
+        }
+        return value;
+    }
+
+    // Decodes one varint of at most 5 bytes. Returns false if the input ends inside it or it does
+    // not fit in 32 bits.
+    bool GetVarint(const unsigned char*& cursor, const unsigned char* end, uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (cursor == end) {
+                return false;
+            }
+            const unsigned char byte = *cursor++;
+            if (shift == 28 && (byte & 0x70) != 0) {
+                return false;
+            }
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // True if length bytes at offset fit inside a region of regionSize bytes, without overflowing.
+    bool Within(uint64_t offset, uint64_t length, uint64_t regionSize) {
+        return offset <= regionSize && length <= regionSize - offset;
+    }
+
+}
+
+bool WriteBinaryIndex(const std::filesystem::path& outputPath, const std::string& rootDirectory,
+    const std::string& signature, const PathTable& paths, const std::vector<std::string>& keywords,
+    const std::vector<std::vector<FileId>>& fileIdsByKeyword, uint32_t shardIndex, uint32_t shardCount)
+{
+    // Number the files that matched anything densely, keeping their relative order.
+    constexpr uint32_t kUnused = static_cast<uint32_t>(-1);
+    std::vector<uint32_t> denseIds(paths.Size(), kUnused);
+    for (const auto& ids : fileIdsByKeyword) {
+        for (FileId fileId : ids) {
+            denseIds[fileId] = 0;
+        }
+    }
+
+    std::string stringData = rootDirectory + signature;
+    std::string pathIndex;
+    uint32_t pathCount = 0;
+    for (FileId fileId = 0; fileId < paths.Size(); ++fileId) {
+        if (denseIds[fileId] == kUnused) {
+            continue;
+        }
+        denseIds[fileId] = pathCount++;
+        PutU64(pathIndex, stringData.size());
+        stringData += paths.String(fileId);
+    }
+    PutU64(pathIndex, stringData.size());
+
+    // The reader binary-searches the entries by case-folded name, so they go in that order.
+    std::vector<std::string> foldedKeywords;
+    for (const auto& keyword : keywords) {
+        foldedKeywords.push_back(CaseFold::FoldText(keyword));
+    }
+    std::vector<size_t> keywordOrder(keywords.size());
+    std::iota(keywordOrder.begin(), keywordOrder.end(), size_t(0));
+    std::sort(keywordOrder.begin(), keywordOrder.end(), [&](size_t left, size_t right) {
+        return std::tie(foldedKeywords[left], keywords[left]) < std::tie(foldedKeywords[right], keywords[right]);
+    });
+
+    std::string keywordIndex;
+    std::string postingsData;
+    uint32_t keywordCount = 0;
+    for (size_t keywordId : keywordOrder) {
+        const std::vector<FileId>& ids = fileIdsByKeyword[keywordId];
+        if (ids.empty()) {
+            continue;
+        }
+        ++keywordCount;
+        const size_t postingsStart = postingsData.size();
+        uint32_t previous = 0;
+        for (FileId fileId : ids) {
+            const uint32_t id = denseIds[fileId];
+            PutVarint(postingsData, id - previous);
+            previous = id;
+        }
+
+        PutU64(keywordIndex, stringData.size());
+        PutU32(keywordIndex, static_cast<uint32_t>(keywords[keywordId].size()));
+        PutU32(keywordIndex, static_cast<uint32_t>(ids.size()));
+        PutU64(keywordIndex, postingsStart);
+        PutU64(keywordIndex, postingsData.size() - postingsStart);
+        stringData += keywords[keywordId];
+    }
+
+    const uint64_t pathIndexOffset = kHeaderSize;
+    const uint64_t keywordIndexOffset = pathIndexOffset + pathIndex.size();
+    const uint64_t stringDataOffset = keywordIndexOffset + keywordIndex.size();
+    const uint64_t postingsDataOffset = stringDataOffset + stringData.size();
+
+    std::string header(kMagic, sizeof(kMagic));
+    PutU32(header, kVersion);
+    PutU32(header, pathCount);
+    PutU32(header, keywordCount);
+    PutU64(header, pathIndexOffset);
+    PutU64(header, keywordIndexOffset);
+    PutU64(header, stringDataOffset);
+    PutU64(header, postingsDataOffset);
+    PutU64(header, 0);
+    PutU64(header, rootDirectory.size());
+    PutU32(header, shardIndex);
+    PutU32(header, shardCount);
+    PutU64(header, rootDirectory.size());
+    PutU64(header, signature.size());
+
+    std::ofstream outputFile(outputPath, std::ios::binary | std::ios::trunc);
+    if (!outputFile.is_open()) {
+        return false;
+    }
+    for (const std::string* section : { &header, &pathIndex, &keywordIndex, &stringData, &postingsData }) {
+        outputFile.write(section->data(), static_cast<std::streamsize>(section->size()));
+    }
+    return static_cast<bool>(outputFile.flush());
+}
+
+bool BinaryIndexReader::Open(const std::filesystem::path& indexPath)
+{
+    if (!m_file.Open(indexPath) || m_file.Size() < kUnshardedHeaderSize) {
+        m_file.Close();
+        return false;
+    }
+
+    const char* data = m_file.Data();
+    const uint32_t version = GetU32(data + 4);
+    const bool knownVersion = version == kUnshardedVersion ||
+        (version == kUnsignedVersion && m_file.Size() >= kUnsignedHeaderSize) ||
+        ((version == kByteOrderVersion || version == kVersion) && m_file.Size() >= kHeaderSize);
+    if (!std::equal(kMagic, kMagic + sizeof(kMagic), data) || !knownVersion) {
+        m_file.Close();
+        return false;
+    }
+
+    m_pathCount = GetU32(data + 8);
+    m_keywordCount = GetU32(data + 12);
+    m_pathIndexOffset = GetU64(data + 16);
+    m_keywordIndexOffset = GetU64(data + 24);
+    m_stringDataOffset = GetU64(data + 32);
+    m_postingsDataOffset = GetU64(data + 40);
+    m_rootOffset = GetU64(data + 48);
+    m_rootLength = GetU64(data + 56);
+    m_shardIndex = version >= kUnsignedVersion ? GetU32(data + 64) : 0;
+    m_shardCount = version >= kUnsignedVersion ? GetU32(data + 68) : 1;
+    m_signatureOffset = version >= kByteOrderVersion ? GetU64(data + 72) : 0;
+    m_signatureLength = version >= kByteOrderVersion ? GetU64(data + 80) : 0;
+    m_foldedOrder = version == kVersion;
+
+    if (!ValidateHeader()) {
+        m_file.Close();
+        return false;
+    }
+    return true;
+}
+
+bool BinaryIndexReader::ValidateHeader() const
+{
+    // Every section the accessors rely on lies inside the file, in order.
+    const uint64_t size = m_file.Size();
+    if (!Within(m_pathIndexOffset, (static_cast<uint64_t>(m_pathCount) + 1) * 8, m_keywordIndexOffset) ||
+        !Within(m_keywordIndexOffset, static_cast<uint64_t>(m_keywordCount) * kKeywordEntrySize, m_stringDataOffset) ||
+        m_stringDataOffset > m_postingsDataOffset || m_postingsDataOffset > size ||
+        m_shardIndex >= m_shardCount) {
+        return false;
+    }
+    const uint64_t stringDataSize = m_postingsDataOffset - m_stringDataOffset;
+    return Within(m_rootOffset, m_rootLength, stringDataSize) && Within(m_signatureOffset, m_signatureLength, stringDataSize);
+}
+
+std::string_view BinaryIndexReader::RootDirectory() const
+{
+    return std::string_view(m_file.Data() + m_stringDataOffset + m_rootOffset, static_cast<size_t>(m_rootLength));
+}
+
+std::string_view BinaryIndexReader::Signature() const
+{
+    return std::string_view(m_file.Data() + m_stringDataOffset + m_signatureOffset, static_cast<size_t>(m_signatureLength));
+}
+
+bool BinaryIndexReader::Path(uint32_t fileId, std::string_view& path) const
+{
+    const char* entry = m_file.Data() + m_pathIndexOffset + static_cast<uint64_t>(fileId) * 8;
+    const uint64_t begin = GetU64(entry);
+    const uint64_t end = GetU64(entry + 8);
+    if (begin > end || end > m_postingsDataOffset - m_stringDataOffset) {
+        return false;
+    }
+    path = std::string_view(m_file.Data() + m_stringDataOffset + begin, static_cast<size_t>(end - begin));
+    return true;
+}
+
+bool BinaryIndexReader::ReadKeywordEntry(size_t keywordIndex, KeywordEntry& entry) const
+{
+    const char* data = m_file.Data() + m_keywordIndexOffset + keywordIndex * kKeywordEntrySize;
+    entry = { GetU64(data), GetU32(data + 8), GetU32(data + 12), GetU64(data + 16), GetU64(data + 24) };
+    return Within(entry.nameOffset, entry.nameLength, m_postingsDataOffset - m_stringDataOffset) &&
+        Within(entry.postingsOffset, entry.postingsLength, m_file.Size() - m_postingsDataOffset) &&
+        entry.fileCount <= m_pathCount;
+}
+
+bool BinaryIndexReader::Keyword(size_t keywordIndex, std::string_view& keyword) const
+{
+    KeywordEntry entry;
+    if (!ReadKeywordEntry(keywordIndex, entry)) {
+        return false;
+    }
+    keyword = std::string_view(m_file.Data() + m_stringDataOffset + entry.nameOffset, entry.nameLength);
+    return true;
+}
+
+bool BinaryIndexReader::Postings(size_t keywordIndex, std::vector<uint32_t>& fileIds) const
+{
+    fileIds.clear();
+    KeywordEntry entry;
+    if (!ReadKeywordEntry(keywordIndex, entry)) {
+        return false;
+    }
+    const unsigned char* cursor = reinterpret_cast<const unsigned char*>(m_file.Data() + m_postingsDataOffset + entry.postingsOffset);
+    const unsigned char* end = cursor + entry.postingsLength;
+
+    fileIds.reserve(entry.fileCount);
+    uint64_t fileId = 0;
+    while (cursor < end) {
+        uint32_t delta = 0;
+        if (!GetVarint(cursor, end, delta) || (!fileIds.empty() && delta == 0)) {
+            return false;
+        }
+        fileId += delta;
+        if (fileId >= m_pathCount || fileIds.size() == entry.fileCount) {
+            return false;
+        }
+        fileIds.push_back(static_cast<uint32_t>(fileId));
+    }
+    return fileIds.size() == entry.fileCount;
+}
+
+bool BinaryIndexReader::Lookup(std::string_view keyword, std::vector<uint32_t>& fileIds) const
+{
+    fileIds.clear();
+    const std::string folded = CaseFold::FoldText(std::string(keyword));
+    if (!m_foldedOrder) {
+        for (size_t keywordIndex = 0; keywordIndex < m_keywordCount; ++keywordIndex) {
+            std::string_view name;
+            if (!Keyword(keywordIndex, name)) {
+                return false;
+            }
+            if (CaseFold::FoldText(std::string(name)) == folded) {
+                return Postings(keywordIndex, fileIds);
+            }
+        }
+        return true;
+    }
+
+    size_t low = 0;
+    size_t high = m_keywordCount;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        std::string_view name;
+        if (!Keyword(middle, name)) {
+            return false;
+        }
+        const int comparison = CaseFold::FoldText(std::string(name)).compare(folded);
+        if (comparison == 0) {
+            return Postings(middle, fileIds);
+        }
+        if (comparison < 0) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return true;
+}
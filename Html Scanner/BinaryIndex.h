@@ -0,0 +1,121 @@
+// Compact binary inverted index of scan results, written with /format bin.
+//
+// Layout (all integers little-endian):
+//   Header (88 bytes)
+//     char[4]  magic "HSBI"
+//     uint32   version             4; version 3 files sort keyword entries by their bytes, version 2
+//                                  files also end before the scan signature and version 1 files
+//                                  before the shard fields, which read as shard 0/1
+//     uint32   pathCount
+//     uint32   keywordCount
+//     uint64   pathIndexOffset     pathCount + 1 uint64 offsets into the string data
+//     uint64   keywordIndexOffset  keywordCount 32-byte keyword entries, sorted by case-folded name,
+//                                  then by name
+//     uint64   stringDataOffset    root directory, signature, paths and keyword names, back to back
+//     uint64   postingsDataOffset  per-keyword posting lists
+//     uint64   rootOffset          root directory, relative to the string data
+//     uint64   rootLength
+//     uint32   shardIndex          which part of the tree the index covers, for /shard
+//     uint32   shardCount          1 for an index of the whole tree
+//     uint64   signatureOffset     the keywords and options of the scan, relative to the string data
+//     uint64   signatureLength
+//   Keyword entry (32 bytes)
+//     uint64   nameOffset          relative to the string data
+//     uint32   nameLength
+//     uint32   fileCount
+//     uint64   postingsOffset      relative to the postings data
+//     uint64   postingsLength      in bytes
+//   Posting list: ascending file IDs as LEB128 varints, each one stored as the delta to the
+//   previous ID (the first one as-is).
+//
+// Every section is addressed through the header, so a reader can map the file and look up one
+// keyword by binary search, ignoring case as the scan did. Index files come from other machines for merge and /serve, so the
+// reader checks the header and section bounds when it opens the file, and each path, keyword
+// entry and posting list when it is read, without touching the rest of the file.
+
+#pragma once
+
+#include "MappedFile.h"
+#include "PathTable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Writes the results as a binary index. fileIdsByKeyword[i] lists the files that contain
+// keywords[i] by their ID in paths, in ascending order. keywords must be sorted and free of
+// repeats; those without any files are left out. Only files that appear in some list are written,
+// renumbered densely in the same order. signature identifies the full keyword list and options of
+// the scan, which the keyword entries alone cannot, so merge can refuse shards of different scans.
+// An index written by one node of a sharded scan records which shard it holds. Returns false if
+// the file could not be written.
+bool WriteBinaryIndex(const std::filesystem::path& outputPath, const std::string& rootDirectory,
+    const std::string& signature, const PathTable& paths, const std::vector<std::string>& keywords,
+    const std::vector<std::vector<FileId>>& fileIdsByKeyword, uint32_t shardIndex = 0, uint32_t shardCount = 1);
+
+// Read-only view of a binary index. The file is memory-mapped, and only the parts that are asked
+// for are read and checked.
+class BinaryIndexReader {
+public:
+    // Maps the index and checks its header: every section must lie inside the file, in order.
+    // Returns false if the index is missing or its header is malformed.
+    bool Open(const std::filesystem::path& indexPath);
+
+    std::string_view RootDirectory() const;
+    // The signature the index was written with; empty for indexes older than version 3.
+    std::string_view Signature() const;
+
+    uint32_t ShardIndex() const { return m_shardIndex; }
+    uint32_t ShardCount() const { return m_shardCount; }
+
+    // The accessors below return false if the part of the index they read is malformed.
+
+    size_t PathCount() const { return m_pathCount; }
+    // fileId must be below PathCount().
+    bool Path(uint32_t fileId, std::string_view& path) const;
+
+    size_t KeywordCount() const { return m_keywordCount; }
+    // keywordIndex must be below KeywordCount().
+    bool Keyword(size_t keywordIndex, std::string_view& keyword) const;
+
+    // Decodes the posting list of the keyword at keywordIndex into fileIds. The list must lie
+    // inside the postings data and hold exactly its file count of ascending IDs below PathCount().
+    bool Postings(size_t keywordIndex, std::vector<uint32_t>& fileIds) const;
+
+    // Finds a keyword, ignoring case, and decodes its posting list into fileIds, which is left
+    // empty if the keyword is not in the index. Older indexes, not sorted by case-folded name, are
+    // searched one keyword entry at a time.
+    bool Lookup(std::string_view keyword, std::vector<uint32_t>& fileIds) const;
+
+private:
+    struct KeywordEntry {
+        uint64_t nameOffset;
+        uint32_t nameLength;
+        uint32_t fileCount;
+        uint64_t postingsOffset;
+        uint64_t postingsLength;
+    };
+
+    // Reads the entry and checks that its name and posting list lie inside their sections.
+    bool ReadKeywordEntry(size_t keywordIndex, KeywordEntry& entry) const;
+    bool ValidateHeader() const;
+
+    MappedFile m_file;
+    uint32_t m_pathCount = 0;
+    uint32_t m_keywordCount = 0;
+    uint64_t m_pathIndexOffset = 0;
+    uint64_t m_keywordIndexOffset = 0;
+    uint64_t m_stringDataOffset = 0;
+    uint64_t m_postingsDataOffset = 0;
+    uint64_t m_rootOffset = 0;
+    uint64_t m_rootLength = 0;
+    uint64_t m_signatureOffset = 0;
+    uint64_t m_signatureLength = 0;
+    uint32_t m_shardIndex = 0;
+    uint32_t m_shardCount = 1;
+    bool m_foldedOrder = false;
+};
@@ -0,0 +1,323 @@
+#include "BlockReader.h"
+
+#include "CaseFold.h"
+
+#include <cstdint>
+
+#ifdef HTMLSCANNER_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HTMLSCANNER_WITH_BROTLI
+#include <brotli/decode.h>
+#endif
+
+
+namespace {
+
+    // Compressed input is read in blocks of this size.
+    constexpr size_t kInputBlockSize = 256 * 1024;
+
+    // Feeds input to a decoder and collects its output. Both formats are streamed the same way:
+    // Decode consumes what it can of the input, fills what it can of the output, and tells the
+    // caller whether it needs more input, more room, has finished, or hit corrupt data.
+    enum class DecodeResult {
+        NeedInput,
+        NeedOutput,
+        Finished,
+        Corrupt,
+    };
+
+#ifdef HTMLSCANNER_WITH_ZLIB
+
+    class GzipDecoder {
+    public:
+        GzipDecoder() {
+            // 15 window bits plus 32 accepts both gzip and zlib headers.
+            m_ready = inflateInit2(&m_stream, 15 + 32) == Z_OK;
+        }
+        ~GzipDecoder() {
+            if (m_ready) {
+                inflateEnd(&m_stream);
+            }
+        }
+
+        DecodeResult Decode(const uint8_t*& input, size_t& inputSize, uint8_t*& output, size_t& outputSize, bool inputEnded) {
+            if (!m_ready) {
+                return DecodeResult::Corrupt;
+            }
+            m_stream.next_in = const_cast<Bytef*>(input);
+            m_stream.avail_in = static_cast<uInt>(inputSize);
+            m_stream.next_out = output;
+            m_stream.avail_out = static_cast<uInt>(outputSize);
+            const int status = inflate(&m_stream, Z_NO_FLUSH);
+            input = m_stream.next_in;
+            inputSize = m_stream.avail_in;
+            output = m_stream.next_out;
+            outputSize = m_stream.avail_out;
+
+            if (status == Z_STREAM_END) {
+                // gzip files may hold several members back to back; carry on with the next one.
+                if (inputSize > 0 || !inputEnded) {
+                    inflateReset(&m_stream);
+                    return inputSize > 0 ? DecodeResult::NeedOutput : DecodeResult::NeedInput;
+                }
+                return DecodeResult::Finished;
+            }
+            if (status == Z_OK || status == Z_BUF_ERROR) {
+                if (outputSize == 0) {
+                    return DecodeResult::NeedOutput;
+                }
+                // A stream that ends in the middle of a member is truncated.
+                return inputEnded && inputSize == 0 ? DecodeResult::Corrupt : DecodeResult::NeedInput;
+            }
+            return DecodeResult::Corrupt;
+        }
+
+    private:
+        z_stream m_stream{};
+        bool m_ready = false;
+    };
+
+#endif
+
+#ifdef HTMLSCANNER_WITH_BROTLI
+
+    class BrotliDecoder {
+    public:
+        BrotliDecoder() : m_state(BrotliDecoderCreateInstance(nullptr, nullptr, nullptr)) {}
+        ~BrotliDecoder() {
+            if (m_state != nullptr) {
+                BrotliDecoderDestroyInstance(m_state);
+            }
+        }
+
+        DecodeResult Decode(const uint8_t*& input, size_t& inputSize, uint8_t*& output, size_t& outputSize, bool inputEnded) {
+            if (m_state == nullptr) {
+                return DecodeResult::Corrupt;
+            }
+            switch (BrotliDecoderDecompressStream(m_state, &inputSize, &input, &outputSize, &output, nullptr)) {
+            case BROTLI_DECODER_RESULT_SUCCESS:
+                return DecodeResult::Finished;
+            case BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT:
+                return DecodeResult::NeedOutput;
+            case BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT:
+                return inputEnded ? DecodeResult::Corrupt : DecodeResult::NeedInput;
+            default:
+                return DecodeResult::Corrupt;
+            }
+        }
+
+    private:
+        BrotliDecoderState* m_state;
+    };
+
+#endif
+
+    // Whichever of the decoders above a format needs.
+    class StreamDecoder {
+    public:
+        explicit StreamDecoder(Compression compression) {
+#ifdef HTMLSCANNER_WITH_ZLIB
+            if (compression == Compression::Gzip) {
+                m_gzip = std::make_unique<GzipDecoder>();
+            }
+#endif
+#ifdef HTMLSCANNER_WITH_BROTLI
+            if (compression == Compression::Brotli) {
+                m_brotli = std::make_unique<BrotliDecoder>();
+            }
+#endif
+            (void)compression;
+        }
+
+        DecodeResult Decode(const uint8_t*& input, size_t& inputSize, uint8_t*& output, size_t& outputSize, bool inputEnded) {
+#ifdef HTMLSCANNER_WITH_ZLIB
+            if (m_gzip) {
+                return m_gzip->Decode(input, inputSize, output, outputSize, inputEnded);
+            }
+#endif
+#ifdef HTMLSCANNER_WITH_BROTLI
+            if (m_brotli) {
+                return m_brotli->Decode(input, inputSize, output, outputSize, inputEnded);
+            }
+#endif
+            (void)input;
+            (void)inputSize;
+            (void)output;
+            (void)outputSize;
+            (void)inputEnded;
+            return DecodeResult::Corrupt;
+        }
+
+    private:
+#ifdef HTMLSCANNER_WITH_ZLIB
+        std::unique_ptr<GzipDecoder> m_gzip;
+#endif
+#ifdef HTMLSCANNER_WITH_BROTLI
+        std::unique_ptr<BrotliDecoder> m_brotli;
+#endif
+    };
+
+    template <typename CharType>
+    unsigned char FoldAscii(CharType c) {
+        return (c >= 0 && c < 128) ? CaseFold::Fold(static_cast<unsigned char>(c)) : 0;
+    }
+
+}
+
+// The decoder for the open file, plus the compressed bytes read from it but not decoded yet.
+struct BlockReader::Decoder {
+    explicit Decoder(Compression compression) : stream(compression), input(kInputBlockSize) {}
+
+    StreamDecoder stream;
+    std::vector<uint8_t> input;
+    const uint8_t* next = nullptr;
+    size_t available = 0;
+    bool inputEnded = false;
+};
+
+Compression CompressionFromName(const std::filesystem::path::value_type* name, size_t length)
+{
+    if (length < 4 || name[length - 3] != '.') {
+        return Compression::None;
+    }
+    const unsigned char first = FoldAscii(name[length - 2]);
+    const unsigned char second = FoldAscii(name[length - 1]);
+    if (first == 'g' && second == 'z') {
+        return Compression::Gzip;
+    }
+    if (first == 'b' && second == 'r') {
+        return Compression::Brotli;
+    }
+    return Compression::None;
+}
+
+Compression CompressionFromPath(const std::filesystem::path& filePath)
+{
+    const std::filesystem::path::string_type& native = filePath.native();
+    return CompressionFromName(native.c_str(), native.size());
+}
+
+bool CompressionSupported(Compression compression)
+{
+    switch (compression) {
+    case Compression::None:
+        return true;
+#ifdef HTMLSCANNER_WITH_ZLIB
+    case Compression::Gzip:
+        return true;
+#endif
+#ifdef HTMLSCANNER_WITH_BROTLI
+    case Compression::Brotli:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+const char* SupportedCompressionNames()
+{
+#if defined(HTMLSCANNER_WITH_ZLIB) && defined(HTMLSCANNER_WITH_BROTLI)
+    return "gzip, brotli";
+#elif defined(HTMLSCANNER_WITH_ZLIB)
+    return "gzip";
+#elif defined(HTMLSCANNER_WITH_BROTLI)
+    return "brotli";
+#else
+    return "none";
+#endif
+}
+
+bool DecompressBuffer(Compression compression, const char* data, size_t size, std::vector<char>& out)
+{
+    out.clear();
+    if (compression == Compression::None || !CompressionSupported(compression)) {
+        return false;
+    }
+
+    StreamDecoder decoder(compression);
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(data);
+    size_t inputSize = size;
+    size_t filled = 0;
+    for (;;) {
+        // HTML usually compresses four- to tenfold, so start with room for that and grow as needed.
+        if (filled == out.size()) {
+            out.resize(std::max<size_t>(out.size() * 2, std::max<size_t>(size * 4, 4096)));
+        }
+        uint8_t* output = reinterpret_cast<uint8_t*>(out.data()) + filled;
+        size_t outputSize = out.size() - filled;
+        const DecodeResult result = decoder.Decode(input, inputSize, output, outputSize, true);
+        filled = out.size() - outputSize;
+        if (result == DecodeResult::Finished || result == DecodeResult::Corrupt) {
+            out.resize(filled);
+            return result == DecodeResult::Finished;
+        }
+    }
+}
+
+BlockReader::BlockReader() = default;
+
+BlockReader::~BlockReader() = default;
+
+bool BlockReader::Open(const std::filesystem::path& filePath)
+{
+    Close();
+    const Compression compression = CompressionFromPath(filePath);
+    if (!CompressionSupported(compression)) {
+        return false;
+    }
+
+    m_stream.open(filePath, std::ios::binary);
+    if (!m_stream.is_open()) {
+        return false;
+    }
+    if (compression != Compression::None) {
+        m_decoder = std::make_unique<Decoder>(compression);
+    }
+    return true;
+}
+
+size_t BlockReader::Read(char* out, size_t capacity)
+{
+    if (m_ended || capacity == 0) {
+        return 0;
+    }
+
+    if (!m_decoder) {
+        m_stream.read(out, static_cast<std::streamsize>(capacity));
+        const size_t bytesRead = static_cast<size_t>(m_stream.gcount());
+        // A short read means the end of the file, so the next call need not ask again.
+        m_ended = bytesRead < capacity;
+        return bytesRead;
+    }
+
+    Decoder& decoder = *m_decoder;
+    uint8_t* output = reinterpret_cast<uint8_t*>(out);
+    size_t outputSize = capacity;
+    while (outputSize > 0) {
+        if (decoder.available == 0 && !decoder.inputEnded) {
+            m_stream.read(reinterpret_cast<char*>(decoder.input.data()), static_cast<std::streamsize>(decoder.input.size()));
+            decoder.available = static_cast<size_t>(m_stream.gcount());
+            decoder.next = decoder.input.data();
+            decoder.inputEnded = decoder.available < decoder.input.size();
+        }
+
+        const DecodeResult result = decoder.stream.Decode(decoder.next, decoder.available, output, outputSize, decoder.inputEnded);
+        if (result == DecodeResult::Finished || result == DecodeResult::Corrupt) {
+            m_ended = true;
+            break;
+        }
+    }
+    return capacity - outputSize;
+}
+
+void BlockReader::Close()
+{
+    if (m_stream.is_open()) {
+        m_stream.close();
+    }
+    m_stream.clear();
+    m_ended = false;
+    m_decoder.reset();
+}
@@ -0,0 +1,62 @@
+// Sequential block reads of a file, decompressing pre-compressed pages on the way.
+// Files named *.gz are inflated with zlib and *.br with Brotli, so a mirrored corpus can be
+// scanned without unpacking it to disk first. Each format is only compiled in when its library
+// is linked: define HTMLSCANNER_WITH_ZLIB (zlib) or HTMLSCANNER_WITH_BROTLI (brotlidec).
+// Without them, compressed files are not picked up by the walk at all.
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+
+enum class Compression {
+    None,
+    Gzip,
+    Brotli,
+};
+
+// The compression a file name's last suffix stands for, ".gz" or ".br" compared case-insensitively.
+Compression CompressionFromName(const std::filesystem::path::value_type* name, size_t length);
+Compression CompressionFromPath(const std::filesystem::path& filePath);
+
+// True if this build can decompress the format.
+bool CompressionSupported(Compression compression);
+
+// Names the formats this build can decompress, for diagnostics.
+const char* SupportedCompressionNames();
+
+// Decompresses a whole in-memory file into out. Stops at the first corrupt byte, keeping what was
+// decoded up to there, and returns false in that case or if the format is not supported.
+bool DecompressBuffer(Compression compression, const char* data, size_t size, std::vector<char>& out);
+
+class BlockReader {
+public:
+    BlockReader();
+    ~BlockReader();
+
+    BlockReader(const BlockReader&) = delete;
+    BlockReader& operator=(const BlockReader&) = delete;
+
+    // Opens a file, picking the decompressor from its name. Returns false if the file cannot be
+    // opened or its format is not supported by this build.
+    bool Open(const std::filesystem::path& filePath);
+
+    // Fills up to capacity bytes with the next part of the file's contents, decompressed, and
+    // returns how many were written. Returns 0 once the contents are exhausted; a corrupt
+    // compressed stream ends there as well.
+    size_t Read(char* out, size_t capacity);
+
+    void Close();
+
+private:
+    struct Decoder;
+
+    std::ifstream m_stream;
+    bool m_ended = false;
+    // Set while a compressed file is open.
+    std::unique_ptr<Decoder> m_decoder;
+};
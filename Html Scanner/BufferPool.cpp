@@ -0,0 +1,32 @@
+#include "BufferPool.h"
+
+
+BufferPool::BufferPool(size_t bufferCount, size_t bufferSize)
+    : m_bufferSize(bufferSize)
+{
+    if (bufferCount == 0) {
+        bufferCount = 1;
+    }
+    for (size_t i = 0; i < bufferCount; ++i) {
+        m_storage.push_back(std::make_unique<char[]>(bufferSize));
+        m_free.push_back(m_storage.back().get());
+    }
+}
+
+char* BufferPool::Acquire()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_available.wait(lock, [this] { return !m_free.empty(); });
+    char* buffer = m_free.back();
+    m_free.pop_back();
+    return buffer;
+}
+
+void BufferPool::Release(char* buffer)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(buffer);
+    }
+    m_available.notify_one();
+}
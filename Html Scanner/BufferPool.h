@@ -0,0 +1,33 @@
+// Fixed set of equally sized byte buffers shared by the pipeline's reader and matcher threads.
+// All buffers are allocated up front, so the pipeline's memory use does not grow with the input.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+class BufferPool {
+public:
+    BufferPool(size_t bufferCount, size_t bufferSize);
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Waits until a buffer is free and hands it out. Every buffer must be given back with Release.
+    char* Acquire();
+    void Release(char* buffer);
+
+    size_t BufferSize() const { return m_bufferSize; }
+    size_t BufferCount() const { return m_storage.size(); }
+
+private:
+    const size_t m_bufferSize;
+    std::vector<std::unique_ptr<char[]>> m_storage;
+    std::vector<char*> m_free;
+    std::mutex m_mutex;
+    std::condition_variable m_available;
+};
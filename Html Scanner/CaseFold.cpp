@@ -0,0 +1,126 @@
+#include "CaseFold.h"
+
+#include "TextEncoding.h"
+
+
+namespace {
+
+    // A run of uppercase letters whose lowercase forms are delta away. With a step of 2 only every
+    // other code point from first is an uppercase letter, and the ones between are the lowercase.
+    struct CaseRange {
+        uint32_t first;
+        uint32_t last;
+        int32_t delta;
+        uint32_t step;
+    };
+
+    constexpr CaseRange kCaseRanges[] = {
+        { 0x0041, 0x005a, 32, 1 },
+        // Latin-1, around the multiplication sign.
+        { 0x00c0, 0x00d6, 32, 1 },
+        { 0x00d8, 0x00de, 32, 1 },
+        // Latin Extended-A. The dotted and dotless i pair up with ASCII letters and are left alone,
+        // so that ASCII keywords keep matching ASCII text only.
+        { 0x0100, 0x012e, 1, 2 },
+        { 0x0132, 0x0136, 1, 2 },
+        { 0x0139, 0x0147, 1, 2 },
+        { 0x014a, 0x0176, 1, 2 },
+        { 0x0178, 0x0178, 0x00ff - 0x0178, 1 },
+        { 0x0179, 0x017d, 1, 2 },
+        // Greek, with the accented capitals.
+        { 0x0386, 0x0386, 0x03ac - 0x0386, 1 },
+        { 0x0388, 0x038a, 0x03ad - 0x0388, 1 },
+        { 0x038c, 0x038c, 0x03cc - 0x038c, 1 },
+        { 0x038e, 0x038f, 0x03cd - 0x038e, 1 },
+        { 0x0391, 0x03a1, 32, 1 },
+        { 0x03a3, 0x03ab, 32, 1 },
+        // Cyrillic.
+        { 0x0400, 0x040f, 80, 1 },
+        { 0x0410, 0x042f, 32, 1 },
+        { 0x0460, 0x0480, 1, 2 },
+        { 0x048a, 0x04be, 1, 2 },
+        { 0x04c0, 0x04c0, 0x04cf - 0x04c0, 1 },
+        { 0x04c1, 0x04cd, 1, 2 },
+        { 0x04d0, 0x052e, 1, 2 },
+        // Armenian.
+        { 0x0531, 0x0556, 48, 1 },
+        // Latin Extended Additional, with the capital sharp s.
+        { 0x1e00, 0x1e94, 1, 2 },
+        { 0x1e9e, 0x1e9e, 0x00df - 0x1e9e, 1 },
+        { 0x1ea0, 0x1efe, 1, 2 },
+        // Fullwidth Latin.
+        { 0xff21, 0xff3a, 32, 1 },
+    };
+
+    constexpr uint32_t kCapitalSigma = 0x03a3;
+    constexpr uint32_t kSmallSigma = 0x03c3;
+    constexpr uint32_t kFinalSigma = 0x03c2;
+
+    bool InRange(uint32_t codePoint, uint32_t first, uint32_t last, uint32_t step) {
+        return codePoint >= first && codePoint <= last && (codePoint - first) % step == 0;
+    }
+
+    uint32_t ToLower(uint32_t codePoint) {
+        for (const CaseRange& range : kCaseRanges) {
+            if (InRange(codePoint, range.first, range.last, range.step)) {
+                return codePoint + range.delta;
+            }
+        }
+        return codePoint;
+    }
+
+    uint32_t ToUpper(uint32_t codePoint) {
+        for (const CaseRange& range : kCaseRanges) {
+            if (InRange(codePoint, range.first + range.delta, range.last + range.delta, range.step)) {
+                return codePoint - range.delta;
+            }
+        }
+        return codePoint;
+    }
+
+}
+
+size_t CaseFold::Variants(uint32_t codePoint, uint32_t (&variants)[kMaxVariants])
+{
+    size_t count = 0;
+    const auto add = [&](uint32_t variant) {
+        for (size_t i = 0; i < count; ++i) {
+            if (variants[i] == variant) {
+                return;
+            }
+        }
+        variants[count++] = variant;
+    };
+
+    add(codePoint);
+    // Final sigma has no case of its own and folds to the ordinary small sigma.
+    const uint32_t lower = codePoint == kFinalSigma ? kSmallSigma : ToLower(codePoint);
+    add(lower);
+    add(ToUpper(lower));
+    if (lower == kSmallSigma) {
+        add(kCapitalSigma);
+        add(kFinalSigma);
+    }
+    return count;
+}
+
+std::string CaseFold::FoldText(const std::string& text)
+{
+    std::string folded;
+    folded.reserve(text.size());
+    for (size_t position = 0; position < text.size();) {
+        const unsigned char byte = static_cast<unsigned char>(text[position]);
+        if (byte < 0x80) {
+            folded.push_back(static_cast<char>(Fold(byte)));
+            ++position;
+            continue;
+        }
+        uint32_t codePoint = 0;
+        if (!DecodeUtf8(text, position, codePoint)) {
+            folded.push_back(static_cast<char>(byte));
+            continue;
+        }
+        AppendEncoded(codePoint == kFinalSigma ? kSmallSigma : ToLower(codePoint), TextEncoding::Utf8, folded);
+    }
+    return folded;
+}
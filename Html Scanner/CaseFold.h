@@ -0,0 +1,43 @@
+// Case-folding helpers shared by the matchers.
+// ASCII folding goes through a lookup table instead of std::tolower, so it does not depend on
+// the current locale and never allocates. Keywords outside ASCII are folded by code point, with
+// the Unicode simple case mappings of the Latin, Greek, Cyrillic and Armenian alphabets and of
+// fullwidth Latin; the letters each one pairs up are listed in CaseFold.cpp.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+namespace CaseFold {
+
+    // Maps every byte to its lowercase ASCII equivalent. Bytes outside A-Z map to themselves.
+    constexpr std::array<unsigned char, 256> MakeAsciiFoldTable() {
+        std::array<unsigned char, 256> table{};
+        for (size_t i = 0; i < table.size(); ++i) {
+            table[i] = static_cast<unsigned char>(i >= 'A' && i <= 'Z' ? i + ('a' - 'A') : i);
+        }
+        return table;
+    }
+
+    inline constexpr std::array<unsigned char, 256> kAsciiFoldTable = MakeAsciiFoldTable();
+
+    inline unsigned char Fold(unsigned char c) {
+        return kAsciiFoldTable[c];
+    }
+
+    // A code point's case variants are itself and at most two others, as with the three sigmas.
+    constexpr size_t kMaxVariants = 3;
+
+    // Fills variants with every code point that matches codePoint when case is ignored, itself
+    // first, and returns how many there are. Code points without case have only themselves.
+    size_t Variants(uint32_t codePoint, uint32_t (&variants)[kMaxVariants]);
+
+    // Returns UTF-8 text with every letter in lowercase, so two keywords that match the same text
+    // fold to the same string. Bytes that are not UTF-8 are kept as they are.
+    std::string FoldText(const std::string& text);
+
+}
@@ -0,0 +1,18 @@
+// The keyword list that is compiled into the binary as a specialized matcher (see CompiledMatcher.h).
+// Builds for jobs that search the same keywords on every run can fill in the list here, or define
+// HTMLSCANNER_COMPILED_KEYWORDS as the name of another header that declares kCompiledKeywords
+// the same way, for example:
+//
+//     inline constexpr std::array<std::string_view, 4> kCompiledKeywords = { "form", "gallery", "table", "iframe" };
+//
+// The list is empty by default, which builds no specialized matcher. Lists of up to
+// KeywordSearch::kSmallSetLimit keywords are never worth compiling in, since the SIMD kernel
+// searches those faster than any automaton.
+
+#pragma once
+
+#include <array>
+#include <string_view>
+
+
+inline constexpr std::array<std::string_view, 0> kCompiledKeywords = {};
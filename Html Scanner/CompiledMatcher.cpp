@@ -0,0 +1,223 @@
+#include "CompiledMatcher.h"
+
+#include "CaseFold.h"
+
+#ifdef HTMLSCANNER_COMPILED_KEYWORDS
+#include HTMLSCANNER_COMPILED_KEYWORDS
+#else
+#include "CompiledKeywordList.h"
+#endif
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+
+namespace {
+    constexpr size_t kAlphabetSize = 256;
+    constexpr size_t kKeywordCount = kCompiledKeywords.size();
+
+    static_assert(kKeywordCount <= 64, "Each state's output is a 64-bit mask, one bit per compiled-in keyword.");
+
+    // The trie never has more states than the root plus one per keyword byte.
+    constexpr size_t MaxStateCount() {
+        size_t count = 1;
+        for (const std::string_view keyword : kCompiledKeywords) {
+            count += keyword.size();
+        }
+        return count;
+    }
+
+    constexpr size_t kMaxStateCount = MaxStateCount();
+
+    static_assert(kMaxStateCount <= 65536, "The compiled-in keywords need more states than a 16-bit state can address.");
+
+    using State = std::conditional_t<kMaxStateCount <= 256, uint8_t, uint16_t>;
+
+    struct Automaton {
+        // next[state * kAlphabetSize + byte], with uppercase ASCII edges mirroring lowercase ones.
+        std::array<State, kMaxStateCount * kAlphabetSize> next{};
+        // Bit i is set in every state where compiled-in keyword i ends, failure links included.
+        std::array<uint64_t, kMaxStateCount> outputs{};
+        // True for the bytes that leave the initial state.
+        std::array<bool, kAlphabetSize> startsKeyword{};
+        size_t stateCount = 1;
+    };
+
+    // The same construction as the AhoCorasick class, written so it can run at compile time.
+    constexpr Automaton BuildAutomaton() {
+        Automaton automaton{};
+
+        // Trie edges, -1 where there is none yet.
+        std::array<int32_t, kMaxStateCount * kAlphabetSize> trie{};
+        for (int32_t& edge : trie) {
+            edge = -1;
+        }
+
+        for (size_t keywordIndex = 0; keywordIndex < kKeywordCount; ++keywordIndex) {
+            size_t state = 0;
+            for (const char c : kCompiledKeywords[keywordIndex]) {
+                int32_t& edge = trie[state * kAlphabetSize + CaseFold::kAsciiFoldTable[static_cast<unsigned char>(c)]];
+                if (edge == -1) {
+                    edge = static_cast<int32_t>(automaton.stateCount++);
+                }
+                state = static_cast<size_t>(edge);
+            }
+            automaton.outputs[state] |= uint64_t{ 1 } << keywordIndex;
+        }
+
+        // Breadth-first pass over the trie to compute the failure links and fill in the missing edges.
+        std::array<size_t, kMaxStateCount> failure{};
+        std::array<size_t, kMaxStateCount> pending{};
+        size_t head = 0;
+        size_t tail = 0;
+
+        for (size_t c = 0; c < kAlphabetSize; ++c) {
+            const int32_t edge = trie[c];
+            if (edge != -1) {
+                automaton.next[c] = static_cast<State>(edge);
+                automaton.startsKeyword[c] = true;
+                pending[tail++] = static_cast<size_t>(edge);
+            }
+        }
+
+        while (head != tail) {
+            const size_t state = pending[head++];
+            automaton.outputs[state] |= automaton.outputs[failure[state]];
+
+            for (size_t c = 0; c < kAlphabetSize; ++c) {
+                const int32_t edge = trie[state * kAlphabetSize + c];
+                const State fallback = automaton.next[failure[state] * kAlphabetSize + c];
+                if (edge == -1) {
+                    automaton.next[state * kAlphabetSize + c] = fallback;
+                }
+                else {
+                    automaton.next[state * kAlphabetSize + c] = static_cast<State>(edge);
+                    failure[static_cast<size_t>(edge)] = fallback;
+                    pending[tail++] = static_cast<size_t>(edge);
+                }
+            }
+        }
+
+        // Keywords were inserted lowercase, so uppercase input follows the lowercase edges.
+        for (size_t state = 0; state < automaton.stateCount; ++state) {
+            for (size_t c = 'A'; c <= 'Z'; ++c) {
+                automaton.next[state * kAlphabetSize + c] = automaton.next[state * kAlphabetSize + CaseFold::kAsciiFoldTable[c]];
+            }
+        }
+        for (size_t c = 'A'; c <= 'Z'; ++c) {
+            automaton.startsKeyword[c] = automaton.startsKeyword[CaseFold::kAsciiFoldTable[c]];
+        }
+
+        return automaton;
+    }
+
+    constexpr Automaton kAutomaton = BuildAutomaton();
+
+    bool EqualFolded(std::string_view left, std::string_view right) {
+        if (left.size() != right.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < left.size(); ++i) {
+            if (CaseFold::Fold(static_cast<unsigned char>(left[i])) != CaseFold::Fold(static_cast<unsigned char>(right[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+namespace CompiledMatcher {
+
+    bool Matches(const std::vector<std::string>& keywords, std::vector<size_t>& slots)
+    {
+        if (kKeywordCount == 0 || keywords.size() != kKeywordCount) {
+            return false;
+        }
+
+        // Pair every compiled-in keyword with a distinct requested one, so duplicates on
+        // either side only match when they line up exactly.
+        std::vector<char> used(keywords.size(), 0);
+        slots.assign(kKeywordCount, 0);
+        for (size_t compiledIndex = 0; compiledIndex < kKeywordCount; ++compiledIndex) {
+            size_t keywordIndex = 0;
+            while (keywordIndex < keywords.size()
+                && (used[keywordIndex] || !EqualFolded(keywords[keywordIndex], kCompiledKeywords[compiledIndex]))) {
+                ++keywordIndex;
+            }
+            if (keywordIndex == keywords.size()) {
+                slots.clear();
+                return false;
+            }
+            used[keywordIndex] = 1;
+            slots[compiledIndex] = keywordIndex;
+        }
+        return true;
+    }
+
+    void Scan(const char* data, size_t size, const std::vector<size_t>& slots, KeywordHits& hits)
+    {
+        uint64_t pending = 0;
+        for (size_t compiledIndex = 0; compiledIndex < slots.size(); ++compiledIndex) {
+            if (!hits.Found(slots[compiledIndex])) {
+                pending |= uint64_t{ 1 } << compiledIndex;
+            }
+        }
+
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        size_t state = 0;
+        size_t i = 0;
+        while (pending != 0 && i < size) {
+            if (state == 0) {
+                // From the initial state, a byte that starts no keyword leads straight back to it.
+                while (i < size && !kAutomaton.startsKeyword[bytes[i]]) {
+                    ++i;
+                }
+                if (i == size) {
+                    break;
+                }
+            }
+
+            state = kAutomaton.next[state * kAlphabetSize + bytes[i++]];
+            uint64_t matched = kAutomaton.outputs[state] & pending;
+            if (matched != 0) {
+                pending &= ~matched;
+                for (size_t compiledIndex = 0; matched != 0; ++compiledIndex, matched >>= 1) {
+                    if (matched & 1) {
+                        hits.Mark(slots[compiledIndex]);
+                    }
+                }
+            }
+        }
+    }
+
+    void FindAll(const char* data, size_t size, const std::vector<size_t>& slots, const MatchFound& found)
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        size_t state = 0;
+        size_t i = 0;
+        while (i < size) {
+            if (state == 0) {
+                while (i < size && !kAutomaton.startsKeyword[bytes[i]]) {
+                    ++i;
+                }
+                if (i == size) {
+                    break;
+                }
+            }
+
+            state = kAutomaton.next[state * kAlphabetSize + bytes[i++]];
+            for (uint64_t matched = kAutomaton.outputs[state], compiledIndex = 0; matched != 0; ++compiledIndex, matched >>= 1) {
+                if (matched & 1) {
+                    found(slots[compiledIndex], i);
+                }
+            }
+        }
+    }
+
+    size_t StateCount()
+    {
+        return kAutomaton.stateCount;
+    }
+
+}
@@ -0,0 +1,35 @@
+// Keyword matcher specialized at compile time for one fixed keyword list.
+// The Aho-Corasick automaton for the list is built by constexpr code, so it ships in read-only
+// data instead of being built at startup. Knowing the automaton's size up front lets the state
+// type shrink to 8 or 16 bits, every state's output become a single bitmask, and a first-byte
+// table skip the text that cannot start a keyword without touching the goto table at all.
+// Only runs that ask for exactly the compiled-in keywords use it; any other list goes through
+// the generic engines.
+
+#pragma once
+
+#include "KeywordHits.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+namespace CompiledMatcher {
+
+    // If keywords holds exactly the compiled-in keywords, in any order and compared
+    // case-insensitively, fills slots so that slots[i] is the index in keywords of compiled-in
+    // keyword i, and returns true.
+    bool Matches(const std::vector<std::string>& keywords, std::vector<size_t>& slots);
+
+    // Marks every keyword contained in the text, using the slots filled in by Matches.
+    // Keywords already marked in hits are skipped and the scan stops once all of them are found.
+    void Scan(const char* data, size_t size, const std::vector<size_t>& slots, KeywordHits& hits);
+
+    // Reports every match in the text to found, in keyword list indices through slots.
+    void FindAll(const char* data, size_t size, const std::vector<size_t>& slots, const MatchFound& found);
+
+    // Number of states in the compiled-in automaton, for diagnostics.
+    size_t StateCount();
+
+}
@@ -0,0 +1,319 @@
+#include "DirectoryWalker.h"
+
+#include "WorkStealingPool.h"
+
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+
+namespace {
+    enum class EntryKind {
+        HtmlFile,
+        Directory,
+    };
+
+    // A directory entry the walk cares about. Everything else is dropped while listing.
+    struct ListedEntry {
+        std::filesystem::path::string_type name;
+        EntryKind kind;
+    };
+
+    template <typename CharType>
+    bool IsDotOrDotDot(const CharType* name) {
+        return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+    }
+
+#ifdef _WIN32
+
+    // Appends the accepted files and subdirectories of a directory in listing order and counts what
+    // it skipped. Sets error if the directory could not be listed completely.
+    void ListDirectory(const std::filesystem::path& directory, const FileFilter& filter,
+        std::vector<ListedEntry>& entries, std::error_code& error, WalkCounters& counters) {
+        // FindExInfoBasic skips the short 8.3 names and the large fetch flag asks for bigger
+        // batches per round trip, which matters most on network shares.
+        const std::filesystem::path pattern = directory / L"*";
+        WIN32_FIND_DATAW data;
+        HANDLE find = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch,
+            nullptr, FIND_FIRST_EX_LARGE_FETCH);
+        if (find == INVALID_HANDLE_VALUE) {
+            const DWORD lastError = GetLastError();
+            if (lastError != ERROR_FILE_NOT_FOUND) {
+                error.assign(static_cast<int>(lastError), std::system_category());
+            }
+            return;
+        }
+
+        do {
+            if (IsDotOrDotDot(data.cFileName)) {
+                continue;
+            }
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                // Junctions and directory symlinks are reparse points. Like the standard
+                // iterator, the walk does not descend into them.
+                if (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+                    continue;
+                }
+                if (filter.ExcludesDirectory(data.cFileName)) {
+                    ++counters.directoriesExcluded;
+                    continue;
+                }
+                entries.push_back({ data.cFileName, EntryKind::Directory });
+                continue;
+            }
+
+            ++counters.filesSeen;
+            if (!filter.HasExtension(data.cFileName)) {
+                ++counters.filesSkippedByExtension;
+            }
+            else if (!filter.PassesPatterns(data.cFileName)) {
+                ++counters.filesExcluded;
+            }
+            else {
+                entries.push_back({ data.cFileName, EntryKind::HtmlFile });
+            }
+        } while (FindNextFileW(find, &data));
+
+        const DWORD lastError = GetLastError();
+        FindClose(find);
+        if (lastError != ERROR_NO_MORE_FILES) {
+            error.assign(static_cast<int>(lastError), std::system_category());
+        }
+    }
+
+#else
+
+    // Appends the accepted files and subdirectories of a directory in listing order and counts what
+    // it skipped. Sets error if the directory could not be listed completely.
+    void ListDirectory(const std::filesystem::path& directory, const FileFilter& filter,
+        std::vector<ListedEntry>& entries, std::error_code& error, WalkCounters& counters) {
+        DIR* handle = opendir(directory.c_str());
+        if (handle == nullptr) {
+            error.assign(errno, std::generic_category());
+            return;
+        }
+        const int directoryFd = dirfd(handle);
+
+        for (;;) {
+            errno = 0;
+            const dirent* entry = readdir(handle);
+            if (entry == nullptr) {
+                if (errno != 0) {
+                    error.assign(errno, std::generic_category());
+                }
+                break;
+            }
+
+            const char* name = entry->d_name;
+            if (IsDotOrDotDot(name)) {
+                continue;
+            }
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                // Some filesystems leave d_type empty, so only then does the entry cost a stat.
+                struct stat info;
+                if (fstatat(directoryFd, name, &info, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : S_ISLNK(info.st_mode) ? DT_LNK : DT_UNKNOWN;
+            }
+
+            if (type == DT_DIR) {
+                if (filter.ExcludesDirectory(name)) {
+                    ++counters.directoriesExcluded;
+                    continue;
+                }
+                entries.push_back({ name, EntryKind::Directory });
+                continue;
+            }
+            if (type != DT_REG && type != DT_LNK) {
+                continue;
+            }
+
+            ++counters.filesSeen;
+            if (!filter.HasExtension(name)) {
+                ++counters.filesSkippedByExtension;
+                continue;
+            }
+            if (!filter.PassesPatterns(name)) {
+                ++counters.filesExcluded;
+                continue;
+            }
+            if (type == DT_LNK) {
+                // A link counts when it points at a regular file, as with directory_entry::is_regular_file().
+                struct stat info;
+                if (fstatat(directoryFd, name, &info, 0) != 0 || !S_ISREG(info.st_mode)) {
+                    continue;
+                }
+            }
+            entries.push_back({ name, EntryKind::HtmlFile });
+        }
+
+        closedir(handle);
+    }
+
+#endif
+
+    void ReportError(const WalkErrorCallback& walkFailed, const std::filesystem::path& directory, const std::error_code& error) {
+        if (walkFailed) {
+            walkFailed(std::filesystem::filesystem_error("cannot open directory", directory, error).what());
+        }
+    }
+
+    void WalkSequential(const std::filesystem::path& root, const FileFilter& filter, const FileFoundCallback& fileFound,
+        const WalkErrorCallback& walkFailed, WalkCounters& counters) {
+        struct Frame {
+            std::filesystem::path directory;
+            std::vector<ListedEntry> entries;
+            size_t next = 0;
+        };
+
+        // An explicit stack keeps very deep trees from exhausting the thread's stack.
+        std::vector<Frame> stack;
+        auto enter = [&](std::filesystem::path directory) {
+            Frame frame;
+            frame.directory = std::move(directory);
+            std::error_code error;
+            ListDirectory(frame.directory, filter, frame.entries, error, counters);
+            ++counters.directoriesListed;
+            if (error) {
+                ReportError(walkFailed, frame.directory, error);
+            }
+            stack.push_back(std::move(frame));
+        };
+
+        enter(root);
+        while (!stack.empty()) {
+            Frame& frame = stack.back();
+            if (frame.next == frame.entries.size()) {
+                stack.pop_back();
+                continue;
+            }
+
+            const ListedEntry& entry = frame.entries[frame.next++];
+            std::filesystem::path entryPath = frame.directory / entry.name;
+            if (entry.kind == EntryKind::HtmlFile) {
+                fileFound(entryPath);
+            }
+            else {
+                enter(std::move(entryPath));
+            }
+        }
+    }
+
+    // Listing of one directory. Each subdirectory gets its own node, filled in by whichever
+    // worker lists it, so no two threads ever write to the same node.
+    struct DirectoryNode {
+        std::filesystem::path directory;
+        std::vector<ListedEntry> entries;
+        // One node per Directory entry, in the same order.
+        std::vector<std::unique_ptr<DirectoryNode>> children;
+        std::error_code error;
+        WalkCounters counters;
+    };
+
+    void ListTree(WorkStealingPool& pool, const FileFilter& filter, DirectoryNode& node) {
+        ListDirectory(node.directory, filter, node.entries, node.error, node.counters);
+        for (const auto& entry : node.entries) {
+            if (entry.kind == EntryKind::Directory) {
+                auto child = std::make_unique<DirectoryNode>();
+                child->directory = node.directory / entry.name;
+                node.children.push_back(std::move(child));
+            }
+        }
+
+        // The children are only queued once the vector above has stopped growing.
+        for (const auto& child : node.children) {
+            DirectoryNode* childNode = child.get();
+            pool.Submit([&pool, &filter, childNode](size_t) { ListTree(pool, filter, *childNode); });
+        }
+    }
+
+    void WalkParallel(const std::filesystem::path& root, size_t threadCount, const FileFilter& filter,
+        const FileFoundCallback& fileFound, const WalkErrorCallback& walkFailed, WalkCounters& counters) {
+        DirectoryNode rootNode;
+        rootNode.directory = root;
+        {
+            WorkStealingPool pool(threadCount);
+            pool.Submit([&pool, &filter, &rootNode](size_t) { ListTree(pool, filter, rootNode); });
+            pool.Wait();
+        }
+
+        // Replay the listed tree depth-first, which is the order the sequential walk reports in.
+        struct Frame {
+            const DirectoryNode* node;
+            size_t nextEntry = 0;
+            size_t nextChild = 0;
+        };
+
+        std::vector<Frame> stack;
+        auto enter = [&](const DirectoryNode& node) {
+            ++counters.directoriesListed;
+            counters.filesSeen += node.counters.filesSeen;
+            counters.filesSkippedByExtension += node.counters.filesSkippedByExtension;
+            counters.filesExcluded += node.counters.filesExcluded;
+            counters.directoriesExcluded += node.counters.directoriesExcluded;
+            if (node.error) {
+                ReportError(walkFailed, node.directory, node.error);
+            }
+            stack.push_back({ &node });
+        };
+
+        enter(rootNode);
+        while (!stack.empty()) {
+            Frame& frame = stack.back();
+            if (frame.nextEntry == frame.node->entries.size()) {
+                stack.pop_back();
+                continue;
+            }
+
+            const ListedEntry& entry = frame.node->entries[frame.nextEntry++];
+            if (entry.kind == EntryKind::HtmlFile) {
+                fileFound(frame.node->directory / entry.name);
+            }
+            else {
+                enter(*frame.node->children[frame.nextChild++]);
+            }
+        }
+    }
+}
+
+void WalkHtmlFiles(const std::filesystem::path& root, size_t threadCount, const FileFilter& filter,
+    const FileFoundCallback& fileFound, const WalkErrorCallback& walkFailed, WalkCounters* counters)
+{
+    WalkCounters localCounters;
+    WalkCounters& target = counters != nullptr ? *counters : localCounters;
+
+    // Shards are decided on the whole relative path, which only exists once a file is found.
+    FileFoundCallback shardFound;
+    if (filter.Sharded()) {
+        shardFound = [&](const std::filesystem::path& filePath) {
+            if (filter.InShard(filePath.lexically_relative(root))) {
+                fileFound(filePath);
+            }
+            else {
+                ++target.filesInOtherShards;
+            }
+        };
+    }
+    const FileFoundCallback& found = filter.Sharded() ? shardFound : fileFound;
+
+    if (threadCount <= 1) {
+        WalkSequential(root, filter, found, walkFailed, target);
+    }
+    else {
+        WalkParallel(root, threadCount, filter, found, walkFailed, target);
+    }
+}
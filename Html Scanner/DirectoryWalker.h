@@ -0,0 +1,49 @@
+// Directory walk that finds the HTML files below a root directory.
+// Which files count, and which subtrees are skipped, is up to a FileFilter. Entries are classified
+// from what the directory listing already says (d_type on POSIX, the find data attributes on
+// Windows), so no file is stat'ed just to learn whether it is a regular file. With several threads,
+// sibling subdirectories are listed concurrently, which pays off on very wide trees and on network
+// filesystems where every listing is a round trip.
+
+#pragma once
+
+#include "FileFilter.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+
+// What the walk came across, for statistics.
+struct WalkCounters {
+    size_t directoriesListed = 0;
+    // Regular files and symbolic links, HTML or not.
+    size_t filesSeen = 0;
+    size_t filesSkippedByExtension = 0;
+    // Files with a matching extension turned away by the include or exclude patterns.
+    size_t filesExcluded = 0;
+    // Directories pruned by an exclude pattern, not counting anything below them.
+    size_t directoriesExcluded = 0;
+    // Accepted files left to the other nodes of a sharded scan.
+    size_t filesInOtherShards = 0;
+};
+
+using FileFoundCallback = std::function<void(const std::filesystem::path& filePath)>;
+using WalkErrorCallback = std::function<void(const std::string& message)>;
+
+// Calls fileFound for every regular file below root that the filter accepts, in the same order
+// std::filesystem::recursive_directory_iterator would visit them. Symbolic links to files are
+// followed; symbolic links to directories, and directories the filter excludes, are not
+// descended into.
+//
+// With a single thread the callbacks stream out while the tree is walked. With more, the tree is
+// listed in parallel first and the callbacks run afterwards, still in walk order. Either way they
+// are only ever called from the calling thread.
+//
+// With a sharded filter, only the files of its shard are reported.
+//
+// A directory that cannot be listed is reported through walkFailed and skipped; the rest of the
+// tree is still walked. If counters is given, the walk adds what it saw to it.
+void WalkHtmlFiles(const std::filesystem::path& root, size_t threadCount, const FileFilter& filter,
+    const FileFoundCallback& fileFound, const WalkErrorCallback& walkFailed, WalkCounters* counters = nullptr);
@@ -0,0 +1,351 @@
+#include "DirectoryWatcher.h"
+
+#include <system_error>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <unordered_map>
+#endif
+
+
+namespace {
+
+    std::string SystemMessage(const char* what, int code, const std::error_category& category) {
+        return std::string(what) + ": " + std::error_code(code, category).message();
+    }
+
+}
+
+#ifdef _WIN32
+
+class DirectoryWatcher::Backend {
+public:
+    ~Backend() {
+        if (m_directory != INVALID_HANDLE_VALUE) {
+            if (m_pending) {
+                // The kernel still owns the buffer until the cancelled read has completed.
+                CancelIoEx(m_directory, &m_overlapped);
+                DWORD ignored = 0;
+                GetOverlappedResult(m_directory, &m_overlapped, &ignored, TRUE);
+            }
+            CloseHandle(m_directory);
+        }
+        if (m_overlapped.hEvent != nullptr) {
+            CloseHandle(m_overlapped.hEvent);
+        }
+    }
+
+    bool Start(const std::filesystem::path& root, std::string& error) {
+        m_root = root;
+        m_directory = CreateFileW(root.c_str(), FILE_LIST_DIRECTORY,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+            FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        if (m_directory == INVALID_HANDLE_VALUE) {
+            error = SystemMessage("cannot open directory", static_cast<int>(GetLastError()), std::system_category());
+            return false;
+        }
+        m_overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (m_overlapped.hEvent == nullptr) {
+            error = SystemMessage("cannot create event", static_cast<int>(GetLastError()), std::system_category());
+            return false;
+        }
+        return Issue(error);
+    }
+
+    bool Wait(std::chrono::milliseconds timeout, std::vector<WatchEvent>& events, std::string& error) {
+        const DWORD waited = WaitForSingleObject(m_overlapped.hEvent, static_cast<DWORD>(timeout.count()));
+        if (waited == WAIT_TIMEOUT) {
+            return true;
+        }
+
+        m_pending = false;
+        DWORD bytes = 0;
+        if (!GetOverlappedResult(m_directory, &m_overlapped, &bytes, FALSE)) {
+            const DWORD lastError = GetLastError();
+            if (lastError != ERROR_NOTIFY_ENUM_DIR) {
+                // The directory handle is no longer usable, typically because root was deleted.
+                error = SystemMessage("cannot watch directory", static_cast<int>(lastError), std::system_category());
+                return false;
+            }
+            bytes = 0;
+        }
+
+        if (bytes == 0) {
+            // The system's own buffer overflowed, so the changes were lost.
+            events.push_back({ WatchEvent::Kind::Overflow, m_root });
+        }
+        else {
+            Parse(bytes, events);
+        }
+        return Issue(error);
+    }
+
+private:
+    static constexpr DWORD kBufferSize = 64 * 1024;
+
+    bool Issue(std::string& error) {
+        ResetEvent(m_overlapped.hEvent);
+        const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME
+            | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+        if (!ReadDirectoryChangesW(m_directory, m_buffer, kBufferSize, TRUE, filter, nullptr, &m_overlapped, nullptr)) {
+            error = SystemMessage("cannot watch directory", static_cast<int>(GetLastError()), std::system_category());
+            return false;
+        }
+        m_pending = true;
+        return true;
+    }
+
+    void Parse(DWORD bytes, std::vector<WatchEvent>& events) {
+        for (DWORD offset = 0; offset < bytes;) {
+            const auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(m_buffer + offset);
+            const std::filesystem::path path = m_root
+                / std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR));
+
+            switch (info->Action) {
+            case FILE_ACTION_ADDED:
+            case FILE_ACTION_RENAMED_NEW_NAME:
+            case FILE_ACTION_MODIFIED: {
+                // The notification does not say whether the entry is a directory, so ask. A directory
+                // is "modified" whenever an entry inside it changes; those entries are reported themselves.
+                const DWORD attributes = GetFileAttributesW(path.c_str());
+                const bool isDirectory = attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+                if (!isDirectory) {
+                    events.push_back({ WatchEvent::Kind::FileChanged, path });
+                }
+                else if (info->Action != FILE_ACTION_MODIFIED) {
+                    events.push_back({ WatchEvent::Kind::DirectoryAdded, path });
+                }
+                break;
+            }
+            case FILE_ACTION_REMOVED:
+            case FILE_ACTION_RENAMED_OLD_NAME:
+                events.push_back({ WatchEvent::Kind::Removed, path });
+                break;
+            }
+
+            if (info->NextEntryOffset == 0) {
+                break;
+            }
+            offset += info->NextEntryOffset;
+        }
+    }
+
+    std::filesystem::path m_root;
+    HANDLE m_directory = INVALID_HANDLE_VALUE;
+    OVERLAPPED m_overlapped = {};
+    bool m_pending = false;
+    // ReadDirectoryChangesW needs a DWORD-aligned buffer.
+    alignas(DWORD) char m_buffer[kBufferSize];
+};
+
+#elif defined(__linux__)
+
+class DirectoryWatcher::Backend {
+public:
+    ~Backend() {
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    bool Start(const std::filesystem::path& root, std::string& error) {
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0) {
+            error = SystemMessage("cannot create inotify instance", errno, std::generic_category());
+            return false;
+        }
+        if (!AddWatch(root, error)) {
+            return false;
+        }
+        m_rootWatch = m_watches.begin()->first;
+        return AddTree(root, error);
+    }
+
+    bool Wait(std::chrono::milliseconds timeout, std::vector<WatchEvent>& events, std::string& error) {
+        pollfd descriptor = { m_fd, POLLIN, 0 };
+        const int ready = poll(&descriptor, 1, static_cast<int>(timeout.count()));
+        if (ready < 0) {
+            if (errno == EINTR) {
+                return true;
+            }
+            error = SystemMessage("cannot wait for changes", errno, std::generic_category());
+            return false;
+        }
+
+        // Drain everything queued, so a burst of changes is handed over in one go.
+        for (;;) {
+            const ssize_t bytes = read(m_fd, m_buffer, sizeof(m_buffer));
+            if (bytes < 0) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    break;
+                }
+                error = SystemMessage("cannot read changes", errno, std::generic_category());
+                return false;
+            }
+            for (ssize_t offset = 0; offset < bytes;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(m_buffer + offset);
+                offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+                if (!Handle(*event, events)) {
+                    error = "the watched directory was removed";
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    static constexpr uint32_t kMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+        | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+    bool AddWatch(const std::filesystem::path& directory, std::string& error) {
+        const int watch = inotify_add_watch(m_fd, directory.c_str(), kMask);
+        if (watch < 0) {
+            if (errno == ENOSPC) {
+                error = "too many directories to watch; raise fs.inotify.max_user_watches";
+            }
+            else {
+                error = SystemMessage(("cannot watch " + directory.string()).c_str(), errno, std::generic_category());
+            }
+            return false;
+        }
+        m_watches[watch] = directory;
+        return true;
+    }
+
+    // Watches every directory below directory, which is already watched itself. Directory
+    // symlinks are not followed, just as in the walk.
+    bool AddTree(const std::filesystem::path& directory, std::string& error) {
+        std::error_code iterationError;
+        std::filesystem::recursive_directory_iterator it(directory, iterationError);
+        for (const std::filesystem::recursive_directory_iterator end; !iterationError && it != end; it.increment(iterationError)) {
+            std::error_code statusError;
+            if (it->is_directory(statusError) && !it->is_symlink(statusError)) {
+                if (!AddWatch(it->path(), error)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Translates one inotify event. Returns false once the root directory is gone.
+    bool Handle(const inotify_event& event, std::vector<WatchEvent>& events) {
+        if (event.mask & IN_Q_OVERFLOW) {
+            events.push_back({ WatchEvent::Kind::Overflow, m_watches[m_rootWatch] });
+            return true;
+        }
+
+        const auto watch = m_watches.find(event.wd);
+        if (watch == m_watches.end()) {
+            return true;
+        }
+        if (event.mask & IN_IGNORED) {
+            const bool rootGone = event.wd == m_rootWatch;
+            m_watches.erase(watch);
+            return !rootGone;
+        }
+        if ((event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) && event.wd == m_rootWatch) {
+            return false;
+        }
+        if (event.len == 0) {
+            return true;
+        }
+
+        const std::filesystem::path path = watch->second / event.name;
+        if (event.mask & IN_ISDIR) {
+            if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+                // Anything created inside before the watch is in place is found by the caller's walk.
+                std::string ignored;
+                if (AddWatch(path, ignored)) {
+                    AddTree(path, ignored);
+                }
+                events.push_back({ WatchEvent::Kind::DirectoryAdded, path });
+            }
+            else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+                if (event.mask & IN_MOVED_FROM) {
+                    // The watches move along with the directory, and their paths would go stale.
+                    ForgetTree(path);
+                }
+                events.push_back({ WatchEvent::Kind::Removed, path });
+            }
+            return true;
+        }
+
+        // Files are reported once they are closed after writing rather than on every write.
+        // A newly created file is reported that way too, once its contents are in place.
+        if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+            events.push_back({ WatchEvent::Kind::FileChanged, path });
+        }
+        else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+            events.push_back({ WatchEvent::Kind::Removed, path });
+        }
+        return true;
+    }
+
+    void ForgetTree(const std::filesystem::path& directory) {
+        const std::string prefix = directory.string() + '/';
+        for (auto it = m_watches.begin(); it != m_watches.end();) {
+            const std::string& watched = it->second.native();
+            if (watched == directory.native() || watched.compare(0, prefix.size(), prefix) == 0) {
+                inotify_rm_watch(m_fd, it->first);
+                it = m_watches.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    int m_fd = -1;
+    int m_rootWatch = -1;
+    std::unordered_map<int, std::filesystem::path> m_watches;
+    alignas(inotify_event) char m_buffer[64 * 1024];
+};
+
+#else
+
+class DirectoryWatcher::Backend {
+public:
+    bool Start(const std::filesystem::path&, std::string& error) {
+        error = "change notifications are not supported on this platform";
+        return false;
+    }
+
+    bool Wait(std::chrono::milliseconds, std::vector<WatchEvent>&, std::string& error) {
+        error = "change notifications are not supported on this platform";
+        return false;
+    }
+};
+
+#endif
+
+DirectoryWatcher::DirectoryWatcher() = default;
+
+DirectoryWatcher::~DirectoryWatcher() = default;
+
+bool DirectoryWatcher::Start(const std::filesystem::path& root, std::string& error)
+{
+    m_backend = std::make_unique<Backend>();
+    if (!m_backend->Start(root, error)) {
+        m_backend.reset();
+        return false;
+    }
+    return true;
+}
+
+bool DirectoryWatcher::Wait(std::chrono::milliseconds timeout, std::vector<WatchEvent>& events, std::string& error)
+{
+    if (!m_backend) {
+        error = "not watching";
+        return false;
+    }
+    return m_backend->Wait(timeout, events, error);
+}
@@ -0,0 +1,55 @@
+// Change notifications for a directory tree, for /watch.
+// On Linux every directory in the tree gets an inotify watch, and directories that appear later
+// are added as they are reported. On Windows a single ReadDirectoryChangesW call covers the whole
+// subtree. Either way the watcher only says which paths changed; deciding which of them are HTML
+// files that need a rescan is up to the caller.
+
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+struct WatchEvent {
+    enum class Kind {
+        // A file was written, created or moved into the tree.
+        FileChanged,
+        // A directory was created or moved into the tree. Files already inside it are not
+        // reported one by one, so the caller has to walk it.
+        DirectoryAdded,
+        // A file or directory was deleted or moved out of the tree. For a directory, everything
+        // below it is gone as well.
+        Removed,
+        // Events were dropped because they arrived faster than they were read. Nothing is known
+        // about what changed, so the whole tree has to be rescanned.
+        Overflow,
+    };
+
+    Kind kind;
+    std::filesystem::path path;
+};
+
+class DirectoryWatcher {
+public:
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // Starts watching root and everything below it. Paths in events start with root as given.
+    // Returns false, with the reason in error, if the watch could not be set up.
+    bool Start(const std::filesystem::path& root, std::string& error);
+
+    // Waits up to timeout for changes and appends them to events, oldest first. Returns as soon as
+    // some have arrived. Returns false, with the reason in error, once the tree can no longer be
+    // watched, for instance because root itself was removed.
+    bool Wait(std::chrono::milliseconds timeout, std::vector<WatchEvent>& events, std::string& error);
+
+private:
+    class Backend;
+    std::unique_ptr<Backend> m_backend;
+};
@@ -0,0 +1,238 @@
+#include "FileFilter.h"
+
+#include "BlockReader.h"
+
+#include <algorithm>
+
+
+namespace {
+
+    using CharType = FileFilter::CharType;
+    using StringType = FileFilter::StringType;
+
+    // ASCII case folding for either character type. Other characters compare as they are.
+    CharType Fold(CharType c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<CharType>(c + ('a' - 'A')) : c;
+    }
+
+    // FNV-1a over the folded characters.
+    uint32_t HashFolded(const CharType* text, size_t length) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; ++i) {
+            hash ^= static_cast<uint32_t>(Fold(text[i]));
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // 64-bit FNV-1a over the bytes of a string.
+    uint64_t HashBytes(const std::string& text) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : text) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    size_t Length(const CharType* text) {
+        return std::char_traits<CharType>::length(text);
+    }
+
+    // Converts a command-line argument to the encoding directory listings use.
+    StringType ToNative(const std::string& text) {
+        return std::filesystem::path(text).native();
+    }
+
+    // Glob match with '*' and '?', backtracking only to the most recent '*'.
+    bool GlobMatches(const StringType& pattern, const CharType* name) {
+        size_t p = 0;
+        size_t n = 0;
+        size_t starPattern = StringType::npos;
+        size_t starName = 0;
+        while (name[n] != 0) {
+            if (p < pattern.size() && pattern[p] == '*') {
+                starPattern = p++;
+                starName = n;
+            }
+            else if (p < pattern.size() && (pattern[p] == '?' || Fold(pattern[p]) == Fold(name[n]))) {
+                ++p;
+                ++n;
+            }
+            else if (starPattern != StringType::npos) {
+                p = starPattern + 1;
+                n = ++starName;
+            }
+            else {
+                return false;
+            }
+        }
+        while (p < pattern.size() && pattern[p] == '*') {
+            ++p;
+        }
+        return p == pattern.size();
+    }
+
+    void AppendNarrow(std::string& text, const StringType& native) {
+        text += std::filesystem::path(native).string();
+    }
+
+}
+
+FileFilter::FileFilter()
+{
+    SetExtensions("html,htm");
+}
+
+bool FileFilter::SetExtensions(const std::string& list)
+{
+    std::vector<StringType> extensions;
+    size_t start = 0;
+    for (;;) {
+        const size_t comma = std::min(list.find(',', start), list.size());
+        std::string extension = list.substr(start, comma - start);
+        if (!extension.empty() && extension[0] == '.') {
+            extension.erase(0, 1);
+        }
+        if (extension.empty()) {
+            return false;
+        }
+
+        StringType folded = ToNative(extension);
+        for (CharType& c : folded) {
+            c = Fold(c);
+        }
+        if (std::find(extensions.begin(), extensions.end(), folded) == extensions.end()) {
+            extensions.push_back(std::move(folded));
+        }
+
+        if (comma == list.size()) {
+            break;
+        }
+        start = comma + 1;
+    }
+
+    m_extensions = std::move(extensions);
+    BuildTable();
+    return true;
+}
+
+void FileFilter::BuildTable()
+{
+    // At most half full, so probe sequences stay short.
+    size_t size = 8;
+    while (size < 2 * m_extensions.size()) {
+        size *= 2;
+    }
+    m_table.assign(size, 0);
+    for (size_t i = 0; i < m_extensions.size(); ++i) {
+        size_t slot = HashFolded(m_extensions[i].data(), m_extensions[i].size()) & (size - 1);
+        while (m_table[slot] != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        m_table[slot] = static_cast<uint32_t>(i + 1);
+    }
+}
+
+void FileFilter::AddExclude(const std::string& pattern)
+{
+    m_excludes.push_back(ToNative(pattern));
+}
+
+void FileFilter::AddInclude(const std::string& pattern)
+{
+    m_includes.push_back(ToNative(pattern));
+}
+
+bool FileFilter::HasExtension(const CharType* name) const
+{
+    // Like path::extension(), a name whose only dot is its first character has no extension.
+    size_t length = Length(name);
+    const Compression compression = CompressionFromName(name, length);
+    if (compression != Compression::None && CompressionSupported(compression)) {
+        length -= 3;
+    }
+    size_t dot = length;
+    while (dot > 0 && name[dot - 1] != '.') {
+        --dot;
+    }
+    if (dot <= 1) {
+        return false;
+    }
+
+    const CharType* extension = name + dot;
+    const size_t extensionLength = length - dot;
+    const size_t mask = m_table.size() - 1;
+    for (size_t slot = HashFolded(extension, extensionLength) & mask; m_table[slot] != 0; slot = (slot + 1) & mask) {
+        const StringType& candidate = m_extensions[m_table[slot] - 1];
+        if (candidate.size() != extensionLength) {
+            continue;
+        }
+        size_t i = 0;
+        while (i < extensionLength && candidate[i] == Fold(extension[i])) {
+            ++i;
+        }
+        if (i == extensionLength) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FileFilter::MatchesAny(const std::vector<StringType>& patterns, const CharType* name) const
+{
+    for (const auto& pattern : patterns) {
+        if (GlobMatches(pattern, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FileFilter::PassesPatterns(const CharType* name) const
+{
+    if (!m_includes.empty() && !MatchesAny(m_includes, name)) {
+        return false;
+    }
+    return !MatchesAny(m_excludes, name);
+}
+
+bool FileFilter::ExcludesDirectory(const CharType* name) const
+{
+    return MatchesAny(m_excludes, name);
+}
+
+void FileFilter::SetShard(uint32_t index, uint32_t count)
+{
+    m_shardIndex = index;
+    m_shardCount = count;
+}
+
+bool FileFilter::InShard(const std::filesystem::path& relativePath) const
+{
+    // UTF-8 with '/' separators, so the same file lands in the same shard on every platform.
+    return HashBytes(relativePath.generic_u8string()) % m_shardCount == m_shardIndex;
+}
+
+std::string FileFilter::Describe() const
+{
+    std::string description = "extensions";
+    for (size_t i = 0; i < m_extensions.size(); ++i) {
+        description += (i == 0) ? " ." : ", .";
+        AppendNarrow(description, m_extensions[i]);
+    }
+    for (const auto& pattern : m_includes) {
+        description += "; include ";
+        AppendNarrow(description, pattern);
+    }
+    for (const auto& pattern : m_excludes) {
+        description += "; exclude ";
+        AppendNarrow(description, pattern);
+    }
+    if (Sharded()) {
+        description += "; shard " + std::to_string(m_shardIndex) + "/" + std::to_string(m_shardCount);
+    }
+    description += "; decompresses ";
+    description += SupportedCompressionNames();
+    return description;
+}
@@ -0,0 +1,76 @@
+// Decides which directory entries a scan looks at.
+// Extensions are kept in a small open-addressing hash table built once from the configured set.
+// A lookup folds case and hashes the extension straight out of the listed name, so checking a
+// file allocates nothing and never builds a path. Exclude patterns are matched against the names
+// of directories as they are listed, so an excluded subtree is pruned without ever being opened.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+class FileFilter {
+public:
+    // Names as the directory listing returns them: char on POSIX, wchar_t on Windows.
+    using CharType = std::filesystem::path::value_type;
+    using StringType = std::filesystem::path::string_type;
+
+    // Accepts .html and .htm files and excludes nothing.
+    FileFilter();
+
+    // Replaces the extension set with a comma-separated list such as "html,htm,xhtml". A leading
+    // dot on each entry is optional, and extensions are compared case-insensitively. Returns false,
+    // leaving the set as it was, if the list has an empty entry.
+    bool SetExtensions(const std::string& list);
+
+    // Skips every file and directory whose name matches the glob pattern ('*' matches any run of
+    // characters, '?' a single one, case-insensitively). Excluded directories are not descended into.
+    void AddExclude(const std::string& pattern);
+
+    // Once any include pattern is given, only files whose name matches one of them are accepted.
+    // Include patterns do not apply to directories.
+    void AddInclude(const std::string& pattern);
+
+    // True if the file name has one of the configured extensions. When this build can decompress
+    // it, a file with a .gz or .br suffix is judged by the extension in front of the suffix, so
+    // page.html.gz counts as an .html file.
+    bool HasExtension(const CharType* name) const;
+
+    // True if the file name passes the include and exclude patterns.
+    bool PassesPatterns(const CharType* name) const;
+
+    // True if the walk should not descend into a directory of this name.
+    bool ExcludesDirectory(const CharType* name) const;
+
+    // Keeps only the files of shard index out of count. A file belongs to the shard its path,
+    // relative to the scan root with '/' separators, hashes to, so nodes that walk the same tree with
+    // different indexes scan every file exactly once between them, whatever their platform.
+    void SetShard(uint32_t index, uint32_t count);
+
+    bool Sharded() const { return m_shardCount > 1; }
+    uint32_t ShardIndex() const { return m_shardIndex; }
+    uint32_t ShardCount() const { return m_shardCount; }
+
+    // True if the file at relativePath, relative to the scan root, belongs to this shard.
+    bool InShard(const std::filesystem::path& relativePath) const;
+
+    // Describes the configuration, for diagnostics.
+    std::string Describe() const;
+
+private:
+    void BuildTable();
+    bool MatchesAny(const std::vector<StringType>& patterns, const CharType* name) const;
+
+    // Extensions without the dot, lowercased.
+    std::vector<StringType> m_extensions;
+    // Slot i holds an index into m_extensions plus one, or 0 when empty. The size is a power of two.
+    std::vector<uint32_t> m_table;
+    std::vector<StringType> m_excludes;
+    std::vector<StringType> m_includes;
+    uint32_t m_shardIndex = 0;
+    uint32_t m_shardCount = 1;
+};
@@ -0,0 +1,37 @@
+#include "HitRanking.h"
+
+#include <algorithm>
+
+
+void SelectTopFiles(const std::vector<FileId>& files, const std::vector<uint32_t>& counts, size_t limit,
+    std::vector<FileId>& topFiles, std::vector<uint32_t>& topCounts)
+{
+    // Ranks by count, then by position in files.
+    const auto better = [&counts](size_t a, size_t b) {
+        return counts[a] != counts[b] ? counts[a] > counts[b] : a < b;
+    };
+
+    // Ordered by better, the heap keeps its worst entry in front, which is the one a better file
+    // replaces.
+    std::vector<size_t> heap;
+    heap.reserve(std::min(limit, files.size()));
+    for (size_t i = 0; i < files.size() && limit > 0; ++i) {
+        if (heap.size() < limit) {
+            heap.push_back(i);
+            std::push_heap(heap.begin(), heap.end(), better);
+        }
+        else if (better(i, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), better);
+            heap.back() = i;
+            std::push_heap(heap.begin(), heap.end(), better);
+        }
+    }
+    std::sort_heap(heap.begin(), heap.end(), better);
+
+    topFiles.clear();
+    topCounts.clear();
+    for (size_t i : heap) {
+        topFiles.push_back(files[i]);
+        topCounts.push_back(counts[i]);
+    }
+}
@@ -0,0 +1,17 @@
+// Ranking of the files that contain a keyword by how often it occurs in them, for /top.
+
+#pragma once
+
+#include "PathTable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Picks the limit files with the most hits out of files, whose hit counts are in counts, and
+// leaves them in topFiles and topCounts, most hits first. Files with equal counts keep the order
+// they have in files. A heap that never holds more than limit entries does the picking, so
+// ranking n files costs O(n log limit) however long the list is.
+void SelectTopFiles(const std::vector<FileId>& files, const std::vector<uint32_t>& counts, size_t limit,
+    std::vector<FileId>& topFiles, std::vector<uint32_t>& topCounts);
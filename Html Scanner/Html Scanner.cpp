@@ -2,32 +2,357 @@
 // It checks if these files contain any of a predefined list of keywords.
 // The output is a text file that lists the matching filenames, grouped by the keyword they contained.
 
+#include "AsyncReader.h"
+#include "BinaryIndex.h"
+#include "DirectoryWalker.h"
+#include "DirectoryWatcher.h"
+#include "FileFilter.h"
+#include "HitRanking.h"
+#include "KeywordSearch.h"
+#include "LiveResults.h"
+#include "Log.h"
+#include "MatchPositions.h"
+#include "PathTable.h"
+#include "Pipeline.h"
+#include "QueryServer.h"
+#include "ResourceLimits.h"
+#include "ScanCorpus.h"
+#include "ScanIndex.h"
+#include "ScanStats.h"
+#include "Scanner.h"
+#include "ShardMerge.h"
+#include "StreamReport.h"
+#include "TextReport.h"
+#include "WorkStealingPool.h"
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
-#include <map>
-#include <set>
+#include <memory>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <shellapi.h>
+#pragma comment(lib, "shell32.lib")
+#endif
+
+
+// What the output file holds.
+enum class OutputFormat {
+    // The report grouped by keyword, written at the end.
+    Text,
+    // The binary inverted index from BinaryIndex.h, written at the end.
+    Binary,
+    // keyword<TAB>path records, appended as files are scanned.
+    Records,
+};
+
+// With /watch, how long Wait blocks before checking for Ctrl+C, and how long a burst of changes
+// has to stay quiet before the changed files are rescanned.
+constexpr std::chrono::milliseconds kWatchPollInterval{ 500 };
+constexpr std::chrono::milliseconds kWatchSettleTime{ 100 };
+
+// Set from the signal handler when Ctrl+C ends /watch or /serve.
+volatile std::sig_atomic_t stopRequested = 0;
+
+extern "C" void RequestStop(int) {
+    stopRequested = 1;
+}
+
+// The command-line arguments as UTF-8, which is how keywords are matched. On Windows, main gets
+// them in the ANSI code page, which cannot spell most non-ASCII keywords, so they are read again
+// from the wide command line.
+std::vector<std::string> Utf8Arguments(int argCount, char* argValues[])
+{
+    std::vector<std::string> arguments(argValues, argValues + argCount);
+#ifdef _WIN32
+    int wideCount = 0;
+    LPWSTR* wideValues = CommandLineToArgvW(GetCommandLineW(), &wideCount);
+    if (wideValues == nullptr) {
+        return arguments;
+    }
+    if (wideCount == argCount) {
+        for (int i = 0; i < wideCount; ++i) {
+            const int length = WideCharToMultiByte(CP_UTF8, 0, wideValues[i], -1, nullptr, 0, nullptr, nullptr);
+            if (length > 0) {
+                arguments[i].resize(static_cast<size_t>(length));
+                WideCharToMultiByte(CP_UTF8, 0, wideValues[i], -1, arguments[i].data(), length, nullptr, nullptr);
+                arguments[i].resize(static_cast<size_t>(length - 1));
+            }
+        }
+    }
+    LocalFree(wideValues);
+#endif
+    return arguments;
+}
 
 void PrintUsage(const char* programName) {
     std::cerr << "Usage: " << programName << " <directory_to_scan> <keyword1> [keyword2] [keyword3] ..." << std::endl;
     std::cerr << "Example: " << programName << " \"C:\\MyWebsite\" form gallery table" << std::endl;
     std::cerr << "An optional output file can be specified with the /o flag." << std::endl;
     std::cerr << "Example with output file: " << programName << " \"C:\\MyWebsite\" /o \"results.txt\" form gallery" << std::endl;
+    std::cerr << "Files can be scanned in parallel with the /j flag (0 uses every available core)." << std::endl;
+    std::cerr << "Example with 8 threads: " << programName << " \"C:\\MyWebsite\" /j 8 form gallery" << std::endl;
+    std::cerr << "The /mmap flag memory-maps each file and matches across line breaks." << std::endl;
+    std::cerr << "/ext html,htm,xhtml sets the file extensions to scan (default html,htm), case-insensitively." << std::endl;
+    std::cerr << "/exclude pattern skips files and whole directories whose name matches, e.g. /exclude node_modules;" << std::endl;
+    std::cerr << "/include pattern scans only files whose name matches. Both take * and ? and can be repeated." << std::endl;
+    std::cerr << "/scope text|tags|attrs matches only in page text, tag names or start tag attributes, skipping" << std::endl;
+    std::cerr << "comments, scripts and style sheets; /scope all (default) matches the whole file. UTF-16 pages are" << std::endl;
+    std::cerr << "always matched in full, whatever the scope." << std::endl;
+    std::cerr << "With /index, results are cached in the given file and unchanged files are skipped on the next run." << std::endl;
+    std::cerr << "Example with an index: " << programName << " \"C:\\MyWebsite\" /index \"scan.idx\" form gallery" << std::endl;
+    std::cerr << "The output format is chosen with /format text (default), /format bin for a binary inverted index," << std::endl;
+    std::cerr << "or /format tsv, which streams keyword<TAB>path records to the output while the scan runs." << std::endl;
+    std::cerr << "With /format tsv, /group file also writes the grouped text report from the records once the scan is done." << std::endl;
+    std::cerr << "With /pipeline, walking, reading and matching run as overlapping stages; /io N sets the reader threads (default 2)." << std::endl;
+    std::cerr << "/stats file writes counters and per-phase timings for the scan as JSON." << std::endl;
+    std::cerr << "/q prints only warnings and errors; /v adds debug output such as every file scanned." << std::endl;
+    std::cerr << "/async N replaces the pipeline's reader threads with N asynchronous reads in flight (io_uring or IOCP); it implies /pipeline." << std::endl;
+    std::cerr << "/watch keeps running after the scan and rewrites the report whenever files change, rescanning only those" << std::endl;
+    std::cerr << "files, until Ctrl+C. It works with /format text and bin; an /index is only updated by the first scan." << std::endl;
+    std::cerr << "/match wildcard reads keywords as patterns with * and ?, and /match regex as regular expressions such" << std::endl;
+    std::cerr << "as gallery[0-9]+; all of them are matched together in one pass. /match literal (default) matches plain text." << std::endl;
+    std::cerr << "Wildcard and regex keywords do not match in UTF-16 pages." << std::endl;
+    std::cerr << "/serve port loads every file once and answers keyword queries on 127.0.0.1:port until Ctrl+C, taking no" << std::endl;
+    std::cerr << "keywords on the command line. Given a /format bin index instead of a directory, it answers from the index." << std::endl;
+    std::cerr << "/shard i/N scans only the i-th of N parts of the tree, split by path hash, and writes a /format bin index." << std::endl;
+    std::cerr << "Combine the indexes of all N parts without rescanning with: " << programName << " merge [/o file] [/format text|bin] shard.bin ..." << std::endl;
+    std::cerr << "/positions file also writes keyword<TAB>path<TAB>line<TAB>offset<TAB>snippet for every hit, at most "
+        << PositionLog::kDefaultMaxPerFile << " per file;" << std::endl;
+    std::cerr << "/context N sets how many bytes of the hit's line the snippet shows on either side (default "
+        << PositionLog::kDefaultContextBytes << ")." << std::endl;
+    std::cerr << "/count also counts every occurrence of each keyword and gives the count with each file; every file is read to" << std::endl;
+    std::cerr << "the end. /top N lists only the N files with the most hits per keyword, most first; it implies /count." << std::endl;
+    std::cerr << "Keywords are matched ignoring case, accented and non-Latin letters included. Each page's encoding is sniffed" << std::endl;
+    std::cerr << "from its byte order mark or charset, so UTF-16 and Windows-1252 pages are matched as they are." << std::endl;
+    std::cerr << "/maxmem size caps the memory taken by file buffers and results, /maxopen N the files open at once and /iorate size" << std::endl;
+    std::cerr << "the bytes read per second, for hosts that serve other work. Sizes take K, M or G and are MiB with no suffix, such as" << std::endl;
+    std::cerr << "/maxmem 256 /iorate 50M. Threads that reach a limit wait for it instead of failing, so the scan slows down to fit." << std::endl;
+}
+
+// Runs the merge subcommand: combines the /shard indexes named on the command line into one
+// grouped text report or binary index. Returns the exit code for main.
+int Merge(int argCount, char* argValues[])
+{
+    std::filesystem::path outputFileName;
+    OutputFormat outputFormat = OutputFormat::Text;
+    LogLevel logLevel = LogLevel::Info;
+    std::vector<std::filesystem::path> shardPaths;
+
+    bool outputFlagFound = false;
+    bool formatFlagFound = false;
+    for (int i = 2; i < argCount; ++i) {
+        std::string arg = argValues[i];
+
+        if (outputFlagFound) {
+            outputFileName = arg;
+            outputFlagFound = false;
+            continue;
+        }
+
+        if (formatFlagFound) {
+            if (arg == "bin" || arg == "BIN") {
+                outputFormat = OutputFormat::Binary;
+            }
+            else if (arg == "text" || arg == "TEXT") {
+                outputFormat = OutputFormat::Text;
+            }
+            else {
+                std::cerr << "Error: Unknown merge output format \"" << arg << "\", expected text or bin." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            formatFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/o" || arg == "/O") {
+            outputFlagFound = true;
+            continue;
+        }
+
+        if (arg == "/format" || arg == "/FORMAT") {
+            formatFlagFound = true;
+            continue;
+        }
+
+        if (arg == "/q" || arg == "/Q") {
+            logLevel = LogLevel::Warning;
+            continue;
+        }
+
+        if (arg == "/v" || arg == "/V") {
+            logLevel = LogLevel::Debug;
+            continue;
+        }
+
+        shardPaths.push_back(arg);
+    }
+
+    if (outputFlagFound || formatFlagFound) {
+        std::cerr << "Error: " << (outputFlagFound ? "/o flag specified without a filename." : "/format flag specified without a format.") << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+    if (shardPaths.empty()) {
+        std::cerr << "Error: merge needs the shard indexes to combine." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+    if (outputFileName.empty()) {
+        outputFileName = outputFormat == OutputFormat::Binary ? "output.bin" : "output.txt";
+    }
+
+    SetLogLevel(logLevel);
+    const Stopwatch mergeTime;
+    MergedResults merged;
+    std::string error;
+    if (!MergeShards(shardPaths, merged, error)) {
+        LogLine(LogLevel::Error) << "Error: Cannot merge: " << error;
+        return 1;
+    }
+    LogLine(LogLevel::Info) << "Merged " << shardPaths.size() << " shards: " << merged.paths.Size() << " files with hits for "
+        << merged.keywords.size() << " keywords in " << mergeTime.Seconds() * 1000.0 << " ms";
+
+    if (outputFormat == OutputFormat::Binary) {
+        if (!WriteBinaryIndex(outputFileName, merged.rootDirectory, merged.signature, merged.paths, merged.keywords, merged.filesByKeyword)) {
+            LogLine(LogLevel::Error) << "Error: Could not write binary index to: " << outputFileName.string();
+            return 1;
+        }
+    }
+    else if (!WriteTextReport(outputFileName, merged.rootDirectory, merged.paths, merged.keywords, merged.filesByKeyword)) {
+        LogLine(LogLevel::Error) << "Error: Could not open output file for writing: " << outputFileName.string();
+        return 1;
+    }
+    LogLine(LogLevel::Info) << (outputFormat == OutputFormat::Binary ? "Binary index" : "Results") << " saved to " << outputFileName.string();
+    return 0;
 }
 
-// Helper function to convert a string to lowercase
-std::string ToLower(std::string str) {
-    std::transform(str.begin(), str.end(), str.begin(),
-        [](unsigned char c) { return std::tolower(c); });
-    return str;
+// Runs /serve: loads every file below source into memory, or opens source as a binary index, and
+// answers queries until Ctrl+C. Returns the exit code for main.
+int Serve(const std::filesystem::path& source, uint16_t port, size_t threadCount, ReadMode readMode,
+    ScanScope scope, MatchMode matchMode, const FileFilter& fileFilter)
+{
+    // Each query lists its keywords once and in sorted order, the way the reports do.
+    auto sortedKeywords = [](Query query) {
+        std::sort(query.begin(), query.end());
+        query.erase(std::unique(query.begin(), query.end()), query.end());
+        return query;
+    };
+
+    std::unique_ptr<ScanCorpus> corpus;
+    BinaryIndexReader index;
+    BatchHandler handler;
+    if (std::filesystem::is_directory(source)) {
+        const Stopwatch loadTime;
+        corpus = std::make_unique<ScanCorpus>(threadCount, readMode, scope, matchMode);
+        corpus->Load(source, fileFilter,
+            [](const std::string& message) { LogLine(LogLevel::Error) << "Filesystem error: " << message; },
+            [](const std::filesystem::path& filePath) { LogLine(LogLevel::Warning) << "Warning: Could not open file: " << filePath.string(); });
+        LogLine(LogLevel::Info) << "Loaded " << corpus->FileCount() << " files (" << corpus->ContentBytes() / (1024 * 1024)
+            << " MiB) from " << std::filesystem::absolute(source).string() << " in " << loadTime.Seconds() * 1000.0 << " ms";
+
+        handler = [&](const std::vector<Query>& queries, std::vector<std::string>& answers, std::string& error) {
+            // The keywords of the whole batch are matched together, each one once however many
+            // queries ask for it.
+            std::vector<std::string> keywords;
+            for (const auto& query : queries) {
+                keywords.insert(keywords.end(), query.begin(), query.end());
+            }
+            if (matchMode != MatchMode::Literal) {
+                for (const auto& keyword : keywords) {
+                    std::string patternError;
+                    if (!PatternSearch::Check(keyword, matchMode, patternError)) {
+                        error = "invalid pattern \"" + keyword + "\": " + patternError;
+                        return false;
+                    }
+                }
+            }
+            keywords = sortedKeywords(std::move(keywords));
+            std::vector<std::vector<FileId>> filesByKeyword;
+            corpus->Match(keywords, filesByKeyword);
+
+            for (size_t queryIndex = 0; queryIndex < queries.size(); ++queryIndex) {
+                for (const auto& keyword : sortedKeywords(queries[queryIndex])) {
+                    const size_t keywordIndex = static_cast<size_t>(
+                        std::lower_bound(keywords.begin(), keywords.end(), keyword) - keywords.begin());
+                    for (FileId fileId : filesByKeyword[keywordIndex]) {
+                        answers[queryIndex] += keyword + '\t' + corpus->Paths().String(fileId) + '\n';
+                    }
+                }
+            }
+            return true;
+        };
+    }
+    else {
+        if (!index.Open(source)) {
+            LogLine(LogLevel::Error) << "Error: " << source.string() << " is neither a directory nor a binary index.";
+            return 1;
+        }
+        if (matchMode != MatchMode::Literal) {
+            LogLine(LogLevel::Error) << "Error: A binary index can only be queried for the keywords it was built with, not with /match.";
+            return 1;
+        }
+        LogLine(LogLevel::Info) << "Loaded binary index of " << index.PathCount() << " files and " << index.KeywordCount()
+            << " keywords for " << index.RootDirectory();
+
+        // The index only knows the keywords it was built with, but finds them in any case, as a scan would.
+        // Parts of the index are only checked when a query reads them.
+        handler = [&](const std::vector<Query>& queries, std::vector<std::string>& answers, std::string& error) {
+            std::vector<uint32_t> fileIds;
+            std::string_view path;
+            for (size_t queryIndex = 0; queryIndex < queries.size(); ++queryIndex) {
+                for (const auto& keyword : sortedKeywords(queries[queryIndex])) {
+                    if (!index.Lookup(keyword, fileIds)) {
+                        error = "the index is damaged";
+                        return false;
+                    }
+                    for (uint32_t fileId : fileIds) {
+                        if (!index.Path(fileId, path)) {
+                            error = "the index is damaged";
+                            return false;
+                        }
+                        answers[queryIndex] += keyword + '\t';
+                        answers[queryIndex] += path;
+                        answers[queryIndex] += '\n';
+                    }
+                }
+            }
+            return true;
+        };
+    }
+
+    std::signal(SIGINT, RequestStop);
+    std::signal(SIGTERM, RequestStop);
+    LogLine(LogLevel::Info) << "Serving queries on 127.0.0.1:" << port << ". Press Ctrl+C to stop.";
+    FlushLog();
+
+    std::string error;
+    if (!RunQueryServer(port, handler, stopRequested, error)) {
+        LogLine(LogLevel::Error) << "Error: " << error;
+        return 1;
+    }
+    LogLine(LogLevel::Info) << "Stopped serving.";
+    return 0;
 }
 
 int main(int argCount, char* argValues[])
 {
+	if (argCount >= 2 && std::string(argValues[1]) == "merge")
+	{
+		return Merge(argCount, argValues);
+	}
+
 	if (argCount < 3)
 	{
 		PrintUsage(argValues[0]);
@@ -37,9 +362,55 @@ int main(int argCount, char* argValues[])
 	std::filesystem::path scanDirectory;
 	std::string outputFileName = "output.txt";
 	std::vector<std::string> keywords;
+	size_t threadCount = 1;
+	ReadMode readMode = ReadMode::Lines;
+	ScanScope scope = ScanScope::All;
+	MatchMode matchMode = MatchMode::Literal;
+	FileFilter fileFilter;
+	std::filesystem::path indexFileName;
+	OutputFormat outputFormat = OutputFormat::Text;
+	LogLevel logLevel = LogLevel::Info;
+	std::filesystem::path statsFileName;
+	std::filesystem::path groupedReportName;
+	bool usePipeline = false;
+	size_t ioThreadCount = 2;
+	size_t asyncQueueDepth = 0;
+	bool watchMode = false;
+	uint16_t servePort = 0;
+	std::filesystem::path positionsFileName;
+	size_t contextBytes = PositionLog::kDefaultContextBytes;
+	bool contextGiven = false;
+	bool countHits = false;
+	size_t topLimit = 0;
+	uint64_t maxMemoryBytes = 0;
+	size_t maxOpenFiles = 0;
+	uint64_t maxBytesPerSecond = 0;
 
     // --- Argument Parsing Logic ---
+    const std::vector<std::string> utf8Arguments = Utf8Arguments(argCount, argValues);
     bool outputFlagFound = false;
+    bool threadFlagFound = false;
+    bool indexFlagFound = false;
+    bool formatFlagFound = false;
+    bool scopeFlagFound = false;
+    bool matchFlagFound = false;
+    bool extFlagFound = false;
+    bool excludeFlagFound = false;
+    bool includeFlagFound = false;
+    bool groupFlagFound = false;
+    bool statsFlagFound = false;
+    bool ioFlagFound = false;
+    bool asyncFlagFound = false;
+    bool serveFlagFound = false;
+    bool shardFlagFound = false;
+    bool positionsFlagFound = false;
+    bool contextFlagFound = false;
+    bool topFlagFound = false;
+    bool maxmemFlagFound = false;
+    bool maxopenFlagFound = false;
+    bool iorateFlagFound = false;
+    bool outputFileGiven = false;
+    bool outputFormatGiven = false;
     for (int i = 1; i < argCount; ++i) {
         std::string arg = argValues[i];
 
@@ -51,10 +422,401 @@ int main(int argCount, char* argValues[])
         if (outputFlagFound) {
             // The argument directly after /o is the output filename.
             outputFileName = arg;
+            outputFileGiven = true;
             outputFlagFound = false; // Reset the flag
             continue;
         }
 
+        if (threadFlagFound) {
+            // The argument directly after /j is the number of worker threads.
+            try {
+                threadCount = std::stoul(arg);
+            }
+            catch (const std::exception&) {
+                std::cerr << "Error: /j flag requires a numeric thread count, got \"" << arg << "\"." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            if (threadCount == 0) {
+                threadCount = std::max(1u, std::thread::hardware_concurrency());
+            }
+            threadFlagFound = false;
+            continue;
+        }
+
+        if (ioFlagFound) {
+            // The argument directly after /io is the number of reader threads.
+            try {
+                ioThreadCount = std::max<size_t>(std::stoul(arg), 1);
+            }
+            catch (const std::exception&) {
+                std::cerr << "Error: /io flag requires a numeric thread count, got \"" << arg << "\"." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            ioFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/io" || arg == "/IO") {
+            ioFlagFound = true;
+            continue;
+        }
+
+        if (asyncFlagFound) {
+            // The argument directly after /async is the number of reads kept in flight.
+            try {
+                asyncQueueDepth = std::max<size_t>(std::stoul(arg), 1);
+            }
+            catch (const std::exception&) {
+                std::cerr << "Error: /async flag requires a numeric queue depth, got \"" << arg << "\"." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            usePipeline = true;
+            asyncFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/async" || arg == "/ASYNC") {
+            asyncFlagFound = true;
+            continue;
+        }
+
+        if (statsFlagFound) {
+            // The argument directly after /stats is the JSON file the statistics are written to.
+            statsFileName = arg;
+            statsFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/stats" || arg == "/STATS") {
+            statsFlagFound = true;
+            continue;
+        }
+
+        if (arg == "/q" || arg == "/Q") {
+            logLevel = LogLevel::Warning;
+            continue;
+        }
+
+        if (arg == "/v" || arg == "/V") {
+            logLevel = LogLevel::Debug;
+            continue;
+        }
+
+        if (arg == "/pipeline" || arg == "/PIPELINE") {
+            usePipeline = true;
+            continue;
+        }
+
+        if (serveFlagFound) {
+            // The argument directly after /serve is the port to listen on.
+            unsigned long port = 0;
+            try {
+                port = std::stoul(arg);
+            }
+            catch (const std::exception&) {
+            }
+            if (port == 0 || port > 65535) {
+                std::cerr << "Error: /serve flag requires a port number between 1 and 65535, got \"" << arg << "\"." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            servePort = static_cast<uint16_t>(port);
+            serveFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/serve" || arg == "/SERVE") {
+            serveFlagFound = true;
+            continue;
+        }
+
+        if (shardFlagFound) {
+            // The argument directly after /shard is "index/count".
+            unsigned long shardIndex = 0;
+            unsigned long shardCount = 0;
+            const size_t slash = arg.find('/');
+            try {
+                if (slash != std::string::npos) {
+                    shardIndex = std::stoul(arg.substr(0, slash));
+                    shardCount = std::stoul(arg.substr(slash + 1));
+                }
+            }
+            catch (const std::exception&) {
+                shardCount = 0;
+            }
+            if (shardCount == 0 || shardIndex >= shardCount || shardCount > UINT32_MAX) {
+                std::cerr << "Error: /shard flag requires i/N with 0 <= i < N, such as 0/4, got \"" << arg << "\"." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            fileFilter.SetShard(static_cast<uint32_t>(shardIndex), static_cast<uint32_t>(shardCount));
+            // A shard is only useful as input to merge, so it defaults to the binary index.
+            if (!outputFormatGiven) {
+                outputFormat = OutputFormat::Binary;
+            }
+            shardFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/shard" || arg == "/SHARD") {
+            shardFlagFound = true;
+            continue;
+        }
+
+        if (arg == "/watch" || arg == "/WATCH") {
+            watchMode = true;
+            continue;
+        }
+
+        if (indexFlagFound) {
+            // The argument directly after /index is the index file.
+            indexFileName = arg;
+            indexFlagFound = false;
+            continue;
+        }
+
+        if (formatFlagFound) {
+            // The argument directly after /format is the output format.
+            if (arg == "bin" || arg == "BIN") {
+                outputFormat = OutputFormat::Binary;
+            }
+            else if (arg == "text" || arg == "TEXT") {
+                outputFormat = OutputFormat::Text;
+            }
+            else if (arg == "tsv" || arg == "TSV") {
+                outputFormat = OutputFormat::Records;
+            }
+            else {
+                std::cerr << "Error: Unknown output format \"" << arg << "\", expected text, bin or tsv." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            outputFormatGiven = true;
+            formatFlagFound = false;
+            continue;
+        }
+
+        if (extFlagFound) {
+            // The argument directly after /ext is the comma-separated list of extensions.
+            if (!fileFilter.SetExtensions(arg)) {
+                std::cerr << "Error: /ext flag requires a list of extensions such as html,htm, got \"" << arg << "\"." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            extFlagFound = false;
+            continue;
+        }
+
+        if (excludeFlagFound) {
+            // The argument directly after /exclude is a name pattern to skip.
+            fileFilter.AddExclude(arg);
+            excludeFlagFound = false;
+            continue;
+        }
+
+        if (includeFlagFound) {
+            // The argument directly after /include is a file name pattern to scan.
+            fileFilter.AddInclude(arg);
+            includeFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/ext" || arg == "/EXT") {
+            extFlagFound = true;
+            continue;
+        }
+
+        if (arg == "/exclude" || arg == "/EXCLUDE") {
+            excludeFlagFound = true;
+            continue;
+        }
+
+        if (arg == "/include" || arg == "/INCLUDE") {
+            includeFlagFound = true;
+            continue;
+        }
+
+        if (scopeFlagFound) {
+            // The argument directly after /scope is the part of the HTML to match in.
+            if (!ParseScanScope(arg, scope)) {
+                std::cerr << "Error: Unknown scope \"" << arg << "\", expected text, tags, attrs or all." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            scopeFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/scope" || arg == "/SCOPE") {
+            scopeFlagFound = true;
+            continue;
+        }
+
+        if (matchFlagFound) {
+            // The argument directly after /match is how keywords are read.
+            if (!ParseMatchMode(arg, matchMode)) {
+                std::cerr << "Error: Unknown match mode \"" << arg << "\", expected literal, wildcard or regex." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            matchFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/match" || arg == "/MATCH") {
+            matchFlagFound = true;
+            continue;
+        }
+
+        if (groupFlagFound) {
+            // The argument directly after /group is the grouped report written after the scan.
+            groupedReportName = arg;
+            groupFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/group" || arg == "/GROUP") {
+            groupFlagFound = true;
+            continue;
+        }
+
+        if (positionsFlagFound) {
+            // The argument directly after /positions is the file the hit positions are written to.
+            positionsFileName = arg;
+            positionsFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/positions" || arg == "/POSITIONS") {
+            positionsFlagFound = true;
+            continue;
+        }
+
+        if (contextFlagFound) {
+            // The argument directly after /context is the snippet length on either side of a hit.
+            try {
+                contextBytes = std::stoul(arg);
+            }
+            catch (const std::exception&) {
+                std::cerr << "Error: /context flag requires a numeric byte count, got \"" << arg << "\"." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            contextGiven = true;
+            contextFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/context" || arg == "/CONTEXT") {
+            contextFlagFound = true;
+            continue;
+        }
+
+        if (arg == "/count" || arg == "/COUNT") {
+            countHits = true;
+            continue;
+        }
+
+        if (topFlagFound) {
+            // The argument directly after /top is how many files to list per keyword.
+            try {
+                topLimit = std::stoul(arg);
+            }
+            catch (const std::exception&) {
+                topLimit = 0;
+            }
+            if (topLimit == 0) {
+                std::cerr << "Error: /top flag requires a file count of at least 1, got \"" << arg << "\"." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            countHits = true;
+            topFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/top" || arg == "/TOP") {
+            topFlagFound = true;
+            continue;
+        }
+
+        if (maxmemFlagFound) {
+            // The argument directly after /maxmem is the memory budget.
+            if (!ParseByteSize(arg, maxMemoryBytes)) {
+                std::cerr << "Error: /maxmem flag requires a size such as 512M or 2G, got \"" << arg << "\"." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            maxmemFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/maxmem" || arg == "/MAXMEM") {
+            maxmemFlagFound = true;
+            continue;
+        }
+
+        if (maxopenFlagFound) {
+            // The argument directly after /maxopen is how many files may be open at once.
+            try {
+                maxOpenFiles = std::stoul(arg);
+            }
+            catch (const std::exception&) {
+                maxOpenFiles = 0;
+            }
+            if (maxOpenFiles == 0) {
+                std::cerr << "Error: /maxopen flag requires a file count of at least 1, got \"" << arg << "\"." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            maxopenFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/maxopen" || arg == "/MAXOPEN") {
+            maxopenFlagFound = true;
+            continue;
+        }
+
+        if (iorateFlagFound) {
+            // The argument directly after /iorate is how many bytes may be read per second.
+            if (!ParseByteSize(arg, maxBytesPerSecond)) {
+                std::cerr << "Error: /iorate flag requires a size per second such as 50M, got \"" << arg << "\"." << std::endl;
+                PrintUsage(argValues[0]);
+                return 1;
+            }
+            iorateFlagFound = false;
+            continue;
+        }
+
+        if (arg == "/iorate" || arg == "/IORATE") {
+            iorateFlagFound = true;
+            continue;
+        }
+
+        if (arg == "/format" || arg == "/FORMAT") {
+            formatFlagFound = true;
+            continue;
+        }
+
+        if (arg == "/index" || arg == "/INDEX") {
+            indexFlagFound = true;
+            continue;
+        }
+
+        if (arg == "/j" || arg == "/J") {
+            threadFlagFound = true;
+            continue;
+        }
+
+        if (arg == "/mmap" || arg == "/MMAP") {
+            readMode = ReadMode::Mapped;
+            continue;
+        }
+
         if (arg == "/o" || arg == "/O") {
             outputFlagFound = true;
             // The next argument will be the filename, handled in the next loop iteration.
@@ -62,116 +824,857 @@ int main(int argCount, char* argValues[])
         }
 
         // If it's not the directory or an output flag/file, it's a keyword.
-        keywords.push_back(arg);
+        keywords.push_back(utf8Arguments[i]);
+    }
+
+    if (shardFlagFound) {
+        std::cerr << "Error: /shard flag specified without a shard such as 0/4." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (serveFlagFound) {
+        std::cerr << "Error: /serve flag specified without a port number." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
     }
 
-    if (scanDirectory.empty() || !std::filesystem::is_directory(scanDirectory)) {
+    if (servePort != 0) {
+        if (scanDirectory.empty() || !std::filesystem::exists(scanDirectory)) {
+            std::cerr << "Error: The first argument must be a valid directory or binary index." << std::endl;
+            PrintUsage(argValues[0]);
+            return 1;
+        }
+        if (!keywords.empty() || watchMode) {
+            std::cerr << "Error: /serve takes its keywords from the queries; it cannot be combined with keywords or /watch." << std::endl;
+            PrintUsage(argValues[0]);
+            return 1;
+        }
+    }
+    else if (scanDirectory.empty() || !std::filesystem::is_directory(scanDirectory)) {
         std::cerr << "Error: The first argument must be a valid directory." << std::endl;
         PrintUsage(argValues[0]);
         return 1;
     }
 
-    if (keywords.empty()) {
+    if (keywords.empty() && servePort == 0) {
         std::cerr << "Error: No keywords were provided." << std::endl;
         PrintUsage(argValues[0]);
         return 1;
     }
 
+    // An empty keyword is found in every file, but has no position and no count to report.
+    if (std::find(keywords.begin(), keywords.end(), std::string()) != keywords.end()) {
+        std::cerr << "Error: An empty keyword would match every file." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
     if (outputFlagFound) {
         std::cerr << "Error: /o flag specified without a filename." << std::endl;
         PrintUsage(argValues[0]);
         return 1;
     }
 
+    if (threadFlagFound) {
+        std::cerr << "Error: /j flag specified without a thread count." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (indexFlagFound) {
+        std::cerr << "Error: /index flag specified without a filename." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (formatFlagFound) {
+        std::cerr << "Error: /format flag specified without a format." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (extFlagFound) {
+        std::cerr << "Error: /ext flag specified without a list of extensions." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (excludeFlagFound || includeFlagFound) {
+        std::cerr << "Error: " << (excludeFlagFound ? "/exclude" : "/include") << " flag specified without a pattern." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (scopeFlagFound) {
+        std::cerr << "Error: /scope flag specified without a scope." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (matchFlagFound) {
+        std::cerr << "Error: /match flag specified without a match mode." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (matchMode != MatchMode::Literal) {
+        for (const auto& keyword : keywords) {
+            std::string patternError;
+            if (!PatternSearch::Check(keyword, matchMode, patternError)) {
+                std::cerr << "Error: Invalid " << MatchModeName(matchMode) << " pattern \"" << keyword << "\": " << patternError << "." << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    if (ioFlagFound) {
+        std::cerr << "Error: /io flag specified without a thread count." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (asyncFlagFound) {
+        std::cerr << "Error: /async flag specified without a queue depth." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (usePipeline && !indexFileName.empty()) {
+        std::cerr << "Error: /pipeline and /async cannot be combined with /index." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (statsFlagFound) {
+        std::cerr << "Error: /stats flag specified without a file name." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (groupFlagFound) {
+        std::cerr << "Error: /group flag specified without a file name." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (positionsFlagFound) {
+        std::cerr << "Error: /positions flag specified without a file name." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (contextFlagFound) {
+        std::cerr << "Error: /context flag specified without a byte count." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (topFlagFound) {
+        std::cerr << "Error: /top flag specified without a file count." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (maxmemFlagFound || iorateFlagFound) {
+        std::cerr << "Error: " << (maxmemFlagFound ? "/maxmem" : "/iorate") << " flag specified without a size." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (maxopenFlagFound) {
+        std::cerr << "Error: /maxopen flag specified without a file count." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    // /serve holds every file in memory for as long as it runs, which is what it is for.
+    if (servePort != 0 && (maxMemoryBytes != 0 || maxOpenFiles != 0 || maxBytesPerSecond != 0)) {
+        std::cerr << "Error: /maxmem, /maxopen and /iorate cannot be combined with /serve." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    // Counts need every file read to the end by the streaming matcher, and only the text and tsv
+    // outputs have room for them.
+    if (countHits && (usePipeline || !indexFileName.empty() || watchMode || servePort != 0)) {
+        std::cerr << "Error: /count and /top cannot be combined with /pipeline, /async, /index, /watch or /serve." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+    if (countHits && outputFormat == OutputFormat::Binary) {
+        std::cerr << "Error: /count needs /format text or tsv; the binary index does not hold hit counts." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+    if (topLimit != 0 && outputFormat != OutputFormat::Text) {
+        std::cerr << "Error: /top is only used with /format text." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+    if (countHits && !groupedReportName.empty()) {
+        std::cerr << "Error: /group cannot be combined with /count." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (contextGiven && positionsFileName.empty()) {
+        std::cerr << "Error: /context is only used with /positions." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    // Positions come from reading every file through the streaming matcher, so they cannot be
+    // recovered from an index or the pipeline's independent buffers, and offsets are only
+    // meaningful in the whole file.
+    if (!positionsFileName.empty()
+        && (usePipeline || !indexFileName.empty() || watchMode || servePort != 0 || scope != ScanScope::All)) {
+        std::cerr << "Error: /positions cannot be combined with /pipeline, /async, /index, /watch, /serve or /scope." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (!groupedReportName.empty() && outputFormat != OutputFormat::Records) {
+        std::cerr << "Error: /group is only used with /format tsv." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (watchMode && outputFormat == OutputFormat::Records) {
+        std::cerr << "Error: /watch rewrites the report as files change, so it needs /format text or bin." << std::endl;
+        PrintUsage(argValues[0]);
+        return 1;
+    }
+
+    if (outputFormat == OutputFormat::Records) {
+        // A tab or line break in a keyword would make the records ambiguous.
+        for (const auto& keyword : keywords) {
+            if (keyword.find_first_of("\t\r\n") != std::string::npos) {
+                std::cerr << "Error: Keywords cannot contain tabs or line breaks with /format tsv." << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    if (outputFormat == OutputFormat::Binary && !outputFileGiven) {
+        outputFileName = "output.bin";
+    }
+    if (outputFormat == OutputFormat::Records && !outputFileGiven) {
+        outputFileName = "output.tsv";
+    }
+
+    SetLogLevel(logLevel);
+    if (servePort != 0) {
+        return Serve(scanDirectory, servePort, threadCount, readMode, scope, matchMode, fileFilter);
+    }
+    const Stopwatch totalTime;
+
     // [DEBUG] Print the parsed arguments to verify them
-    std::cout << "[DEBUG] Directory to scan: " << scanDirectory.string() << std::endl;
-    std::cout << "[DEBUG] Output file: " << outputFileName << std::endl;
-    std::cout << "[DEBUG] Keywords to find: ";
-    for (const auto& k : keywords) { std::cout << "\"" << k << "\" "; }
-    std::cout << std::endl << "--------------------------------" << std::endl;
+    LogLine(LogLevel::Debug) << "[DEBUG] Directory to scan: " << scanDirectory.string();
+    LogLine(LogLevel::Debug) << "[DEBUG] Output file: " << outputFileName;
+    LogLine(LogLevel::Debug) << "[DEBUG] Worker threads: " << threadCount;
+    if (usePipeline) {
+        if (asyncQueueDepth != 0) {
+            LogLine(LogLevel::Debug) << "[DEBUG] Async reads in flight: " << asyncQueueDepth
+                << " (" << AsyncReader(1).BackendName() << ")";
+        }
+        else {
+            LogLine(LogLevel::Debug) << "[DEBUG] Pipeline reader threads: " << ioThreadCount;
+        }
+    }
+    LogLine(LogLevel::Debug) << "[DEBUG] Read mode: " << (readMode == ReadMode::Mapped ? "memory-mapped" : "line by line");
+    LogLine(LogLevel::Debug) << "[DEBUG] Scope: " << ScanScopeName(scope);
+    LogLine(LogLevel::Debug) << "[DEBUG] Match mode: " << MatchModeName(matchMode);
+    LogLine(LogLevel::Debug) << "[DEBUG] Files: " << fileFilter.Describe();
+    LogLine(LogLevel::Debug) << "[DEBUG] Index file: " << (indexFileName.empty() ? "(none)" : indexFileName.string());
+    if (maxMemoryBytes != 0 || maxOpenFiles != 0 || maxBytesPerSecond != 0) {
+        LogLine line(LogLevel::Debug);
+        line << "[DEBUG] Resource limits:";
+        if (maxMemoryBytes != 0) {
+            line << " memory " << maxMemoryBytes / 1024 << " KiB;";
+        }
+        if (maxOpenFiles != 0) {
+            line << " open files " << maxOpenFiles << ";";
+        }
+        if (maxBytesPerSecond != 0) {
+            line << " reads " << maxBytesPerSecond / 1024 << " KiB/s;";
+        }
+    }
+    if (countHits) {
+        LogLine line(LogLevel::Debug);
+        line << "[DEBUG] Hit counts: every match";
+        if (topLimit != 0) {
+            line << ", top " << topLimit << " files per keyword";
+        }
+    }
+    if (!positionsFileName.empty()) {
+        LogLine(LogLevel::Debug) << "[DEBUG] Positions file: " << positionsFileName.string() << " (" << contextBytes
+            << " bytes of context, at most " << PositionLog::kDefaultMaxPerFile << " hits per file)";
+    }
+    {
+        LogLine line(LogLevel::Debug);
+        line << "[DEBUG] Keywords to find: ";
+        for (const auto& k : keywords) { line << "\"" << k << "\" "; }
+    }
+    LogLine(LogLevel::Debug) << "--------------------------------";
 
 
-    // Use a map to store a list of filenames for each keyword.
-    std::map<std::string, std::vector<std::string>> foundFilesByKeyword;
+    // From here on a keyword is referred to by its position in the list. Sorting the list first
+    // makes that the order the reports list keywords in, and a keyword given twice is searched for once.
+    std::sort(keywords.begin(), keywords.end());
+    keywords.erase(std::unique(keywords.begin(), keywords.end()), keywords.end());
+
+    // One list of files per keyword, indexed like keywords. Files are referred to by their ID in
+    // candidateFiles, so each path is stored only once however many keywords it matches.
+    std::vector<std::vector<FileId>> foundFilesByKeyword(keywords.size());
+    // With /count, each file's hit count, laid out like foundFilesByKeyword.
+    std::vector<std::vector<uint32_t>> hitCountsByKeyword(countHits ? keywords.size() : 0);
+
+    LogLine(LogLevel::Info) << "Scanning directory: " << std::filesystem::absolute(scanDirectory).string();
+    LogLine(LogLevel::Info) << "Output file: " << outputFileName;
+    {
+        LogLine line(LogLevel::Info);
+        line << "Looking for keywords: ";
+        for (size_t i = 0; i < keywords.size(); ++i) {
+            line << "\"" << keywords[i] << "\"" << (i < keywords.size() - 1 ? ", " : "");
+        }
+    }
+    LogLine(LogLevel::Info) << "";
+
+    // Build the matcher once: a SIMD substring search for a few keywords, or a multi-pattern
+    // automaton that scans each line in a single pass for larger sets. The keywords are lowered
+    // here, once, rather than on every comparison. Patterns are compiled into one lazy DFA instead.
+    const KeywordSearch matcher(keywords, matchMode);
+    LogLine(LogLevel::Debug) << "[DEBUG] Search engine: " << matcher.EngineName();
 
-    std::cout << "Scanning directory: " << std::filesystem::absolute(scanDirectory).string() << std::endl;
-    std::cout << "Output file: " << outputFileName << std::endl;
-    std::cout << "Looking for keywords: ";
-    for (size_t i = 0; i < keywords.size(); ++i) {
-        std::cout << "\"" << keywords[i] << "\"" << (i < keywords.size() - 1 ? ", " : "");
+    // The pipeline matches the buffers of a file independently, overlapping them by the longest
+    // match, so it cannot find a pattern whose matches have no length limit.
+    if (usePipeline && !matcher.BoundedMatches()) {
+        LogLine(LogLevel::Error) << "Error: /pipeline and /async need patterns whose matches have a length limit; "
+            << "one of the patterns can match text of any length, such as a*b.";
+        return 1;
     }
-    std::cout << std::endl << std::endl;
 
-    try {
-        // Recursively iterate through all files in the directory.
-        for (const auto& entry : std::filesystem::recursive_directory_iterator(scanDirectory)) {
-            // Check if the entry is a regular file with a .html or .htm extension.
-            if (entry.is_regular_file() && (entry.path().extension() == ".html" || entry.path().extension() == ".htm")) {
+    // Load the results of the previous run, if an index was requested. A missing or outdated
+    // index simply means every file is scanned.
+    const bool useIndex = !indexFileName.empty();
+    ScanIndex previousIndex(IndexSignature(keywords, readMode, scope, matchMode), keywords.size());
+    if (useIndex) {
+        if (previousIndex.Load(indexFileName)) {
+            LogLine(LogLevel::Debug) << "[DEBUG] Loaded " << previousIndex.Size() << " cached entries from " << indexFileName.string();
+        }
+        else {
+            LogLine(LogLevel::Debug) << "[DEBUG] No usable index at " << indexFileName.string() << ", scanning every file";
+        }
+    }
 
-                // [DEBUG] Print every HTML file that is being opened for scanning
-                std::cout << "[DEBUG] Scanning file: " << entry.path().string() << std::endl;
+    // With /watch, the watch is set up before the first scan so that nothing changed while the scan
+    // runs goes unnoticed. Those changes are picked up by the first rescan.
+    DirectoryWatcher watcher;
+    if (watchMode) {
+        std::string watchError;
+        if (!watcher.Start(scanDirectory, watchError)) {
+            LogLine(LogLevel::Error) << "Error: Cannot watch " << scanDirectory.string() << ": " << watchError;
+            return 1;
+        }
+    }
 
-                std::ifstream fileStream(entry.path());
-                if (!fileStream.is_open()) {
-                    std::cerr << "Warning: Could not open file: " << entry.path().string() << std::endl;
-                    continue; // Skip to the next file
-                }
+    // One keyword found in one file, and with /count how often.
+    struct FileHit {
+        FileId fileId;
+        uint32_t keywordIndex;
+        uint32_t count;
+    };
 
-                // Check the file for each keyword.
-                std::string line;
-                std::set<std::string> keywordsFoundInFile;
-                while (std::getline(fileStream, line)) {
-                    for (const auto& keyword : keywords) {
-                        if (ToLower(line).find(ToLower(keyword)) != std::string::npos) {
-                            keywordsFoundInFile.insert(keyword);
+    // Every worker keeps its own buffers and results, so the scan itself needs no locking.
+    // Console output goes through the log, which does its own locking.
+    PathTable candidateFiles;
+    std::vector<std::vector<FileHit>> workerResults(threadCount);
+    std::vector<std::vector<std::pair<FileId, IndexEntry>>> workerIndexEntries(threadCount);
+    std::atomic<size_t> reusedFileCount{ 0 };
+    // With /positions, one log per worker, like the results.
+    std::vector<PositionLog> workerPositions;
+
+    // With /maxmem, /maxopen or /iorate, every file the scan reads is held to the limits, and the
+    // pipeline's buffers and the results kept for the report are charged to the memory budget.
+    ResourceLimits limits(maxMemoryBytes, maxOpenFiles, maxBytesPerSecond);
+    ResourceLimits* scanLimits = limits.Any() ? &limits : nullptr;
+
+    // Counters shared by the workers are atomics; everything else is filled in between phases.
+    ScanStats stats;
+    std::atomic<size_t> opensFailed{ 0 };
+    std::atomic<size_t> filesMatched{ 0 };
+    std::atomic<size_t> keywordHits{ 0 };
+    auto copyWalkCounters = [&](const WalkCounters& walk) {
+        stats.directoriesListed = walk.directoriesListed;
+        stats.filesSeen = walk.filesSeen;
+        stats.filesSkippedByExtension = walk.filesSkippedByExtension;
+        stats.filesExcluded = walk.filesExcluded;
+        stats.directoriesExcluded = walk.directoriesExcluded;
+        stats.filesInOtherShards = walk.filesInOtherShards;
+    };
+
+    // With /format tsv every hit goes to the output file as soon as its file is done, so results
+    // are never collected in memory and a scan that is cut short keeps what it found.
+    const bool streamRecords = outputFormat == OutputFormat::Records;
+    RecordWriter recordWriter;
+    if (streamRecords && !recordWriter.Open(outputFileName)) {
+        LogLine(LogLevel::Error) << "Error: Could not open output file for writing: " << outputFileName;
+        return 1;
+    }
+
+    // Passes on the keywords found in one file: written out right away when streaming, otherwise
+    // kept with the worker's results until the report is written. counts is only given with /count.
+    auto recordHits = [&](size_t workerIndex, FileId fileId, const std::filesystem::path& filePath,
+        const KeywordHits& hits, const std::vector<uint32_t>* counts) {
+        if (hits.FoundCount() == 0) {
+            return;
+        }
+        ++filesMatched;
+        keywordHits += hits.FoundCount();
+        if (!streamRecords) {
+            if (scanLimits != nullptr) {
+                scanLimits->memory.Hold(hits.FoundCount() * sizeof(FileHit));
+            }
+            std::vector<FileHit>& results = workerResults[workerIndex];
+            hits.ForEach([&](size_t keywordIndex) {
+                results.push_back({ fileId, static_cast<uint32_t>(keywordIndex), counts != nullptr ? (*counts)[keywordIndex] : 0 });
+            });
+            return;
+        }
+
+        const std::string pathString = filePath.string();
+        hits.ForEach([&](size_t keywordIndex) {
+            if (counts != nullptr) {
+                recordWriter.Write(keywords[keywordIndex], pathString, (*counts)[keywordIndex]);
+                LogLine(LogLevel::Info) << "Found \"" << keywords[keywordIndex] << "\" " << (*counts)[keywordIndex]
+                    << " times in: " << pathString;
+                return;
+            }
+            recordWriter.Write(keywords[keywordIndex], pathString);
+            LogLine(LogLevel::Info) << "Found \"" << keywords[keywordIndex] << "\" in: " << pathString;
+        });
+    };
+
+    if (usePipeline) {
+        // Walk, read and match in overlapping stages. The pipeline reports every finished file
+        // from one of its reader or matcher threads.
+        PipelineOptions pipelineOptions;
+        pipelineOptions.readerThreads = ioThreadCount;
+        pipelineOptions.asyncQueueDepth = asyncQueueDepth;
+        pipelineOptions.matcherThreads = threadCount;
+        pipelineOptions.readMode = readMode;
+        pipelineOptions.scope = scope;
+        pipelineOptions.fileFilter = fileFilter;
+        pipelineOptions.limits = scanLimits;
+        workerResults.resize(threadCount + ioThreadCount);
+
+        PipelineCallbacks callbacks;
+        callbacks.fileScanned = [&](size_t workerIndex, FileId fileId, const std::filesystem::path& filePath,
+            const KeywordHits& hits) {
+            recordHits(workerIndex, fileId, filePath, hits, nullptr);
+        };
+        callbacks.openFailed = [&](const std::filesystem::path& filePath) {
+            ++opensFailed;
+            LogLine(LogLevel::Warning) << "Warning: Could not open or read file: " << filePath.string();
+        };
+        callbacks.walkFailed = [&](const std::string& message) {
+            LogLine(LogLevel::Error) << "Filesystem error: " << message;
+        };
+
+        const Stopwatch scanTime;
+        const PipelineStats pipelineStats = RunPipeline(scanDirectory, matcher, pipelineOptions, candidateFiles, callbacks);
+        stats.scanSeconds = scanTime.Seconds();
+        stats.enumerationSeconds = pipelineStats.walkSeconds;
+        copyWalkCounters(pipelineStats.walk);
+        stats.bytesRead = pipelineStats.bytesRead;
+        stats.threads = pipelineStats.threads;
+    }
+    else {
+        // Collect the candidate files first so results can be merged back in enumeration order,
+        // whichever worker happened to scan them. The walk lists subdirectories on the same
+        // number of threads the scan uses.
+        const Stopwatch enumerationTime;
+        WalkCounters walkCounters;
+        WalkHtmlFiles(scanDirectory, threadCount, fileFilter,
+            [&](const std::filesystem::path& filePath) { candidateFiles.Add(filePath); },
+            [&](const std::string& message) { LogLine(LogLevel::Error) << "Filesystem error: " << message; },
+            &walkCounters);
+        stats.enumerationSeconds = enumerationTime.Seconds();
+        copyWalkCounters(walkCounters);
+        if (scanLimits != nullptr) {
+            scanLimits->memory.Hold(candidateFiles.ArenaBytes() + candidateFiles.Size() * sizeof(PathTable::View));
+        }
+
+        std::vector<ScanContext> workerContexts(threadCount);
+        if (!positionsFileName.empty()) {
+            workerPositions.assign(threadCount, PositionLog(contextBytes));
+            for (size_t workerIndex = 0; workerIndex < threadCount; ++workerIndex) {
+                workerContexts[workerIndex].positions = &workerPositions[workerIndex];
+            }
+        }
+        for (auto& context : workerContexts) {
+            context.countHits = countHits;
+            context.limits = scanLimits;
+        }
+        {
+            const Stopwatch scanTime;
+            WorkStealingPool pool(threadCount);
+            for (FileId fileId = 0; fileId < candidateFiles.Size(); ++fileId) {
+                pool.Submit([&, fileId](size_t workerIndex) {
+                    const std::filesystem::path filePath = candidateFiles.Path(fileId);
+                    try {
+                        // [DEBUG] Print every HTML file that is being opened for scanning
+                        LogLine(LogLevel::Debug) << "[DEBUG] Scanning file: " << filePath.string();
+
+                        ScanContext& context = workerContexts[workerIndex];
+                        const size_t positionBytes = context.positions != nullptr ? context.positions->MemoryBytes() : 0;
+                        bool fileRead = false;
+                        if (useIndex) {
+                            IndexEntry entry;
+                            bool reusedCache = false;
+                            fileRead = ScanFileIncremental(filePath, matcher, readMode, scope, previousIndex,
+                                context, entry, reusedCache);
+                            if (fileRead) {
+                                context.hits.Reset(keywords.size());
+                                for (uint32_t keywordIndex : entry.keywordIndices) {
+                                    context.hits.Mark(keywordIndex);
+                                }
+                                if (reusedCache) {
+                                    ++reusedFileCount;
+                                }
+                                if (scanLimits != nullptr) {
+                                    scanLimits->memory.Hold(sizeof(std::pair<FileId, IndexEntry>)
+                                        + entry.keywordIndices.size() * sizeof(uint32_t));
+                                }
+                                workerIndexEntries[workerIndex].emplace_back(fileId, std::move(entry));
+                            }
+                        }
+                        else {
+                            fileRead = ScanFile(filePath, matcher, readMode, scope, context);
+                        }
+
+                        if (!fileRead) {
+                            ++opensFailed;
+                            LogLine(LogLevel::Warning) << "Warning: Could not open file: " << filePath.string();
+                            return; // Skip to the next file
+                        }
+                        if (context.positions != nullptr) {
+                            context.positions->EndFile(fileId);
+                            if (scanLimits != nullptr) {
+                                scanLimits->memory.Hold(context.positions->MemoryBytes() - positionBytes);
+                            }
                         }
+
+                        recordHits(workerIndex, fileId, filePath, context.hits, countHits ? &context.counts : nullptr);
                     }
-                }
+                    catch (const std::exception& e) {
+                        LogLine(LogLevel::Error) << "An error occurred while scanning " << filePath.string() << ": " << e.what();
+                    }
+                });
+            }
+            pool.Wait();
 
-                // If any keywords were found, add the file path to the map for each keyword.
-                for (const auto& foundKeyword : keywordsFoundInFile) {
-                    foundFilesByKeyword[foundKeyword].push_back(entry.path().string());
-                    std::cout << "Found \"" << foundKeyword << "\" in: " << entry.path().string() << std::endl;
-                }
+            stats.scanSeconds = scanTime.Seconds();
+            for (size_t workerIndex = 0; workerIndex < pool.ThreadCount(); ++workerIndex) {
+                const double busySeconds = pool.BusySeconds(workerIndex);
+                stats.threads.push_back({ "worker", busySeconds, std::max(stats.scanSeconds - busySeconds, 0.0) });
             }
         }
+        for (const auto& context : workerContexts) {
+            stats.bytesRead += context.bytesRead;
+        }
     }
-    catch (const std::filesystem::filesystem_error& e) {
-        std::cerr << "Filesystem error: " << e.what() << std::endl;
+
+    LogLine(LogLevel::Debug) << "[DEBUG] Candidate files: " << candidateFiles.Size() << " ("
+        << candidateFiles.ArenaBytes() / 1024 << " KiB of path storage)";
+
+    stats.candidateFiles = candidateFiles.Size();
+    stats.opensFailed = opensFailed.load();
+    stats.filesMatched = filesMatched.load();
+    stats.keywordHits = keywordHits.load();
+    stats.filesReusedFromIndex = reusedFileCount.load();
+    stats.limitWaitSeconds = limits.WaitSeconds();
+    if (limits.memory.Overrun()) {
+        // Streamed results are never held, but the candidate paths still are.
+        if (streamRecords) {
+            LogLine(LogLevel::Warning) << "Warning: The table of candidate file paths alone outgrew /maxmem, and the scan went on"
+                << " with as little memory as it could.";
+        }
+        else {
+            LogLine(LogLevel::Warning) << "Warning: The results held for the report outgrew /maxmem, and the scan went on with as little"
+                << " memory as it could. /format tsv writes results out as they are found instead of holding them.";
+        }
     }
-    catch (const std::exception& e) {
-        std::cerr << "An error occurred: " << e.what() << std::endl;
+
+    // Shows the statistics with /v and writes them out for /stats once the output is done.
+    auto reportStats = [&](const Stopwatch& outputTime) {
+        stats.outputSeconds = outputTime.Seconds();
+        stats.totalSeconds = totalTime.Seconds();
+        LogScanStats(stats);
+        if (!statsFileName.empty()
+            && !WriteScanStatsJson(statsFileName, std::filesystem::absolute(scanDirectory).string(), stats)) {
+            LogLine(LogLevel::Warning) << "Warning: Could not write statistics to: " << statsFileName.string();
+        }
+    };
+
+    // Merge the per-worker results in enumeration order so the output does not depend on scheduling.
+    const Stopwatch mergeTime;
+    std::vector<FileHit> allHits;
+    for (auto& results : workerResults) {
+        allHits.insert(allHits.end(), results.begin(), results.end());
     }
+    std::sort(allHits.begin(), allHits.end(), [](const FileHit& a, const FileHit& b) {
+        return a.fileId != b.fileId ? a.fileId < b.fileId : a.keywordIndex < b.keywordIndex;
+    });
 
-    // Write the grouped results to the output file.
-    std::ofstream outputFile(outputFileName);
-    if (!outputFile.is_open()) {
-        std::cerr << "Error: Could not open output file for writing: " << outputFileName << std::endl;
-        return 1;
+    // Add every file to the list of each keyword it contains.
+    std::string filePath;
+    for (size_t i = 0; i < allHits.size(); ++i) {
+        const FileHit& hit = allHits[i];
+        if (i == 0 || allHits[i - 1].fileId != hit.fileId) {
+            filePath = candidateFiles.String(hit.fileId);
+        }
+        foundFilesByKeyword[hit.keywordIndex].push_back(hit.fileId);
+        if (countHits) {
+            hitCountsByKeyword[hit.keywordIndex].push_back(hit.count);
+            LogLine(LogLevel::Info) << "Found \"" << keywords[hit.keywordIndex] << "\" " << hit.count << " times in: " << filePath;
+            continue;
+        }
+        LogLine(LogLevel::Info) << "Found \"" << keywords[hit.keywordIndex] << "\" in: " << filePath;
+    }
+
+    // With /top, only the files with the most hits are kept for each keyword.
+    if (topLimit != 0) {
+        std::vector<FileId> topFiles;
+        std::vector<uint32_t> topCounts;
+        for (size_t keywordIndex = 0; keywordIndex < keywords.size(); ++keywordIndex) {
+            SelectTopFiles(foundFilesByKeyword[keywordIndex], hitCountsByKeyword[keywordIndex], topLimit, topFiles, topCounts);
+            foundFilesByKeyword[keywordIndex].swap(topFiles);
+            hitCountsByKeyword[keywordIndex].swap(topCounts);
+        }
+    }
+
+    stats.mergeSeconds = mergeTime.Seconds();
+
+    // Replace the index with what this run saw. Files that have disappeared drop out of it.
+    if (useIndex) {
+        const Stopwatch indexTime;
+        ScanIndex updatedIndex(IndexSignature(keywords, readMode, scope, matchMode), keywords.size());
+        for (auto& entries : workerIndexEntries) {
+            for (auto& pair : entries) {
+                updatedIndex.Set(candidateFiles.String(pair.first), std::move(pair.second));
+            }
+        }
+        LogLine(LogLevel::Debug) << "[DEBUG] Reused cached results for " << reusedFileCount.load() << " of "
+            << candidateFiles.Size() << " files";
+        if (!updatedIndex.Save(indexFileName)) {
+            LogLine(LogLevel::Warning) << "Warning: Could not write index file: " << indexFileName.string();
+        }
+        stats.indexSeconds = indexTime.Seconds();
     }
 
-    outputFile << "Scan results for directory: " << std::filesystem::absolute(scanDirectory).string() << std::endl;
+    const Stopwatch outputTime;
 
-    if (foundFilesByKeyword.empty()) {
-        outputFile << "\nNo files were found containing the specified keywords." << std::endl;
+    if (!positionsFileName.empty()) {
+        if (!WritePositions(positionsFileName, workerPositions, candidateFiles, keywords)) {
+            LogLine(LogLevel::Error) << "Error: Could not write positions to: " << positionsFileName.string();
+            return 1;
+        }
+        LogLine(LogLevel::Info) << "Hit positions saved to " << positionsFileName.string();
     }
-    else {
-        for (const auto& pair : foundFilesByKeyword) {
-            const std::string& keyword = pair.first;
-            const std::vector<std::string>& files = pair.second;
 
-            outputFile << "\n==================================================" << std::endl;
-            outputFile << "Files containing keyword: \"" << keyword << "\"" << std::endl;
-            outputFile << "==================================================" << std::endl;
+    if (streamRecords) {
+        if (!recordWriter.Close()) {
+            LogLine(LogLevel::Error) << "Error: Could not write results to: " << outputFileName;
+            return 1;
+        }
+        LogLine(LogLevel::Info) << "\nScan complete. Results streamed to " << outputFileName;
+
+        // The grouped report is an optional pass over the records that were just written.
+        if (!groupedReportName.empty()) {
+            if (!WriteGroupedReport(outputFileName, groupedReportName, std::filesystem::absolute(scanDirectory).string())) {
+                LogLine(LogLevel::Error) << "Error: Could not write grouped report to: " << groupedReportName.string();
+                return 1;
+            }
+            LogLine(LogLevel::Info) << "Grouped report saved to " << groupedReportName.string();
+        }
+        reportStats(outputTime);
+        return 0;
+    }
 
-            for (const auto& filePath : files) {
-                outputFile << filePath << std::endl;
+    // Writes the binary index or the grouped text report. Logs the reason and returns false if the
+    // file could not be written.
+    auto writeReport = [&](const std::filesystem::path& fileName, const PathTable& paths,
+        const std::vector<std::vector<FileId>>& filesByKeyword) {
+        const std::string rootDirectory = std::filesystem::absolute(scanDirectory).string();
+        if (outputFormat == OutputFormat::Binary) {
+            if (!WriteBinaryIndex(fileName, rootDirectory, IndexSignature(keywords, readMode, scope, matchMode),
+                paths, keywords, filesByKeyword, fileFilter.ShardIndex(), fileFilter.ShardCount())) {
+                LogLine(LogLevel::Error) << "Error: Could not write binary index to: " << fileName.string();
+                return false;
             }
+            return true;
+        }
+        if (!WriteTextReport(fileName, rootDirectory, paths, keywords, filesByKeyword, countHits ? &hitCountsByKeyword : nullptr)) {
+            LogLine(LogLevel::Error) << "Error: Could not open output file for writing: " << fileName.string();
+            return false;
         }
+        return true;
+    };
+
+    if (!writeReport(outputFileName, candidateFiles, foundFilesByKeyword)) {
+        return 1;
+    }
+    LogLine(LogLevel::Info) << "\nScan complete. "
+        << (outputFormat == OutputFormat::Binary ? "Binary index" : "Results") << " saved to " << outputFileName;
+    reportStats(outputTime);
+
+    if (!watchMode) {
+        return 0;
     }
 
-    outputFile.close();
-    std::cout << "\nScan complete. Results saved to " << outputFileName << std::endl;
+    // --- Watch mode ---
+    // The results of the scan stay in memory, and every batch of changes only rescans the files
+    // it touched before the report is rewritten.
+    LiveResults liveResults;
+    {
+        KeywordHits fileHits;
+        for (size_t i = 0; i < allHits.size();) {
+            const FileId fileId = allHits[i].fileId;
+            fileHits.Reset(keywords.size());
+            for (; i < allHits.size() && allHits[i].fileId == fileId; ++i) {
+                fileHits.Mark(allHits[i].keywordIndex);
+            }
+            liveResults.Set(candidateFiles.Path(fileId), fileHits);
+        }
+    }
+
+    // Whether a changed path is a file the walk would have scanned, in this node's shard if the scan
+    // is sharded. Exclude patterns prune whole directories in the walk, so they are checked against
+    // every directory below the root as well.
+    auto isCandidate = [&](const std::filesystem::path& filePath) {
+        const std::filesystem::path relative = filePath.lexically_relative(scanDirectory);
+        const std::filesystem::path fileName = filePath.filename();
+        for (const auto& component : relative.parent_path()) {
+            if (fileFilter.ExcludesDirectory(component.c_str())) {
+                return false;
+            }
+        }
+        return fileFilter.HasExtension(fileName.c_str()) && fileFilter.PassesPatterns(fileName.c_str()) &&
+            (!fileFilter.Sharded() || fileFilter.InShard(relative));
+    };
+
+    std::signal(SIGINT, RequestStop);
+    std::signal(SIGTERM, RequestStop);
+    LogLine(LogLevel::Info) << "\nWatching " << std::filesystem::absolute(scanDirectory).string()
+        << " for changes. Press Ctrl+C to stop.";
+    FlushLog();
+
+    FileFilter treeFilter = fileFilter;
+    treeFilter.SetShard(0, 1);
+    ScanContext watchContext;
+    watchContext.limits = scanLimits;
+    std::vector<WatchEvent> events;
+    std::string watchError;
+    std::filesystem::path temporaryOutputName = outputFileName;
+    temporaryOutputName += ".tmp";
+    while (!stopRequested) {
+        events.clear();
+        if (!watcher.Wait(kWatchPollInterval, events, watchError)) {
+            LogLine(LogLevel::Error) << "Error: Stopped watching " << scanDirectory.string() << ": " << watchError;
+            return 1;
+        }
+        if (events.empty()) {
+            continue;
+        }
+
+        // Editors and publishing tools often write a file in several steps; let the burst settle.
+        for (size_t seen = 0; seen != events.size();) {
+            seen = events.size();
+            if (!watcher.Wait(kWatchSettleTime, events, watchError)) {
+                LogLine(LogLevel::Error) << "Error: Stopped watching " << scanDirectory.string() << ": " << watchError;
+                return 1;
+            }
+        }
+
+        // Drop what was removed, then rescan every file that changed or appeared, each once. A file
+        // that changed and was then removed simply fails to open.
+        const Stopwatch rescanTime;
+        std::vector<std::filesystem::path> changedFiles;
+        std::unordered_set<std::filesystem::path::string_type> queued;
+        auto queueFile = [&](const std::filesystem::path& filePath) {
+            if (isCandidate(filePath) && queued.insert(filePath.native()).second) {
+                changedFiles.push_back(filePath);
+            }
+        };
+        // The walk would decide shards relative to the new directory rather than the root, so it lists
+        // every file and isCandidate picks this shard's.
+        auto queueTree = [&](const std::filesystem::path& directory) {
+            WalkHtmlFiles(directory, 1, treeFilter, queueFile,
+                [&](const std::string& message) { LogLine(LogLevel::Error) << "Filesystem error: " << message; });
+        };
+
+        size_t removedCount = 0;
+        const bool overflowed = std::any_of(events.begin(), events.end(),
+            [](const WatchEvent& event) { return event.kind == WatchEvent::Kind::Overflow; });
+        if (overflowed) {
+            LogLine(LogLevel::Warning) << "Warning: Too many changes to track one by one; rescanning the whole directory.";
+            liveResults.Clear();
+            queueTree(scanDirectory);
+        }
+        else {
+            for (const WatchEvent& event : events) {
+                switch (event.kind) {
+                case WatchEvent::Kind::FileChanged:
+                    queueFile(event.path);
+                    break;
+                case WatchEvent::Kind::DirectoryAdded:
+                    queueTree(event.path);
+                    break;
+                case WatchEvent::Kind::Removed:
+                    LogLine(LogLevel::Debug) << "[DEBUG] Removed: " << event.path.string();
+                    liveResults.Remove(event.path);
+                    ++removedCount;
+                    break;
+                case WatchEvent::Kind::Overflow:
+                    break;
+                }
+            }
+        }
+
+        for (const auto& filePath : changedFiles) {
+            LogLine(LogLevel::Debug) << "[DEBUG] Rescanning file: " << filePath.string();
+            if (ScanFile(filePath, matcher, readMode, scope, watchContext)) {
+                liveResults.Set(filePath, watchContext.hits);
+            }
+            else {
+                liveResults.Remove(filePath);
+            }
+        }
+        if (changedFiles.empty() && removedCount == 0) {
+            continue;
+        }
+
+        // Replace the report in one step, so anything reading it never sees half a file.
+        PathTable livePaths;
+        std::vector<std::vector<FileId>> liveFilesByKeyword(keywords.size());
+        liveResults.Collect(livePaths, liveFilesByKeyword);
+        if (!writeReport(temporaryOutputName, livePaths, liveFilesByKeyword)) {
+            return 1;
+        }
+        std::error_code renameError;
+        std::filesystem::rename(temporaryOutputName, outputFileName, renameError);
+        if (renameError) {
+            LogLine(LogLevel::Error) << "Error: Could not replace " << outputFileName << ": " << renameError.message();
+            return 1;
+        }
+        LogLine(LogLevel::Info) << "Rescanned " << changedFiles.size() << " changed files and dropped " << removedCount
+            << " removed paths in " << rescanTime.Seconds() * 1000.0 << " ms; " << liveResults.Size()
+            << " files have hits. Results saved to " << outputFileName;
+        FlushLog();
+    }
 
+    LogLine(LogLevel::Info) << "Stopped watching.";
     return 0;
 }
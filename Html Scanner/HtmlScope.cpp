@@ -0,0 +1,303 @@
+#include "HtmlScope.h"
+
+#include "CaseFold.h"
+
+#include <cstring>
+
+
+namespace {
+
+    bool IsSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+    }
+
+    bool IsAsciiLetter(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    // Offset of the first occurrence of c at or after start, or size if there is none.
+    size_t FindByte(const char* data, size_t start, size_t size, char c) {
+        const void* found = std::memchr(data + start, c, size - start);
+        return found != nullptr ? static_cast<size_t>(static_cast<const char*>(found) - data) : size;
+    }
+
+}
+
+bool ParseScanScope(const std::string& name, ScanScope& scope)
+{
+    if (name == "all") {
+        scope = ScanScope::All;
+    }
+    else if (name == "text") {
+        scope = ScanScope::Text;
+    }
+    else if (name == "tags") {
+        scope = ScanScope::Tags;
+    }
+    else if (name == "attrs") {
+        scope = ScanScope::Attributes;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+const char* ScanScopeName(ScanScope scope)
+{
+    switch (scope) {
+    case ScanScope::Text: return "text";
+    case ScanScope::Tags: return "tags";
+    case ScanScope::Attributes: return "attrs";
+    default: return "all";
+    }
+}
+
+HtmlScopeFilter::HtmlScopeFilter(ScanScope scope)
+    : m_scope(scope)
+{
+}
+
+void HtmlScopeFilter::Reset()
+{
+    m_state = State::Text;
+    m_separated = true;
+    m_tagNameLength = 0;
+    m_quote = 0;
+    m_dashes = 0;
+    m_rawTextEnd = nullptr;
+    m_rawTextMatched = 0;
+}
+
+void HtmlScopeFilter::Keep(ScanScope region, const char* data, size_t size, char* out, size_t& written)
+{
+    if (m_scope == region && size > 0) {
+        std::memmove(out + written, data, size);
+        written += size;
+        m_separated = false;
+    }
+}
+
+void HtmlScopeFilter::Gap(ScanScope region, char* out, size_t& written)
+{
+    // Only called after consuming a byte that is not kept, so in-place output never overtakes the input.
+    if (m_scope == region && !m_separated) {
+        out[written++] = kSeparator;
+        m_separated = true;
+    }
+}
+
+void HtmlScopeFilter::FinishStartTag()
+{
+    m_state = State::Text;
+    if (m_tagNameLength == 6 && std::memcmp(m_tagName, "script", 6) == 0) {
+        m_rawTextEnd = "/script";
+        m_state = State::RawText;
+    }
+    else if (m_tagNameLength == 5 && std::memcmp(m_tagName, "style", 5) == 0) {
+        m_rawTextEnd = "/style";
+        m_state = State::RawText;
+    }
+}
+
+size_t HtmlScopeFilter::Filter(const char* data, size_t size, char* out)
+{
+    if (m_scope == ScanScope::All) {
+        if (out != data) {
+            std::memmove(out, data, size);
+        }
+        return size;
+    }
+
+    size_t written = 0;
+    size_t i = 0;
+    while (i < size) {
+        switch (m_state) {
+        case State::Text: {
+            const size_t end = FindByte(data, i, size, '<');
+            Keep(ScanScope::Text, data + i, end - i, out, written);
+            i = end;
+            if (i < size) {
+                ++i;
+                Gap(ScanScope::Text, out, written);
+                m_state = State::TagOpen;
+            }
+            break;
+        }
+
+        case State::TagOpen: {
+            const char c = data[i];
+            if (IsAsciiLetter(c)) {
+                m_state = State::StartTagName;
+                m_tagNameLength = 0;
+            }
+            else if (c == '/') {
+                ++i;
+                m_state = State::EndTagName;
+            }
+            else if (c == '!') {
+                ++i;
+                m_state = State::MarkupDeclaration;
+            }
+            else if (c == '?') {
+                ++i;
+                m_state = State::BogusComment;
+            }
+            else {
+                // A '<' that opens no tag is plain text; look at this byte again as text.
+                m_state = State::Text;
+            }
+            break;
+        }
+
+        case State::StartTagName: {
+            const char c = data[i++];
+            if (c == '>') {
+                Gap(ScanScope::Tags, out, written);
+                FinishStartTag();
+            }
+            else if (IsSpace(c) || c == '/') {
+                Gap(ScanScope::Tags, out, written);
+                m_state = State::Attributes;
+                Keep(ScanScope::Attributes, &c, 1, out, written);
+            }
+            else {
+                Keep(ScanScope::Tags, &c, 1, out, written);
+                if (m_tagNameLength < sizeof(m_tagName)) {
+                    m_tagName[m_tagNameLength] = static_cast<char>(CaseFold::Fold(static_cast<unsigned char>(c)));
+                }
+                // Counts past the stored letters too, so longer names never look like script or style.
+                if (m_tagNameLength <= sizeof(m_tagName)) {
+                    ++m_tagNameLength;
+                }
+            }
+            break;
+        }
+
+        case State::Attributes: {
+            size_t end = i;
+            while (end < size && data[end] != '>' && data[end] != '"' && data[end] != '\'') {
+                ++end;
+            }
+            Keep(ScanScope::Attributes, data + i, end - i, out, written);
+            i = end;
+            if (i < size) {
+                const char c = data[i++];
+                if (c == '>') {
+                    Gap(ScanScope::Attributes, out, written);
+                    FinishStartTag();
+                }
+                else {
+                    Keep(ScanScope::Attributes, &c, 1, out, written);
+                    m_quote = c;
+                    m_state = State::QuotedValue;
+                }
+            }
+            break;
+        }
+
+        case State::QuotedValue: {
+            // A '>' inside quotes does not end the tag.
+            size_t end = FindByte(data, i, size, m_quote);
+            if (end < size) {
+                ++end;
+                m_state = State::Attributes;
+            }
+            Keep(ScanScope::Attributes, data + i, end - i, out, written);
+            i = end;
+            break;
+        }
+
+        case State::EndTagName: {
+            const char c = data[i++];
+            if (c == '>') {
+                Gap(ScanScope::Tags, out, written);
+                m_state = State::Text;
+            }
+            else if (IsSpace(c) || c == '/') {
+                Gap(ScanScope::Tags, out, written);
+                m_state = State::EndTagRest;
+            }
+            else {
+                Keep(ScanScope::Tags, &c, 1, out, written);
+            }
+            break;
+        }
+
+        case State::EndTagRest:
+        case State::BogusComment: {
+            i = FindByte(data, i, size, '>');
+            if (i < size) {
+                ++i;
+                m_state = State::Text;
+            }
+            break;
+        }
+
+        case State::MarkupDeclaration: {
+            m_state = (data[i++] == '-') ? State::CommentStart : State::BogusComment;
+            if (m_state == State::BogusComment && data[i - 1] == '>') {
+                m_state = State::Text;
+            }
+            break;
+        }
+
+        case State::CommentStart: {
+            m_state = (data[i++] == '-') ? State::Comment : State::BogusComment;
+            m_dashes = 0;
+            if (m_state == State::BogusComment && data[i - 1] == '>') {
+                m_state = State::Text;
+            }
+            break;
+        }
+
+        case State::Comment: {
+            if (m_dashes == 0) {
+                i = FindByte(data, i, size, '-');
+                if (i == size) {
+                    break;
+                }
+            }
+            const char c = data[i++];
+            if (c == '>' && m_dashes >= 2) {
+                m_state = State::Text;
+            }
+            m_dashes = (c == '-') ? m_dashes + 1 : 0;
+            break;
+        }
+
+        case State::RawText: {
+            i = FindByte(data, i, size, '<');
+            if (i < size) {
+                ++i;
+                m_rawTextMatched = 0;
+                m_state = State::RawTextEndTag;
+            }
+            break;
+        }
+
+        case State::RawTextEndTag: {
+            const char c = data[i];
+            if (m_rawTextEnd[m_rawTextMatched] == '\0') {
+                // The whole end tag name has been seen; it has to stop here to close the element.
+                if (c == '>' || IsSpace(c) || c == '/') {
+                    m_state = State::EndTagRest;
+                }
+                else {
+                    m_state = State::RawText;
+                }
+            }
+            else if (CaseFold::Fold(static_cast<unsigned char>(c)) == static_cast<unsigned char>(m_rawTextEnd[m_rawTextMatched])) {
+                ++i;
+                ++m_rawTextMatched;
+            }
+            else {
+                // Not the end tag after all; look at this byte again, it may start another '<'.
+                m_state = State::RawText;
+            }
+            break;
+        }
+        }
+    }
+    return written;
+}
@@ -0,0 +1,90 @@
+// HTML-aware scan scope.
+// A small streaming tokenizer runs ahead of the matcher and keeps only the bytes of one kind:
+// the text content of the page, tag names, or the attribute part of start tags. Comments,
+// doctypes and the bodies of <script> and <style> elements are dropped for every scope but All,
+// and are stepped over with memchr rather than byte by byte. The tokenizer keeps its state in a
+// few fields, so it never allocates and a file can be fed to it in any number of pieces.
+// Character references are not decoded; "&amp;" stays as written.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+enum class ScanScope {
+    // Every byte of the file, markup included. No tokenizer runs.
+    All,
+    // Text between tags, outside comments, scripts and style sheets.
+    Text,
+    // Element names of start and end tags.
+    Tags,
+    // Everything in a start tag after its name: attribute names, values and quotes.
+    Attributes,
+};
+
+// Parses a /scope value: text, tags, attrs or all. Returns false for anything else.
+bool ParseScanScope(const std::string& name, ScanScope& scope);
+
+// The /scope name of a scope, for diagnostics and index signatures.
+const char* ScanScopeName(ScanScope scope);
+
+class HtmlScopeFilter {
+public:
+    // Written in place of every run of bytes that was dropped, so keywords never match across
+    // such a gap. Keywords given on the command line cannot contain it.
+    static constexpr char kSeparator = '\0';
+
+    explicit HtmlScopeFilter(ScanScope scope = ScanScope::All);
+
+    // Forgets everything about the previous file.
+    void Reset();
+
+    // Feeds the next size bytes of the file and copies those in scope to out, with separators
+    // where bytes were dropped. Returns the number of bytes written, which is never more than
+    // size. out may point at data, in which case the buffer is filtered in place.
+    size_t Filter(const char* data, size_t size, char* out);
+
+private:
+    enum class State : uint8_t {
+        Text,
+        // Just after '<'.
+        TagOpen,
+        StartTagName,
+        Attributes,
+        QuotedValue,
+        EndTagName,
+        // Anything after an end tag's name, up to '>'.
+        EndTagRest,
+        // Just after "<!".
+        MarkupDeclaration,
+        // Just after "<!-".
+        CommentStart,
+        Comment,
+        // Doctypes, CDATA sections and processing instructions, up to '>'.
+        BogusComment,
+        // Inside <script> or <style>, where only the matching end tag ends the element.
+        RawText,
+        RawTextEndTag,
+    };
+
+    void Keep(ScanScope region, const char* data, size_t size, char* out, size_t& written);
+    void Gap(ScanScope region, char* out, size_t& written);
+    void FinishStartTag();
+
+    ScanScope m_scope;
+    State m_state = State::Text;
+    // True when nothing was kept since the last separator, so another one is not needed.
+    bool m_separated = true;
+    // The first letters of the current start tag's name, lowercased, enough to spot script and style.
+    char m_tagName[6] = {};
+    size_t m_tagNameLength = 0;
+    char m_quote = 0;
+    // Dashes seen in a row inside a comment.
+    size_t m_dashes = 0;
+    // The end tag that closes the current raw text element ("/script" or "/style") and how many
+    // of its characters have been matched.
+    const char* m_rawTextEnd = nullptr;
+    size_t m_rawTextMatched = 0;
+};
@@ -0,0 +1,92 @@
+// Per-file record of which keywords have been seen so far, one bit per keyword.
+// Keywords are referred to by their index in the keyword list throughout the scan, so recording
+// a hit never compares or copies a string.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+
+// Receives every match an engine's FindAll comes across, in the order the matches end: the
+// keyword and the offset just past its last byte in the text scanned.
+using MatchFound = std::function<void(size_t keywordIndex, size_t end)>;
+
+class KeywordHits {
+public:
+    // Clears every bit. The storage is kept, so reusing one record for file after file does not
+    // allocate once the first file has been scanned.
+    void Reset(size_t keywordCount) {
+        m_words.assign((keywordCount + 63) / 64, 0);
+        m_keywordCount = keywordCount;
+        m_remaining = keywordCount;
+    }
+
+    size_t KeywordCount() const { return m_keywordCount; }
+
+    // Number of keywords matched so far.
+    size_t FoundCount() const { return m_keywordCount - m_remaining; }
+
+    // True once every keyword has matched. Scanning can stop as soon as it is.
+    bool Complete() const { return m_remaining == 0; }
+
+    bool Found(size_t keywordIndex) const {
+        return (m_words[keywordIndex / 64] >> (keywordIndex % 64)) & 1;
+    }
+
+    // Bit b is set while some keyword whose index is b modulo 64 has not been found, so with up to
+    // 64 keywords it is exactly the set still to find.
+    uint64_t PendingMask() const {
+        uint64_t pending = 0;
+        for (size_t wordIndex = 0; wordIndex < m_words.size(); ++wordIndex) {
+            const size_t bitCount = std::min<size_t>(64, m_keywordCount - wordIndex * 64);
+            const uint64_t used = bitCount == 64 ? ~uint64_t{ 0 } : (uint64_t{ 1 } << bitCount) - 1;
+            pending |= ~m_words[wordIndex] & used;
+        }
+        return pending;
+    }
+
+    // Marks a keyword as found. Returns true if this was its first match.
+    bool Mark(size_t keywordIndex) {
+        uint64_t& word = m_words[keywordIndex / 64];
+        const uint64_t bit = uint64_t{ 1 } << (keywordIndex % 64);
+        if (word & bit) {
+            return false;
+        }
+        word |= bit;
+        --m_remaining;
+        return true;
+    }
+
+    // Marks every keyword found in other, which must have been reset to the same keyword count.
+    void Merge(const KeywordHits& other) {
+        for (size_t wordIndex = 0; wordIndex < m_words.size(); ++wordIndex) {
+            uint64_t added = other.m_words[wordIndex] & ~m_words[wordIndex];
+            m_words[wordIndex] |= added;
+            for (; added != 0; added &= added - 1) {
+                --m_remaining;
+            }
+        }
+    }
+
+    // Calls visit with the index of every keyword found, in ascending order.
+    template <typename Visitor>
+    void ForEach(Visitor&& visit) const {
+        for (size_t wordIndex = 0; wordIndex < m_words.size(); ++wordIndex) {
+            size_t keywordIndex = wordIndex * 64;
+            for (uint64_t word = m_words[wordIndex]; word != 0; word >>= 1, ++keywordIndex) {
+                if (word & 1) {
+                    visit(keywordIndex);
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<uint64_t> m_words;
+    size_t m_keywordCount = 0;
+    size_t m_remaining = 0;
+};
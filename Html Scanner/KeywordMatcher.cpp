@@ -0,0 +1,382 @@
+#include "KeywordMatcher.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace {
+
+    // How far before the end of a pattern match its start is looked for; a longer match is
+    // recorded as starting this far back.
+    constexpr size_t kPatternLookBehind = 4096;
+
+    bool IsUtf8Continuation(char byte) {
+        return (static_cast<unsigned char>(byte) & 0xC0) == 0x80;
+    }
+
+    // Moves end back to the lead byte of a UTF-8 sequence that text[floor, end) would cut short,
+    // but not below floor.
+    size_t TrimPartialUtf8(const char* text, size_t floor, size_t end) {
+        size_t lead = end;
+        while (lead > floor && end - lead < 4 && IsUtf8Continuation(text[lead - 1])) {
+            --lead;
+        }
+        if (lead == floor) {
+            return end;
+        }
+        --lead;
+        const unsigned char byte = static_cast<unsigned char>(text[lead]);
+        const size_t length = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+        return end - lead < length ? lead : end;
+    }
+
+}
+
+KeywordMatcher::KeywordMatcher(const KeywordSearch& search, bool stopAtNewlines)
+{
+    Reset(search, stopAtNewlines);
+}
+
+void KeywordMatcher::Reset(const KeywordSearch& search, bool stopAtNewlines, PositionLog* positions,
+    bool countMatches)
+{
+    m_search = &search;
+    m_stopAtNewlines = stopAtNewlines;
+    m_hits.Reset(search.KeywordCount());
+    m_overlap = search.Patterns() == nullptr && search.MaxKeywordLength() > 0 ? search.MaxKeywordLength() - 1 : 0;
+    m_tail.resize(m_overlap);
+    m_tailSize = 0;
+    m_stitch.resize(2 * m_overlap);
+    m_cursor.states.clear();
+
+    m_countMatches = countMatches;
+    m_counts.assign(countMatches ? search.KeywordCount() : 0, 0);
+    m_alignedMatches = search.CodeUnitSize() > 1;
+    m_positions = positions;
+    m_recorded = 0;
+    m_history = 0;
+    m_windowOffset = 0;
+    m_linePosition = 0;
+    m_lineNumber = 1;
+    m_openSnippets.clear();
+    // Counting alone only needs the history to hold the start of a literal match. Telling whether
+    // a pattern match is aligned needs its start as well; literal UTF-16 patterns are bounded.
+    m_historyLimit = m_overlap;
+    if (m_alignedMatches && search.Patterns() != nullptr) {
+        m_historyLimit = search.MaxKeywordLength();
+    }
+    if (positions != nullptr) {
+        const size_t lookBehind = search.Patterns() != nullptr ? kPatternLookBehind : search.MaxKeywordLength();
+        m_historyLimit = lookBehind + positions->ContextBytes();
+    }
+}
+
+void KeywordMatcher::Feed(const char* data, size_t size)
+{
+    if (size == 0 || Complete()) {
+        return;
+    }
+
+    if (FindingEveryMatch()) {
+        FeedEveryMatch(data, size);
+        return;
+    }
+
+    if (m_search->Patterns() != nullptr) {
+        FeedPatterns(*m_search->Patterns(), data, size);
+        return;
+    }
+
+    // Keywords that start in the tail and end in this chunk. Those entirely inside either one are
+    // found on their own.
+    if (m_tailSize > 0) {
+        size_t head = std::min(size, m_overlap);
+        if (m_stopAtNewlines) {
+            const void* newline = std::memchr(data, '\n', head);
+            if (newline != nullptr) {
+                head = static_cast<size_t>(static_cast<const char*>(newline) - data);
+            }
+        }
+        if (head > 0) {
+            std::memcpy(m_stitch.data(), m_tail.data(), m_tailSize);
+            std::memcpy(m_stitch.data() + m_tailSize, data, head);
+            m_search->Scan(m_stitch.data(), m_tailSize + head, m_hits);
+        }
+    }
+
+    ScanChunk(data, size);
+    KeepTail(data, size);
+}
+
+void KeywordMatcher::Finish()
+{
+    m_tailSize = 0;
+    m_cursor.states.clear();
+    if (m_positions != nullptr) {
+        for (const auto& snippet : m_openSnippets) {
+            AddSnippet(snippet.keywordIndex, snippet.offset, snippet.line, snippet.text.data(), snippet.text.size());
+        }
+        m_openSnippets.clear();
+        m_positions = nullptr;
+    }
+}
+
+void KeywordMatcher::FeedEveryMatch(const char* data, size_t size)
+{
+    if (m_positions != nullptr) {
+        CompleteSnippets(data, size);
+    }
+
+    m_window.resize(m_history + size);
+    std::memcpy(m_window.data() + m_history, data, size);
+    FindInWindow(size);
+    if (m_positions != nullptr) {
+        // Line numbers are carried on from the end of the window.
+        LineAt(m_window.size());
+    }
+
+    if (!FindingEveryMatch()) {
+        // Done recording: set up the tail the plain path carries on from.
+        m_tailSize = 0;
+        KeepTail(m_window.data(), m_window.size());
+    }
+
+    const size_t keep = std::min(m_window.size(), m_historyLimit);
+    const size_t dropped = m_window.size() - keep;
+    std::memmove(m_window.data(), m_window.data() + dropped, keep);
+    m_window.resize(keep);
+    m_history = keep;
+    m_windowOffset += dropped;
+    m_linePosition = keep;
+}
+
+void KeywordMatcher::FindInWindow(size_t chunkSize)
+{
+    const char* window = m_window.data();
+    const size_t windowSize = m_window.size();
+    size_t base = 0;
+    const MatchFound found = [this, &base](size_t keywordIndex, size_t end) {
+        // Literal matches that end in the history were seen with the previous chunk.
+        if (base + end <= m_history) {
+            return;
+        }
+        if (m_alignedMatches && (m_windowOffset + m_search->MatchStart(keywordIndex, m_window.data(), base + end)) % 2 != 0) {
+            return;
+        }
+        m_hits.Mark(keywordIndex);
+        if (m_countMatches && m_counts[keywordIndex] != UINT32_MAX) {
+            ++m_counts[keywordIndex];
+        }
+        if (m_positions != nullptr && m_recorded < m_positions->MaxPerFile()) {
+            ++m_recorded;
+            RecordHit(keywordIndex, base + end);
+        }
+    };
+
+    if (const PatternSearch* patterns = m_search->Patterns()) {
+        if (!m_stopAtNewlines) {
+            base = m_history;
+            patterns->FindAll(m_cursor, window + base, chunkSize, found);
+            return;
+        }
+        for (size_t lineStart = m_history; lineStart < windowSize;) {
+            const void* newline = std::memchr(window + lineStart, '\n', windowSize - lineStart);
+            const size_t lineEnd = newline != nullptr ? static_cast<size_t>(static_cast<const char*>(newline) - window) : windowSize;
+            base = lineStart;
+            patterns->FindAll(m_cursor, window + lineStart, lineEnd - lineStart, found);
+            if (newline != nullptr) {
+                m_cursor.states.clear();
+            }
+            lineStart = lineEnd + 1;
+        }
+        return;
+    }
+
+    // Only the last m_overlap bytes of the history can hold the start of a match ending in the chunk.
+    base = m_history - std::min(m_history, m_overlap);
+    if (!m_stopAtNewlines) {
+        m_search->FindAll(window + base, windowSize - base, found);
+        return;
+    }
+    for (size_t lineStart = base; lineStart < windowSize;) {
+        const void* newline = std::memchr(window + lineStart, '\n', windowSize - lineStart);
+        const size_t lineEnd = newline != nullptr ? static_cast<size_t>(static_cast<const char*>(newline) - window) : windowSize;
+        base = lineStart;
+        m_search->FindAll(window + lineStart, lineEnd - lineStart, found);
+        lineStart = lineEnd + 1;
+    }
+}
+
+void KeywordMatcher::RecordHit(size_t keywordIndex, size_t end)
+{
+    const char* window = m_window.data();
+    const size_t windowSize = m_window.size();
+    const size_t context = m_positions->ContextBytes();
+    const size_t start = m_search->MatchStart(keywordIndex, window, end);
+
+    // The snippet stays on the match's line.
+    size_t snippetStart = start;
+    const size_t snippetStartLimit = start - std::min(start, context);
+    while (snippetStart > snippetStartLimit && window[snippetStart - 1] != '\n') {
+        --snippetStart;
+    }
+    // UTF-16 snippets start on a code unit, for AddSnippet to decode them.
+    if (m_alignedMatches && (m_windowOffset + snippetStart) % 2 != 0) {
+        ++snippetStart;
+    }
+    // UTF-8 snippets start and end on whole characters, so the positions file stays valid UTF-8.
+    const bool utf8 = m_search->Encoding() == TextEncoding::Utf8;
+    while (utf8 && snippetStart < start && IsUtf8Continuation(window[snippetStart])) {
+        ++snippetStart;
+    }
+    size_t snippetEnd = end;
+    const size_t snippetEndLimit = end + context;
+    while (snippetEnd < std::min(snippetEndLimit, windowSize) && window[snippetEnd] != '\n') {
+        ++snippetEnd;
+    }
+    if (utf8 && snippetEnd == snippetEndLimit) {
+        snippetEnd = TrimPartialUtf8(window, end, snippetEnd);
+    }
+
+    const uint64_t offset = m_windowOffset + start;
+    const uint64_t line = LineAt(start);
+    if (snippetEnd == windowSize && snippetEnd < snippetEndLimit) {
+        OpenSnippet snippet;
+        snippet.keywordIndex = keywordIndex;
+        snippet.offset = offset;
+        snippet.line = line;
+        snippet.text.assign(window + snippetStart, snippetEnd - snippetStart);
+        snippet.missing = snippetEndLimit - snippetEnd;
+        m_openSnippets.push_back(std::move(snippet));
+        return;
+    }
+    AddSnippet(keywordIndex, offset, line, window + snippetStart, snippetEnd - snippetStart);
+}
+
+void KeywordMatcher::CompleteSnippets(const char* data, size_t size)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < m_openSnippets.size(); ++i) {
+        OpenSnippet& snippet = m_openSnippets[i];
+        size_t take = std::min(snippet.missing, size);
+        const void* newline = std::memchr(data, '\n', take);
+        const bool ended = newline != nullptr || take == snippet.missing;
+        if (newline != nullptr) {
+            take = static_cast<size_t>(static_cast<const char*>(newline) - data);
+        }
+        snippet.text.append(data, take);
+        snippet.missing -= take;
+        if (ended && newline == nullptr && m_search->Encoding() == TextEncoding::Utf8) {
+            snippet.text.resize(TrimPartialUtf8(snippet.text.data(), 0, snippet.text.size()));
+        }
+        if (ended) {
+            AddSnippet(snippet.keywordIndex, snippet.offset, snippet.line, snippet.text.data(), snippet.text.size());
+        }
+        else {
+            if (kept != i) {
+                m_openSnippets[kept] = std::move(snippet);
+            }
+            ++kept;
+        }
+    }
+    m_openSnippets.resize(kept);
+}
+
+void KeywordMatcher::AddSnippet(size_t keywordIndex, uint64_t offset, uint64_t line, const char* text, size_t size)
+{
+    // The positions file is UTF-8 whatever the page was written in.
+    if (m_search->Encoding() != TextEncoding::Utf8) {
+        m_snippetText.clear();
+        AppendAsUtf8(text, size, m_search->Encoding(), m_snippetText);
+        text = m_snippetText.data();
+        size = m_snippetText.size();
+    }
+    m_positions->Add(keywordIndex, offset, line, text, size);
+}
+
+uint64_t KeywordMatcher::LineAt(size_t position)
+{
+    const char* window = m_window.data();
+    if (position >= m_linePosition) {
+        m_lineNumber += static_cast<uint64_t>(std::count(window + m_linePosition, window + position, '\n'));
+    }
+    else {
+        m_lineNumber -= static_cast<uint64_t>(std::count(window + position, window + m_linePosition, '\n'));
+    }
+    m_linePosition = position;
+    return m_lineNumber;
+}
+
+void KeywordMatcher::FeedPatterns(const PatternSearch& patterns, const char* data, size_t size)
+{
+    if (!m_stopAtNewlines) {
+        patterns.Scan(m_cursor, data, size, m_hits);
+        return;
+    }
+
+    // Only the first line can continue one from the previous chunk, and only the last one can
+    // carry on into the next; the lines in between are matched on their own.
+    const char* end = data + size;
+    for (const char* lineStart = data; lineStart < end && !m_hits.Complete();) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', static_cast<size_t>(end - lineStart)));
+        if (lineEnd == nullptr) {
+            patterns.Scan(m_cursor, lineStart, static_cast<size_t>(end - lineStart), m_hits);
+            return;
+        }
+        if (m_cursor.states.empty()) {
+            patterns.Scan(lineStart, static_cast<size_t>(lineEnd - lineStart), m_hits);
+        }
+        else {
+            patterns.Scan(m_cursor, lineStart, static_cast<size_t>(lineEnd - lineStart), m_hits);
+            m_cursor.states.clear();
+        }
+        lineStart = lineEnd + 1;
+    }
+}
+
+void KeywordMatcher::ScanChunk(const char* data, size_t size)
+{
+    if (!m_stopAtNewlines) {
+        m_search->Scan(data, size, m_hits);
+        return;
+    }
+
+    const char* end = data + size;
+    for (const char* lineStart = data; lineStart < end && !m_hits.Complete();) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', static_cast<size_t>(end - lineStart)));
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+        m_search->Scan(lineStart, static_cast<size_t>(lineEnd - lineStart), m_hits);
+        lineStart = lineEnd + 1;
+    }
+}
+
+void KeywordMatcher::KeepTail(const char* data, size_t size)
+{
+    size_t keepFrom = size > m_overlap ? size - m_overlap : 0;
+    bool startsOver = size >= m_overlap;
+    if (m_stopAtNewlines) {
+        // Nothing before the last newline can be part of a match in the next chunk.
+        for (size_t i = size; i > keepFrom; --i) {
+            if (data[i - 1] == '\n') {
+                keepFrom = i;
+                startsOver = true;
+                break;
+            }
+        }
+    }
+
+    if (startsOver) {
+        m_tailSize = size - keepFrom;
+        std::memcpy(m_tail.data(), data + keepFrom, m_tailSize);
+        return;
+    }
+
+    // A chunk shorter than the overlap: append it and keep the last m_overlap bytes.
+    const size_t combined = m_tailSize + size;
+    const size_t dropped = combined > m_overlap ? combined - m_overlap : 0;
+    std::memmove(m_tail.data(), m_tail.data() + dropped, m_tailSize - dropped);
+    std::memcpy(m_tail.data() + m_tailSize - dropped, data, size);
+    m_tailSize = combined - dropped;
+}
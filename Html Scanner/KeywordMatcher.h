@@ -0,0 +1,112 @@
+// Streaming keyword matching over a file fed in arbitrary chunks.
+// KeywordSearch only finds keywords that lie entirely inside the buffer it is given. The matcher
+// remembers the last MaxKeywordLength() - 1 bytes of the stream and matches them together with
+// the start of the next chunk, so a keyword split across two chunks is still found, whatever the
+// chunk sizes. Any reader can hand its buffers straight to Feed: no line or block copies are made,
+// and after the first file the matcher no longer allocates. Patterns have no tail: the DFA simply
+// carries on from where the previous chunk left it, however long a match runs.
+//
+// Given a PositionLog, the matcher also records where hits are (/positions), and it can count
+// every occurrence of each keyword (/count). Either way it goes through every match instead of
+// stopping at a keyword's first one. For positions it keeps enough of the stream behind each chunk
+// to find where a match started and cut a snippet around it, and finishes a snippet that runs past
+// the end of a chunk from the next one. A search of UTF-16 text goes the same way for every
+// stream, since only the matches that start on a code unit boundary count.
+
+#pragma once
+
+#include "KeywordHits.h"
+#include "KeywordSearch.h"
+#include "MatchPositions.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+class KeywordMatcher {
+public:
+    KeywordMatcher() = default;
+    explicit KeywordMatcher(const KeywordSearch& search, bool stopAtNewlines = false);
+
+    // Starts a new stream. With stopAtNewlines, keywords never match across a '\n', just as if
+    // every line were matched on its own (ReadMode::Lines). With positions, hits of the stream are
+    // added to that log, up to its per-file cap. With countMatches, Counts() is filled in.
+    void Reset(const KeywordSearch& search, bool stopAtNewlines = false, PositionLog* positions = nullptr,
+        bool countMatches = false);
+
+    // Matches the next chunk of the stream.
+    void Feed(const char* data, size_t size);
+
+    // Ends the stream. Hits() and the positions recorded are final afterwards.
+    void Finish();
+
+    // True once every keyword has been found, and neither matches are being counted nor positions
+    // recorded; the rest of the stream need not be fed.
+    bool Complete() const { return m_hits.Complete() && !m_countMatches && !RecordingPositions(); }
+
+    const KeywordHits& Hits() const { return m_hits; }
+
+    // With countMatches, the number of matches of each keyword, told apart by where they end.
+    // Counts saturate at UINT32_MAX.
+    const std::vector<uint32_t>& Counts() const { return m_counts; }
+
+private:
+    void ScanChunk(const char* data, size_t size);
+    void KeepTail(const char* data, size_t size);
+    void FeedPatterns(const PatternSearch& patterns, const char* data, size_t size);
+
+    struct OpenSnippet {
+        size_t keywordIndex = 0;
+        uint64_t offset = 0;
+        uint64_t line = 0;
+        std::string text;
+        // Bytes of context still wanted from the next chunk.
+        size_t missing = 0;
+    };
+
+    bool RecordingPositions() const {
+        return m_positions != nullptr && (m_recorded < m_positions->MaxPerFile() || !m_openSnippets.empty());
+    }
+    bool FindingEveryMatch() const { return m_countMatches || m_alignedMatches || RecordingPositions(); }
+    void FeedEveryMatch(const char* data, size_t size);
+    void FindInWindow(size_t chunkSize);
+    void RecordHit(size_t keywordIndex, size_t end);
+    void CompleteSnippets(const char* data, size_t size);
+    void AddSnippet(size_t keywordIndex, uint64_t offset, uint64_t line, const char* text, size_t size);
+    uint64_t LineAt(size_t position);
+
+    const KeywordSearch* m_search = nullptr;
+    bool m_stopAtNewlines = false;
+    KeywordHits m_hits;
+    // A keyword that ends in the next chunk starts at most this many bytes before it.
+    size_t m_overlap = 0;
+    // The last m_overlap bytes of the stream, or fewer at its start (or a line's, with stopAtNewlines).
+    std::vector<char> m_tail;
+    size_t m_tailSize = 0;
+    // The tail followed by the start of the next chunk.
+    std::vector<char> m_stitch;
+    // Where the pattern engine stopped, in place of the tail.
+    PatternSearch::Cursor m_cursor;
+
+    bool m_countMatches = false;
+    std::vector<uint32_t> m_counts;
+    // Set for UTF-16 searches: matches starting at an odd stream offset are dropped.
+    bool m_alignedMatches = false;
+    // Only set while recording positions.
+    PositionLog* m_positions = nullptr;
+    size_t m_recorded = 0;
+    // The last m_historyLimit bytes of the stream before the chunk being matched, followed by it.
+    std::vector<char> m_window;
+    size_t m_history = 0;
+    size_t m_historyLimit = 0;
+    // Stream offset of the window's first byte.
+    uint64_t m_windowOffset = 0;
+    // The line number at m_linePosition in the window, moved along as hits come in.
+    size_t m_linePosition = 0;
+    uint64_t m_lineNumber = 1;
+    std::vector<OpenSnippet> m_openSnippets;
+    // Snippets of pages in other encodings, converted to UTF-8.
+    std::string m_snippetText;
+};
@@ -0,0 +1,239 @@
+#include "KeywordSearch.h"
+
+#include "CaseFold.h"
+#include "CompiledMatcher.h"
+#include "Log.h"
+#include "SimdSearch.h"
+
+#include <algorithm>
+#include <atomic>
+
+
+namespace {
+
+    // Encodes literal keywords for the byte-at-a-time engines, which fold ASCII letters only.
+    // Returns false if some keyword has to be matched by the DFA in this encoding instead: it has
+    // a letter outside ASCII, or a character the encoding cannot represent. In UTF-16 every
+    // keyword has to be 7-bit, since the bytes of other characters could be folded as letters.
+    bool EncodeForLiteralEngines(const std::vector<std::string>& keywords, TextEncoding encoding,
+        std::vector<std::string>& encoded)
+    {
+        for (const auto& keyword : keywords) {
+            if (encoding == TextEncoding::Utf8 && IsAscii(keyword)) {
+                encoded.push_back(keyword);
+                continue;
+            }
+            std::string bytes;
+            for (size_t position = 0; position < keyword.size();) {
+                uint32_t codePoint = 0;
+                const bool decoded = DecodeUtf8(keyword, position, codePoint);
+                uint32_t variants[CaseFold::kMaxVariants];
+                if (codePoint >= 0x80
+                    && (CodeUnitSize(encoding) > 1 || (decoded && CaseFold::Variants(codePoint, variants) > 1))) {
+                    return false;
+                }
+                if (!decoded) {
+                    bytes += static_cast<char>(codePoint);
+                }
+                else if (!AppendEncoded(codePoint, encoding, bytes)) {
+                    return false;
+                }
+            }
+            encoded.push_back(std::move(bytes));
+        }
+        return true;
+    }
+
+    bool AllAscii(const std::vector<std::string>& keywords) {
+        return std::all_of(keywords.begin(), keywords.end(), [](const std::string& keyword) { return IsAscii(keyword); });
+    }
+
+}
+
+KeywordSearch::KeywordSearch(const std::vector<std::string>& keywords, MatchMode mode)
+    : KeywordSearch(keywords, mode, TextEncoding::Utf8)
+{
+    m_keywords = keywords;
+    m_mode = mode;
+    m_asciiKeywords = AllAscii(keywords);
+    // No character takes more bytes in Windows-1252 than in UTF-8, and none of the case variants
+    // takes more than two bytes of UTF-16 per byte of UTF-8.
+    m_maxEncodedLength = m_maxKeywordLength;
+    if (mode == MatchMode::Literal) {
+        for (const auto& keyword : keywords) {
+            m_maxEncodedLength = std::max(m_maxEncodedLength, 2 * keyword.size());
+        }
+    }
+}
+
+KeywordSearch::KeywordSearch(const std::vector<std::string>& keywords, MatchMode mode, TextEncoding encoding)
+    : m_encoding(encoding)
+    , m_keywordCount(keywords.size())
+{
+    std::vector<std::string> encoded;
+    if (mode != MatchMode::Literal || !EncodeForLiteralEngines(keywords, encoding, encoded)) {
+        m_patterns = std::make_unique<PatternSearch>(keywords, mode, encoding);
+        m_maxKeywordLength = m_patterns->MaxMatchLength();
+        m_maxEncodedLength = m_maxKeywordLength;
+        return;
+    }
+
+    InitLiteral(encoded);
+    m_maxEncodedLength = m_maxKeywordLength;
+}
+
+void KeywordSearch::InitLiteral(const std::vector<std::string>& keywords)
+{
+    for (const auto& keyword : keywords) {
+        m_maxKeywordLength = std::max(m_maxKeywordLength, keyword.size());
+        m_keywordLengths.push_back(keyword.size());
+    }
+
+    if (keywords.size() > kSmallSetLimit) {
+        if (CompiledMatcher::Matches(keywords, m_compiledSlots)) {
+            m_compiledIn = true;
+            return;
+        }
+        m_automaton = std::make_unique<AhoCorasick>(keywords);
+        return;
+    }
+
+    // The SIMD kernel expects lowercase needles, so fold them once here.
+    for (const auto& keyword : keywords) {
+        std::string folded = keyword;
+        for (char& c : folded) {
+            c = static_cast<char>(CaseFold::Fold(static_cast<unsigned char>(c)));
+        }
+        m_foldedKeywords.push_back(std::move(folded));
+    }
+}
+
+void KeywordSearch::Scan(const char* data, size_t size, KeywordHits& hits) const
+{
+    if (m_compiledIn) {
+        CompiledMatcher::Scan(data, size, m_compiledSlots, hits);
+        return;
+    }
+
+    if (m_automaton) {
+        m_automaton->Scan(AhoCorasick::kInitialState, data, size, hits);
+        return;
+    }
+
+    if (m_patterns) {
+        m_patterns->Scan(data, size, hits);
+        return;
+    }
+
+    for (size_t keywordIndex = 0; keywordIndex < m_foldedKeywords.size(); ++keywordIndex) {
+        if (hits.Found(keywordIndex)) {
+            continue;
+        }
+        const std::string& keyword = m_foldedKeywords[keywordIndex];
+        if (SimdSearch::FindFolded(data, size, keyword.data(), keyword.size()) != SimdSearch::npos) {
+            hits.Mark(keywordIndex);
+        }
+    }
+}
+
+void KeywordSearch::FindAll(const char* data, size_t size, const MatchFound& found) const
+{
+    if (m_compiledIn) {
+        CompiledMatcher::FindAll(data, size, m_compiledSlots, found);
+        return;
+    }
+
+    if (m_automaton) {
+        m_automaton->FindAll(AhoCorasick::kInitialState, data, size, found);
+        return;
+    }
+
+    // Merge the keywords' occurrences, each searched for on its own, into one run by end offset.
+    size_t starts[kSmallSetLimit];
+    for (size_t keywordIndex = 0; keywordIndex < m_foldedKeywords.size(); ++keywordIndex) {
+        const std::string& keyword = m_foldedKeywords[keywordIndex];
+        starts[keywordIndex] = keyword.empty() ? SimdSearch::npos
+            : SimdSearch::FindFolded(data, size, keyword.data(), keyword.size());
+    }
+    for (;;) {
+        size_t next = SimdSearch::npos;
+        size_t nextEnd = SimdSearch::npos;
+        for (size_t keywordIndex = 0; keywordIndex < m_foldedKeywords.size(); ++keywordIndex) {
+            if (starts[keywordIndex] != SimdSearch::npos && starts[keywordIndex] + m_keywordLengths[keywordIndex] < nextEnd) {
+                next = keywordIndex;
+                nextEnd = starts[keywordIndex] + m_keywordLengths[keywordIndex];
+            }
+        }
+        if (next == SimdSearch::npos) {
+            return;
+        }
+        found(next, nextEnd);
+
+        const std::string& keyword = m_foldedKeywords[next];
+        const size_t from = starts[next] + 1;
+        const size_t offset = SimdSearch::FindFolded(data + from, size - from, keyword.data(), keyword.size());
+        starts[next] = offset == SimdSearch::npos ? SimdSearch::npos : from + offset;
+    }
+}
+
+const KeywordSearch& KeywordSearch::ForEncoding(TextEncoding encoding) const
+{
+    // 7-bit keywords read the same in every ASCII-compatible encoding.
+    size_t slot = 0;
+    switch (encoding) {
+    case TextEncoding::Windows1252:
+        if (m_asciiKeywords) {
+            return *this;
+        }
+        slot = 0;
+        break;
+    case TextEncoding::Utf16LE:
+    case TextEncoding::Utf16BE:
+        if (m_mode != MatchMode::Literal) {
+            // Byte for byte, a pattern never matches UTF-16 text, so say so, once.
+            static std::atomic<bool> warned{ false };
+            if (!warned.exchange(true)) {
+                LogLine(LogLevel::Warning) << "Warning: /match " << MatchModeName(m_mode)
+                    << " keywords cannot match UTF-16 pages, so nothing is found in them.";
+            }
+            return *this;
+        }
+        slot = encoding == TextEncoding::Utf16LE ? 1 : 2;
+        break;
+    default:
+        return *this;
+    }
+    // Only the search built from the command line has the keywords to build the others from.
+    if (m_encoding != TextEncoding::Utf8) {
+        return *this;
+    }
+    EncodedSearch& encoded = m_encodedSearches[slot];
+    std::call_once(encoded.built, [&] { encoded.search.reset(new KeywordSearch(m_keywords, m_mode, encoding)); });
+    return *encoded.search;
+}
+
+size_t KeywordSearch::MatchStart(size_t keywordIndex, const char* data, size_t end) const
+{
+    if (m_patterns) {
+        return m_patterns->MatchStart(keywordIndex, data, end);
+    }
+    return end - std::min(end, m_keywordLengths[keywordIndex]);
+}
+
+std::string KeywordSearch::EngineName() const
+{
+    std::string name;
+    if (m_compiledIn) {
+        name = "Compiled-in automaton (" + std::to_string(CompiledMatcher::StateCount()) + " states)";
+    }
+    else if (m_automaton) {
+        name = "Aho-Corasick";
+    }
+    else if (m_patterns) {
+        name = "Lazy DFA over " + std::to_string(m_patterns->NfaStateCount()) + " NFA states";
+    }
+    else {
+        name = std::string("SIMD substring search (") + SimdSearch::KernelName() + ")";
+    }
+    return name;
+}
@@ -0,0 +1,108 @@
+// Chooses the search engine for a keyword set.
+// A handful of keywords is searched with the SIMD substring kernel, one keyword at a time;
+// larger sets go through the Aho-Corasick automaton, which costs the same per byte no matter
+// how many keywords there are. When the set is the keyword list compiled into the binary, its
+// specialized automaton takes the place of the one built at runtime. Wildcard and regular
+// expression keywords are all matched by one lazily built DFA.
+//
+// Keywords are UTF-8, and a search is built for text in one encoding; ForEncoding finds the
+// search for others, built from the same keywords the first time a page in that encoding turns
+// up, so a corpus without such pages pays nothing for them. While every keyword is 7-bit, the
+// UTF-8 and Windows-1252 searches are one and the same and UTF-16 text goes through the same
+// engines with the keywords widened. Letters outside ASCII have case variants that byte-at-a-time
+// folding cannot produce, so keywords with such letters are all matched by the DFA instead.
+
+#pragma once
+
+#include "AhoCorasick.h"
+#include "KeywordHits.h"
+#include "PatternSearch.h"
+#include "TextEncoding.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+class KeywordSearch {
+public:
+    // Keyword sets up to this size use the SIMD kernel.
+    static constexpr size_t kSmallSetLimit = 3;
+
+    // Keywords other than MatchMode::Literal ones must have passed PatternSearch::Check.
+    explicit KeywordSearch(const std::vector<std::string>& keywords, MatchMode mode = MatchMode::Literal);
+
+    // The search for text in encoding. Patterns are only ever searched for in ASCII-compatible
+    // encodings, so UTF-16 text gets this same search for them and is matched byte for byte, which
+    // finds nothing; the first UTF-16 page logs a warning.
+    // Safe to call from any number of threads at once.
+    const KeywordSearch& ForEncoding(TextEncoding encoding) const;
+
+    // 2 for a search of UTF-16 text, whose matches only count when they start at an even offset
+    // into the file; otherwise 1.
+    size_t CodeUnitSize() const { return ::CodeUnitSize(m_encoding); }
+
+    // The encoding of the text the search is for.
+    TextEncoding Encoding() const { return m_encoding; }
+
+    // Marks every keyword contained in the text. Keywords already marked in hits are skipped.
+    // Matches are only found inside the given text; callers feeding a file in several buffers
+    // must overlap consecutive buffers by MaxKeywordLength() - 1 bytes.
+    void Scan(const char* data, size_t size, KeywordHits& hits) const;
+
+    // Reports every match of a literal keyword inside the text to found, in the order they end,
+    // with the same overlap rule as Scan. Patterns are found through Patterns()->FindAll instead.
+    void FindAll(const char* data, size_t size, const MatchFound& found) const;
+
+    // Where the match of a keyword that ends at offset end of data starts; see PatternSearch::MatchStart.
+    size_t MatchStart(size_t keywordIndex, const char* data, size_t end) const;
+
+    size_t KeywordCount() const { return m_keywordCount; }
+
+    // The overlap callers need between buffers is one byte less than this. For patterns it is the
+    // longest text a pattern needs to be found, and 0 if that has no limit; such keywords can only
+    // be matched by feeding a file in order through the pattern engine's cursor.
+    size_t MaxKeywordLength() const { return m_maxKeywordLength; }
+
+    // At least MaxKeywordLength() of the search for any encoding, without building those searches.
+    size_t MaxEncodedLength() const { return m_maxEncodedLength; }
+
+    // The pattern engine, or null for literal keywords.
+    const PatternSearch* Patterns() const { return m_patterns.get(); }
+
+    // False if some pattern can need text of any length, so buffers cannot be matched independently.
+    bool BoundedMatches() const { return !m_patterns || m_maxKeywordLength != 0; }
+
+    // Describes the engine in use, for diagnostics.
+    std::string EngineName() const;
+
+private:
+    KeywordSearch(const std::vector<std::string>& keywords, MatchMode mode, TextEncoding encoding);
+    void InitLiteral(const std::vector<std::string>& keywords);
+
+    TextEncoding m_encoding;
+    size_t m_keywordCount = 0;
+    size_t m_maxKeywordLength = 0;
+    size_t m_maxEncodedLength = 0;
+    std::vector<size_t> m_keywordLengths;
+
+    // Exactly one of the four engines is set.
+    bool m_compiledIn = false;
+    std::unique_ptr<PatternSearch> m_patterns;
+    std::vector<size_t> m_compiledSlots;
+    std::unique_ptr<AhoCorasick> m_automaton;
+    std::vector<std::string> m_foldedKeywords;
+
+    // What the searches for other encodings are built from, and those searches once built:
+    // Windows-1252, UTF-16LE and UTF-16BE, in that order.
+    std::vector<std::string> m_keywords;
+    MatchMode m_mode = MatchMode::Literal;
+    bool m_asciiKeywords = true;
+    struct EncodedSearch {
+        std::once_flag built;
+        std::unique_ptr<KeywordSearch> search;
+    };
+    mutable EncodedSearch m_encodedSearches[3];
+};
@@ -0,0 +1,85 @@
+#include "LiveResults.h"
+
+
+void LiveResults::Set(const std::filesystem::path& filePath, const KeywordHits& hits)
+{
+    const auto slot = m_slots.find(filePath.native());
+    if (hits.FoundCount() == 0) {
+        if (slot != m_slots.end()) {
+            Drop(slot->second);
+            CompactIfSparse();
+        }
+        return;
+    }
+
+    if (slot != m_slots.end()) {
+        m_entries[slot->second].hits = hits;
+        return;
+    }
+    m_slots.emplace(filePath.native(), m_entries.size());
+    m_entries.push_back({ filePath.native(), hits, true });
+}
+
+void LiveResults::Remove(const std::filesystem::path& path)
+{
+    const auto slot = m_slots.find(path.native());
+    if (slot != m_slots.end()) {
+        Drop(slot->second);
+        CompactIfSparse();
+        return;
+    }
+
+    // Not a file with hits, so possibly a directory holding some.
+    std::filesystem::path::string_type prefix = path.native();
+    prefix += std::filesystem::path::preferred_separator;
+    for (size_t index = 0; index < m_entries.size(); ++index) {
+        const Entry& entry = m_entries[index];
+        if (entry.live && entry.path.compare(0, prefix.size(), prefix) == 0) {
+            Drop(index);
+        }
+    }
+    CompactIfSparse();
+}
+
+void LiveResults::Clear()
+{
+    m_entries.clear();
+    m_slots.clear();
+}
+
+void LiveResults::Collect(PathTable& paths, std::vector<std::vector<FileId>>& filesByKeyword) const
+{
+    for (const Entry& entry : m_entries) {
+        if (!entry.live) {
+            continue;
+        }
+        const FileId fileId = paths.Add(entry.path);
+        entry.hits.ForEach([&](size_t keywordIndex) { filesByKeyword[keywordIndex].push_back(fileId); });
+    }
+}
+
+void LiveResults::Drop(size_t index)
+{
+    Entry& entry = m_entries[index];
+    m_slots.erase(entry.path);
+    entry.live = false;
+}
+
+void LiveResults::CompactIfSparse()
+{
+    // Compact once most entries are dead, keeping the order of the live ones.
+    if (m_slots.size() * 2 >= m_entries.size()) {
+        return;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        if (m_entries[i].live) {
+            m_slots[m_entries[i].path] = kept;
+            if (kept != i) {
+                m_entries[kept] = std::move(m_entries[i]);
+            }
+            ++kept;
+        }
+    }
+    m_entries.resize(kept);
+}
@@ -0,0 +1,48 @@
+// Scan results kept in memory and updated one file at a time, for /watch.
+// Only files with at least one hit are held. Files keep the position they were first recorded at,
+// so the report lists the files found by the initial scan in walk order, followed by files that
+// started matching later in the order they did.
+
+#pragma once
+
+#include "KeywordHits.h"
+#include "PathTable.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+
+class LiveResults {
+public:
+    // Records the hits of a file, replacing what was recorded for it before. A file without any
+    // hits is dropped.
+    void Set(const std::filesystem::path& filePath, const KeywordHits& hits);
+
+    // Drops the file at path, or every file below path if it is a directory.
+    void Remove(const std::filesystem::path& path);
+
+    void Clear();
+
+    // Number of files with hits.
+    size_t Size() const { return m_slots.size(); }
+
+    // Adds the files to paths and fills filesByKeyword, which has one list per keyword, in the form
+    // the report writers take.
+    void Collect(PathTable& paths, std::vector<std::vector<FileId>>& filesByKeyword) const;
+
+private:
+    struct Entry {
+        std::filesystem::path::string_type path;
+        KeywordHits hits;
+        bool live = false;
+    };
+
+    void Drop(size_t index);
+    void CompactIfSparse();
+
+    std::vector<Entry> m_entries;
+    // Index into m_entries of every live entry, by path.
+    std::unordered_map<std::filesystem::path::string_type, size_t> m_slots;
+};
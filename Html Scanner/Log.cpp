@@ -0,0 +1,95 @@
+#include "Log.h"
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+
+namespace {
+    constexpr size_t kFlushBytes = 64 * 1024;
+
+    std::atomic<LogLevel> currentLevel{ LogLevel::Info };
+
+    // Each thread formats into its own stream, which is reused from one line to the next.
+    thread_local std::ostringstream lineText;
+
+    class LogSink {
+    public:
+        ~LogSink() {
+            Flush();
+        }
+
+        void Write(LogLevel level, const std::string& line) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (level <= LogLevel::Warning) {
+                // Keep the order the lines were logged in, then show the problem at once.
+                FlushLocked();
+                std::fwrite(line.data(), 1, line.size(), stderr);
+                std::fputc('\n', stderr);
+                std::fflush(stderr);
+                return;
+            }
+
+            m_buffer += line;
+            m_buffer += '\n';
+            if (m_buffer.size() >= kFlushBytes) {
+                FlushLocked();
+            }
+        }
+
+        void Flush() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            FlushLocked();
+        }
+
+    private:
+        void FlushLocked() {
+            if (!m_buffer.empty()) {
+                std::fwrite(m_buffer.data(), 1, m_buffer.size(), stdout);
+                std::fflush(stdout);
+                m_buffer.clear();
+            }
+        }
+
+        std::mutex m_mutex;
+        std::string m_buffer;
+    };
+
+    LogSink& Sink() {
+        static LogSink sink;
+        return sink;
+    }
+}
+
+void SetLogLevel(LogLevel level)
+{
+    currentLevel.store(level, std::memory_order_relaxed);
+}
+
+bool LogEnabled(LogLevel level)
+{
+    return level <= currentLevel.load(std::memory_order_relaxed);
+}
+
+void FlushLog()
+{
+    Sink().Flush();
+}
+
+LogLine::LogLine(LogLevel level)
+    : m_level(level)
+    , m_text(LogEnabled(level) ? &lineText : nullptr)
+{
+    if (m_text != nullptr) {
+        m_text->str(std::string());
+        m_text->clear();
+    }
+}
+
+LogLine::~LogLine()
+{
+    if (m_text != nullptr) {
+        Sink().Write(m_level, m_text->str());
+    }
+}
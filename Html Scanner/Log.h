@@ -0,0 +1,53 @@
+// Leveled, buffered console logging.
+// Lines are collected in memory and written to stdout in large chunks instead of being flushed one
+// at a time with std::endl, which on a console or a pipe costs more than scanning a small file.
+// Warnings and errors go to stderr right away, after whatever stdout output precedes them.
+// Safe to use from several threads; every line comes out whole.
+
+#pragma once
+
+#include <sstream>
+
+
+enum class LogLevel {
+    Error,
+    Warning,
+    // Progress and results: the header, every hit, the summary. Hidden by /q.
+    Info,
+    // Diagnostics such as every file opened. Shown with /v.
+    Debug,
+};
+
+// Lines above this level are dropped. Defaults to LogLevel::Info.
+void SetLogLevel(LogLevel level);
+bool LogEnabled(LogLevel level);
+
+// Writes everything buffered so far.
+void FlushLog();
+
+// Builds one log line with operator<< and hands it to the sink when it goes out of scope:
+//
+//     LogLine(LogLevel::Info) << "Found \"" << keyword << "\" in: " << path;
+//
+// When the level is disabled nothing is formatted at all. The line break is added by the sink.
+class LogLine {
+public:
+    explicit LogLine(LogLevel level);
+    ~LogLine();
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    template <typename T>
+    LogLine& operator<<(const T& value) {
+        if (m_text != nullptr) {
+            *m_text << value;
+        }
+        return *this;
+    }
+
+private:
+    const LogLevel m_level;
+    // The calling thread's formatting buffer, or null if the level is disabled.
+    std::ostringstream* m_text;
+};
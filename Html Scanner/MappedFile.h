@@ -0,0 +1,36 @@
+// Read-only memory mapping of a whole file.
+// Uses CreateFileMapping/MapViewOfFile on Windows and mmap everywhere else, so the matcher
+// can run straight over the page cache without copying the contents into std::strings.
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps the file into memory, replacing any previous mapping.
+    // Returns false if the file could not be opened or mapped; callers should fall back to reading it.
+    bool Open(const std::filesystem::path& filePath);
+
+    void Close();
+
+    const char* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+
+#ifdef _WIN32
+    void* m_fileHandle = nullptr;
+    void* m_mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,115 @@
+#include "MatchPositions.h"
+
+#include <algorithm>
+#include <fstream>
+#include <tuple>
+
+
+namespace {
+
+    void AppendEscaped(std::string& out, std::string_view text) {
+        static const char kHexDigits[] = "0123456789abcdef";
+        for (char c : text) {
+            const unsigned char byte = static_cast<unsigned char>(c);
+            switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '\t': out += "\\t"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            default:
+                if (byte < 0x20 || byte == 0x7f) {
+                    out += "\\x";
+                    out += kHexDigits[byte >> 4];
+                    out += kHexDigits[byte & 0xf];
+                }
+                else {
+                    out += c;
+                }
+                break;
+            }
+        }
+    }
+
+}
+
+void PositionLog::Add(size_t keywordIndex, uint64_t offset, uint64_t line, const char* snippet, size_t snippetLength)
+{
+    if (FileFull()) {
+        return;
+    }
+    Entry entry;
+    entry.keywordIndex = static_cast<uint32_t>(keywordIndex);
+    entry.offset = offset;
+    entry.line = line;
+    entry.snippetOffset = m_snippets.size();
+    entry.snippetLength = static_cast<uint32_t>(snippetLength);
+    m_snippets.append(snippet, snippetLength);
+    m_entries.push_back(entry);
+}
+
+void PositionLog::EndFile(FileId fileId)
+{
+    for (size_t i = m_fileStart; i < m_entries.size(); ++i) {
+        m_entries[i].fileId = fileId;
+    }
+    m_fileStart = m_entries.size();
+    m_fileSnippetStart = m_snippets.size();
+}
+
+void PositionLog::DiscardFile()
+{
+    m_entries.resize(m_fileStart);
+    m_snippets.resize(m_fileSnippetStart);
+}
+
+bool WritePositions(const std::filesystem::path& outputPath, const std::vector<PositionLog>& logs,
+    const PathTable& paths, const std::vector<std::string>& keywords)
+{
+    std::ofstream stream(outputPath, std::ios::binary | std::ios::trunc);
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    struct Ref {
+        const PositionLog* log;
+        const PositionLog::Entry* entry;
+    };
+    std::vector<Ref> refs;
+    for (const auto& log : logs) {
+        for (const auto& entry : log.Entries()) {
+            refs.push_back({ &log, &entry });
+        }
+    }
+    std::sort(refs.begin(), refs.end(), [](const Ref& a, const Ref& b) {
+        return std::tie(a.entry->fileId, a.entry->offset, a.entry->keywordIndex)
+            < std::tie(b.entry->fileId, b.entry->offset, b.entry->keywordIndex);
+    });
+
+    std::string buffer;
+    FileId pathId = 0;
+    std::string path;
+    for (size_t i = 0; i < refs.size(); ++i) {
+        const PositionLog::Entry& entry = *refs[i].entry;
+        if (path.empty() || entry.fileId != pathId) {
+            pathId = entry.fileId;
+            path = paths.String(pathId);
+        }
+        buffer += keywords[entry.keywordIndex];
+        buffer += '\t';
+        buffer += path;
+        buffer += '\t';
+        buffer += std::to_string(entry.line);
+        buffer += '\t';
+        buffer += std::to_string(entry.offset);
+        buffer += '\t';
+        AppendEscaped(buffer, refs[i].log->Snippet(entry));
+        buffer += '\n';
+        if (buffer.size() >= 64 * 1024) {
+            stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+    }
+    stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    stream.close();
+    return !stream.fail();
+}
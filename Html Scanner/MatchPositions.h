@@ -0,0 +1,78 @@
+// Where each hit is in its file, for /positions.
+// Every worker keeps its own log: entries are small fixed-size records, and the snippets of text
+// around the hits are appended to one arena string, so recording a hit takes no lock and allocates
+// only when the arena grows. The number of hits recorded per file is capped, which bounds the
+// memory a page full of matches can take; the keyword still counts as found either way.
+
+#pragma once
+
+#include "PathTable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+class PositionLog {
+public:
+    struct Entry {
+        FileId fileId = 0;
+        uint32_t keywordIndex = 0;
+        // Offset of the match's first byte from the start of the file, as the matcher saw it.
+        uint64_t offset = 0;
+        // 1-based line the match starts on.
+        uint64_t line = 0;
+        size_t snippetOffset = 0;
+        uint32_t snippetLength = 0;
+    };
+
+    static constexpr size_t kDefaultContextBytes = 32;
+    static constexpr size_t kDefaultMaxPerFile = 100;
+
+    // Snippets take up to contextBytes of text on either side of a match, within its line, and at
+    // most maxPerFile hits are recorded for a file.
+    explicit PositionLog(size_t contextBytes = kDefaultContextBytes, size_t maxPerFile = kDefaultMaxPerFile)
+        : m_contextBytes(contextBytes), m_maxPerFile(maxPerFile) {}
+
+    size_t ContextBytes() const { return m_contextBytes; }
+    size_t MaxPerFile() const { return m_maxPerFile; }
+
+    // True once the file being scanned has used up its hit budget.
+    bool FileFull() const { return m_entries.size() - m_fileStart >= m_maxPerFile; }
+
+    // Records a hit in the file being scanned. Ignored once FileFull().
+    void Add(size_t keywordIndex, uint64_t offset, uint64_t line, const char* snippet, size_t snippetLength);
+
+    // Assigns the hits recorded since the previous file to fileId.
+    void EndFile(FileId fileId);
+
+    // Drops the hits recorded since the previous file, for a file that could not be scanned.
+    void DiscardFile();
+
+    const std::vector<Entry>& Entries() const { return m_entries; }
+
+    // Bytes taken by the hits recorded so far, for the /maxmem budget.
+    size_t MemoryBytes() const { return m_entries.size() * sizeof(Entry) + m_snippets.size(); }
+
+    std::string_view Snippet(const Entry& entry) const {
+        return std::string_view(m_snippets).substr(entry.snippetOffset, entry.snippetLength);
+    }
+
+private:
+    size_t m_contextBytes;
+    size_t m_maxPerFile;
+    std::vector<Entry> m_entries;
+    // Where the file being scanned starts in m_entries and m_snippets.
+    size_t m_fileStart = 0;
+    size_t m_fileSnippetStart = 0;
+    std::string m_snippets;
+};
+
+// Writes the hits of every log as "keyword<TAB>path<TAB>line<TAB>offset<TAB>snippet" lines, ordered
+// by file, then offset, then keyword. Tabs, line breaks, backslashes and other control bytes in
+// snippets are written as escapes. Returns false if the file cannot be opened or written.
+bool WritePositions(const std::filesystem::path& outputPath, const std::vector<PositionLog>& logs,
+    const PathTable& paths, const std::vector<std::string>& keywords);
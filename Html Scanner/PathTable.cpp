@@ -0,0 +1,39 @@
+#include "PathTable.h"
+
+#include <algorithm>
+
+
+FileId PathTable::Add(const std::filesystem::path& filePath)
+{
+    const auto& native = filePath.native();
+    const size_t length = native.size();
+
+    CharType* destination = nullptr;
+    if (length > kBlockChars) {
+        // Paths longer than a whole block get an allocation of their own.
+        m_oversized.push_back(std::make_unique<CharType[]>(length));
+        m_oversizedBytes += length * sizeof(CharType);
+        destination = m_oversized.back().get();
+    }
+    else {
+        if (m_blocks.empty() || m_blockUsed + length > kBlockChars) {
+            m_blocks.push_back(std::make_unique<CharType[]>(kBlockChars));
+            m_blockUsed = 0;
+        }
+        destination = m_blocks.back().get() + m_blockUsed;
+        m_blockUsed += length;
+    }
+
+    std::copy(native.begin(), native.end(), destination);
+    m_entries.emplace_back(destination, length);
+    return static_cast<FileId>(m_entries.size() - 1);
+}
+
+std::string PathTable::String(FileId fileId) const
+{
+#ifdef _WIN32
+    return Path(fileId).string();
+#else
+    return std::string(NativeView(fileId));
+#endif
+}
@@ -0,0 +1,49 @@
+// Arena-backed table of interned file paths.
+// Every path is stored once, in large shared blocks, and referred to everywhere else by a
+// 32-bit file ID. Paths are kept in the platform's native encoding so no information is lost
+// on the way from the directory walk to the output.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+using FileId = uint32_t;
+
+class PathTable {
+public:
+    using CharType = std::filesystem::path::value_type;
+    using View = std::basic_string_view<CharType>;
+
+    // Copies the path into the arena and returns its ID. IDs are handed out densely from zero,
+    // in the order paths are added. Not thread-safe; add all paths before sharing the table.
+    FileId Add(const std::filesystem::path& filePath);
+
+    // The stored path in native encoding. Valid for the lifetime of the table.
+    View NativeView(FileId fileId) const { return m_entries[fileId]; }
+
+    std::filesystem::path Path(FileId fileId) const { return std::filesystem::path(NativeView(fileId)); }
+
+    // The path converted the same way std::filesystem::path::string() does, for output.
+    std::string String(FileId fileId) const;
+
+    size_t Size() const { return m_entries.size(); }
+
+    // Bytes held by the arena blocks, for diagnostics.
+    size_t ArenaBytes() const { return m_blocks.size() * kBlockChars * sizeof(CharType) + m_oversizedBytes; }
+
+private:
+    static constexpr size_t kBlockChars = 256 * 1024;
+
+    std::vector<std::unique_ptr<CharType[]>> m_blocks;
+    size_t m_blockUsed = 0;
+    std::vector<std::unique_ptr<CharType[]>> m_oversized;
+    size_t m_oversizedBytes = 0;
+    std::vector<View> m_entries;
+};
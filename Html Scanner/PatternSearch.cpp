@@ -0,0 +1,1154 @@
+#include "PatternSearch.h"
+
+#include "CaseFold.h"
+#include "HtmlScope.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <unordered_map>
+
+
+namespace {
+
+    constexpr int kUnbounded = -1;
+
+    // Bounds that keep a single pattern from compiling into an unreasonably large NFA.
+    constexpr int kMaxRepeatCount = 1000;
+    constexpr size_t kMaxNfaStates = 1 << 16;
+    constexpr int kMaxNesting = 100;
+    constexpr uint32_t kMaxClassRange = 1024;
+
+    // A thread's DFA is dropped and rebuilt from scratch once it reaches this many states, so
+    // patterns whose DFA would blow up still only cost bounded memory.
+    constexpr size_t kMaxDfaStates = 10000;
+
+    constexpr int32_t kUnknownTransition = -1;
+
+    std::atomic<uint64_t> nextSearchId{ 1 };
+
+    size_t SaturatingAdd(size_t a, size_t b) {
+        return a > std::numeric_limits<size_t>::max() - b ? std::numeric_limits<size_t>::max() : a + b;
+    }
+
+    size_t SaturatingMultiply(size_t a, size_t b) {
+        return a != 0 && b > std::numeric_limits<size_t>::max() / a ? std::numeric_limits<size_t>::max() : a * b;
+    }
+
+    // Adds a byte and, for letters, the other case.
+    void AddFolded(std::bitset<256>& bytes, unsigned char c) {
+        bytes.set(c);
+        if (c >= 'a' && c <= 'z') {
+            bytes.set(c - ('a' - 'A'));
+        }
+        else if (c >= 'A' && c <= 'Z') {
+            bytes.set(c + ('a' - 'A'));
+        }
+    }
+
+    std::bitset<256> AnyButLineBreak() {
+        std::bitset<256> bytes;
+        bytes.set();
+        bytes.reset('\n');
+        return bytes;
+    }
+
+}
+
+bool ParseMatchMode(const std::string& name, MatchMode& mode)
+{
+    if (name == "literal") {
+        mode = MatchMode::Literal;
+    }
+    else if (name == "wildcard") {
+        mode = MatchMode::Wildcard;
+    }
+    else if (name == "regex") {
+        mode = MatchMode::Regex;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+const char* MatchModeName(MatchMode mode)
+{
+    switch (mode) {
+    case MatchMode::Wildcard: return "wildcard";
+    case MatchMode::Regex: return "regex";
+    default: return "literal";
+    }
+}
+
+// Parsed form of a pattern.
+struct PatternSearch::Node {
+    enum class Kind {
+        // Matches the empty text.
+        Empty,
+        // Matches one byte of bytes.
+        Byte,
+        // Matches the children one after another.
+        Concat,
+        // Matches any one of the children.
+        Alternate,
+        // Matches children[0] between min and max times; max may be kUnbounded.
+        Repeat,
+    };
+
+    Kind kind = Kind::Empty;
+    std::bitset<256> bytes;
+    std::vector<Node> children;
+    int min = 0;
+    int max = 0;
+
+    static Node Byte(const std::bitset<256>& bytes) {
+        Node node;
+        node.kind = Kind::Byte;
+        // Dropped markup leaves a separator behind that nothing may match across.
+        node.bytes = bytes;
+        node.bytes.reset(static_cast<unsigned char>(HtmlScopeFilter::kSeparator));
+        return node;
+    }
+
+    // Matches exactly c. UTF-16 text is never scope filtered, and its characters have zero bytes.
+    static Node Exact(unsigned char c) {
+        Node node;
+        node.kind = Kind::Byte;
+        node.bytes.set(c);
+        return node;
+    }
+
+    static Node Repeat(Node child, int min, int max) {
+        Node node;
+        node.kind = Kind::Repeat;
+        node.children.push_back(std::move(child));
+        node.min = min;
+        node.max = max;
+        return node;
+    }
+
+    bool Nullable() const {
+        switch (kind) {
+        case Kind::Empty:
+            return true;
+        case Kind::Byte:
+            return false;
+        case Kind::Concat:
+            return std::all_of(children.begin(), children.end(), [](const Node& child) { return child.Nullable(); });
+        case Kind::Alternate:
+            return std::any_of(children.begin(), children.end(), [](const Node& child) { return child.Nullable(); });
+        case Kind::Repeat:
+            return min == 0 || children[0].Nullable();
+        }
+        return false;
+    }
+
+    // Length of the longest text the node matches, or SIZE_MAX if there is no limit.
+    size_t MaxLength() const {
+        switch (kind) {
+        case Kind::Empty:
+            return 0;
+        case Kind::Byte:
+            return 1;
+        case Kind::Concat: {
+            size_t length = 0;
+            for (const Node& child : children) {
+                length = SaturatingAdd(length, child.MaxLength());
+            }
+            return length;
+        }
+        case Kind::Alternate: {
+            size_t length = 0;
+            for (const Node& child : children) {
+                length = std::max(length, child.MaxLength());
+            }
+            return length;
+        }
+        case Kind::Repeat: {
+            const size_t childLength = children[0].MaxLength();
+            if (childLength == 0) {
+                return 0;
+            }
+            return max == kUnbounded ? std::numeric_limits<size_t>::max()
+                : SaturatingMultiply(childLength, static_cast<size_t>(max));
+        }
+        }
+        return 0;
+    }
+
+    // Number of NFA states Compile creates for the node, saturating.
+    size_t StateCount() const {
+        switch (kind) {
+        case Kind::Empty:
+            return 0;
+        case Kind::Byte:
+            return 1;
+        case Kind::Concat:
+        case Kind::Alternate: {
+            size_t count = kind == Kind::Alternate ? 1 : 0;
+            for (const Node& child : children) {
+                count = SaturatingAdd(count, child.StateCount());
+            }
+            return count;
+        }
+        case Kind::Repeat: {
+            const size_t copies = static_cast<size_t>(max == kUnbounded ? min + 1 : max);
+            return SaturatingAdd(SaturatingMultiply(SaturatingAdd(children[0].StateCount(), 1), copies), 1);
+        }
+        }
+        return 0;
+    }
+
+    // Only whether a pattern occurs matters, not how much text a match spans. Every match of x+ at
+    // the end of a pattern contains a match with a single x there, and x* at the end can match
+    // nothing at all, so those are cut down to what any match needs, at both ends. This makes
+    // patterns like data-track-* or gallery[0-9]+ bounded, and their DFAs smaller.
+    void TrimForContainment(bool atStart, bool atEnd) {
+        if (!atStart && !atEnd) {
+            return;
+        }
+        switch (kind) {
+        case Kind::Empty:
+        case Kind::Byte:
+            return;
+        case Kind::Alternate:
+            for (Node& child : children) {
+                child.TrimForContainment(atStart, atEnd);
+            }
+            return;
+        case Kind::Repeat:
+            if (min == 0) {
+                *this = Node();
+                return;
+            }
+            if (min == 1) {
+                Node child = std::move(children[0]);
+                *this = std::move(child);
+                TrimForContainment(atStart, atEnd);
+                return;
+            }
+            max = min;
+            return;
+        case Kind::Concat: {
+            if (children.empty()) {
+                return;
+            }
+            // Once a child at an end has been cut down to nothing, the one next to it is at the end.
+            const size_t last = children.size() - 1;
+            size_t first = 0;
+            if (atStart) {
+                for (; first <= last; ++first) {
+                    children[first].TrimForContainment(true, atEnd && first == last);
+                    if (children[first].kind != Kind::Empty) {
+                        break;
+                    }
+                }
+            }
+            if (atEnd) {
+                for (size_t i = last + 1; i-- > first;) {
+                    children[i].TrimForContainment(false, true);
+                    if (children[i].kind != Kind::Empty) {
+                        break;
+                    }
+                }
+            }
+            return;
+        }
+        }
+    }
+
+    // Turns the node into one that matches the reversed texts, for finding where a match starts.
+    void Reverse() {
+        if (kind == Kind::Concat) {
+            std::reverse(children.begin(), children.end());
+        }
+        for (Node& child : children) {
+            child.Reverse();
+        }
+    }
+};
+
+// Recursive descent parser for both pattern syntaxes.
+class PatternSearch::Parser {
+public:
+    Parser(const std::string& pattern, MatchMode mode, TextEncoding encoding)
+        : m_pattern(pattern), m_mode(mode), m_encoding(encoding) {}
+
+    bool Parse(Node& root, std::string& error) {
+        if (m_mode == MatchMode::Literal) {
+            root = ParseLiteral();
+        }
+        else if (m_mode == MatchMode::Wildcard) {
+            root = ParseWildcard();
+        }
+        else {
+            root = ParseAlternation();
+            if (m_error.empty() && m_position < m_pattern.size()) {
+                Fail("unmatched )");
+            }
+        }
+        if (!m_error.empty()) {
+            error = m_error + " at offset " + std::to_string(m_errorPosition);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    Node ParseLiteral() {
+        Node root;
+        root.kind = Node::Kind::Concat;
+        while (m_position < m_pattern.size()) {
+            root.children.push_back(ParseCharacter());
+        }
+        return root;
+    }
+
+    Node ParseWildcard() {
+        Node root;
+        root.kind = Node::Kind::Concat;
+        while (m_position < m_pattern.size()) {
+            const char c = m_pattern[m_position];
+            if (c == '*') {
+                ++m_position;
+                root.children.push_back(Node::Repeat(Node::Byte(AnyButLineBreak()), 0, kUnbounded));
+            }
+            else if (c == '?') {
+                ++m_position;
+                root.children.push_back(ByteClass(AnyButLineBreak()));
+            }
+            else {
+                root.children.push_back(ParseCharacter());
+            }
+        }
+        return root;
+    }
+
+    // Parses the character at the current position into a node for its case variants.
+    Node ParseCharacter() {
+        uint32_t codePoint = 0;
+        if (DecodeUtf8(m_pattern, m_position, codePoint) || CodeUnitSize(m_encoding) > 1) {
+            return CodePoint(codePoint);
+        }
+        // A byte that is not UTF-8 is searched for as it is, as before keywords were decoded.
+        std::bitset<256> bytes;
+        AddFolded(bytes, static_cast<unsigned char>(codePoint));
+        return Node::Byte(bytes);
+    }
+
+    // Matches codePoint or any of its case variants, as encoded in the text.
+    Node CodePoint(uint32_t codePoint) {
+        uint32_t variants[CaseFold::kMaxVariants];
+        const size_t count = CaseFold::Variants(codePoint, variants);
+        Node alternatives;
+        alternatives.kind = Node::Kind::Alternate;
+        // The variants that take one byte share a byte set.
+        std::bitset<256> singleBytes;
+        for (size_t i = 0; i < count; ++i) {
+            std::string encoded;
+            if (!AppendEncoded(variants[i], m_encoding, encoded)) {
+                continue;
+            }
+            if (encoded.size() == 1) {
+                singleBytes.set(static_cast<unsigned char>(encoded[0]));
+                continue;
+            }
+            Node sequence;
+            sequence.kind = Node::Kind::Concat;
+            for (char c : encoded) {
+                sequence.children.push_back(Node::Exact(static_cast<unsigned char>(c)));
+            }
+            alternatives.children.push_back(std::move(sequence));
+        }
+        // A character the encoding cannot represent leaves an empty byte set, which never matches.
+        if (singleBytes.any() || alternatives.children.empty()) {
+            alternatives.children.push_back(Node::Byte(singleBytes));
+        }
+        if (alternatives.children.size() == 1) {
+            Node only = std::move(alternatives.children[0]);
+            return only;
+        }
+        return alternatives;
+    }
+
+    Node ParseAlternation() {
+        Node first = ParseConcat();
+        if (!m_error.empty() || !Peek('|')) {
+            return first;
+        }
+        Node alternation;
+        alternation.kind = Node::Kind::Alternate;
+        alternation.children.push_back(std::move(first));
+        while (m_error.empty() && Peek('|')) {
+            ++m_position;
+            alternation.children.push_back(ParseConcat());
+        }
+        return alternation;
+    }
+
+    Node ParseConcat() {
+        Node concat;
+        concat.kind = Node::Kind::Concat;
+        while (m_error.empty() && m_position < m_pattern.size() && !Peek('|') && !Peek(')')) {
+            concat.children.push_back(ParseRepeat());
+        }
+        return concat;
+    }
+
+    Node ParseRepeat() {
+        Node atom = ParseAtom();
+        while (m_error.empty() && m_position < m_pattern.size()) {
+            const char c = m_pattern[m_position];
+            int min = 0;
+            int max = 0;
+            if (c == '*') {
+                min = 0;
+                max = kUnbounded;
+            }
+            else if (c == '+') {
+                min = 1;
+                max = kUnbounded;
+            }
+            else if (c == '?') {
+                min = 0;
+                max = 1;
+            }
+            else if (c == '{') {
+                if (!ParseCount(min, max)) {
+                    return atom;
+                }
+                atom = Node::Repeat(std::move(atom), min, max);
+                continue;
+            }
+            else {
+                break;
+            }
+            ++m_position;
+            atom = Node::Repeat(std::move(atom), min, max);
+        }
+        return atom;
+    }
+
+    // Parses {m}, {m,} or {m,n} at the current position.
+    bool ParseCount(int& min, int& max) {
+        const size_t start = m_position++;
+        if (!ParseNumber(min)) {
+            return Fail("expected a count after {", start);
+        }
+        max = min;
+        if (Peek(',')) {
+            ++m_position;
+            max = kUnbounded;
+            if (!Peek('}') && !ParseNumber(max)) {
+                return Fail("expected a count or } after ,", start);
+            }
+        }
+        if (!Peek('}')) {
+            return Fail("expected } to close the count", start);
+        }
+        ++m_position;
+        if (min > kMaxRepeatCount || max > kMaxRepeatCount) {
+            return Fail("counts above " + std::to_string(kMaxRepeatCount) + " are not supported", start);
+        }
+        if (max != kUnbounded && max < min) {
+            return Fail("the counts of {m,n} are out of order", start);
+        }
+        return true;
+    }
+
+    bool ParseNumber(int& value) {
+        const size_t start = m_position;
+        value = 0;
+        while (m_position < m_pattern.size() && m_pattern[m_position] >= '0' && m_pattern[m_position] <= '9') {
+            value = std::min(value * 10 + (m_pattern[m_position] - '0'), kMaxRepeatCount + 1);
+            ++m_position;
+        }
+        return m_position > start;
+    }
+
+    Node ParseAtom() {
+        const size_t start = m_position;
+        const unsigned char c = static_cast<unsigned char>(m_pattern[m_position++]);
+        switch (c) {
+        case '(': {
+            if (++m_depth > kMaxNesting) {
+                Fail("groups are nested too deeply", start);
+                return Node();
+            }
+            if (m_pattern.compare(m_position, 2, "?:") == 0) {
+                m_position += 2;
+            }
+            else if (Peek('?')) {
+                Fail("only (?:...) groups are supported", start);
+                return Node();
+            }
+            Node group = ParseAlternation();
+            if (m_error.empty() && !Peek(')')) {
+                Fail("unmatched (", start);
+            }
+            ++m_position;
+            --m_depth;
+            return group;
+        }
+        case '[':
+            return ParseClass(start);
+        case '.':
+            return ByteClass(AnyButLineBreak());
+        case '\\': {
+            std::bitset<256> bytes;
+            ParseEscape(bytes, start);
+            return ByteClass(bytes);
+        }
+        case '^':
+        case '$':
+            Fail("anchors are not supported", start);
+            return Node();
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            Fail("nothing to repeat", start);
+            return Node();
+        default:
+            m_position = start;
+            return ParseCharacter();
+        }
+    }
+
+    // A character of a class, or a byte given as \x or not written in UTF-8.
+    struct ClassCharacter {
+        uint32_t value = 0;
+        bool byte = false;
+        // For an escape that stands for more than one byte, those bytes.
+        std::bitset<256> set;
+    };
+
+    bool ParseClassCharacter(ClassCharacter& character, size_t start) {
+        character = ClassCharacter();
+        const unsigned char c = static_cast<unsigned char>(m_pattern[m_position]);
+        if (c == '\\') {
+            ++m_position;
+            std::bitset<256> escaped;
+            if (!ParseEscape(escaped, start)) {
+                return false;
+            }
+            if (escaped.count() != 1) {
+                character.set = escaped;
+            }
+            else {
+                character.value = static_cast<uint32_t>(FirstByte(escaped));
+                character.byte = true;
+            }
+            return true;
+        }
+        character.byte = !DecodeUtf8(m_pattern, m_position, character.value);
+        return true;
+    }
+
+    // Adds a class member: bytes and ASCII letters to bytes, other characters to codePoints.
+    static void AddMember(uint32_t value, bool byte, std::bitset<256>& bytes, std::vector<uint32_t>& codePoints) {
+        if (byte || value < 0x80) {
+            AddFolded(bytes, static_cast<unsigned char>(value));
+        }
+        else {
+            codePoints.push_back(value);
+        }
+    }
+
+    Node ParseClass(size_t start) {
+        const bool negated = Peek('^');
+        if (negated) {
+            ++m_position;
+        }
+        std::bitset<256> bytes;
+        // Members outside ASCII, each matched with its case variants.
+        std::vector<uint32_t> codePoints;
+        bool first = true;
+        while (m_error.empty()) {
+            if (m_position >= m_pattern.size()) {
+                Fail("unmatched [", start);
+                break;
+            }
+            // A ] right after the opening bracket is a literal one.
+            if (Peek(']') && !first) {
+                ++m_position;
+                break;
+            }
+            first = false;
+
+            const size_t itemStart = m_position;
+            ClassCharacter low;
+            if (!ParseClassCharacter(low, itemStart)) {
+                break;
+            }
+            if (low.set.any()) {
+                bytes |= low.set;
+                continue;
+            }
+            if (!Peek('-') || m_position + 1 >= m_pattern.size() || m_pattern[m_position + 1] == ']') {
+                AddMember(low.value, low.byte, bytes, codePoints);
+                continue;
+            }
+
+            ++m_position;
+            ClassCharacter high;
+            if (!ParseClassCharacter(high, m_position)) {
+                break;
+            }
+            if (high.set.any()) {
+                Fail("a class escape cannot end a range", itemStart);
+                break;
+            }
+            if (high.value < low.value) {
+                Fail("the range is out of order", itemStart);
+                break;
+            }
+            // A range runs over bytes or over characters; ASCII ends go with either.
+            const bool lowCharacter = !low.byte && low.value >= 0x80;
+            const bool highCharacter = !high.byte && high.value >= 0x80;
+            if ((lowCharacter || highCharacter) && ((low.byte && low.value >= 0x80) || (high.byte && high.value >= 0x80))) {
+                Fail("a range cannot run from a byte to a character outside ASCII", itemStart);
+                break;
+            }
+            if (highCharacter && high.value - std::max<uint32_t>(low.value, 0x80) >= kMaxClassRange) {
+                Fail("ranges outside ASCII are limited to " + std::to_string(kMaxClassRange) + " characters", itemStart);
+                break;
+            }
+            for (uint32_t c = low.value; c <= high.value; ++c) {
+                AddMember(c, high.byte, bytes, codePoints);
+            }
+        }
+        if (negated) {
+            if (!codePoints.empty()) {
+                Fail("a negated class cannot hold characters outside ASCII", start);
+                return Node();
+            }
+            // Both cases are already in, so the complement leaves out both as well.
+            bytes.flip();
+            return ByteClass(bytes);
+        }
+        if (codePoints.empty()) {
+            return Node::Byte(bytes);
+        }
+        Node alternatives;
+        alternatives.kind = Node::Kind::Alternate;
+        if (bytes.any()) {
+            alternatives.children.push_back(Node::Byte(bytes));
+        }
+        for (uint32_t codePoint : codePoints) {
+            alternatives.children.push_back(CodePoint(codePoint));
+        }
+        return alternatives;
+    }
+
+    // Matches one byte of bytes. In UTF-8, a set that holds every byte with the high bit set, as
+    // ., negated classes and \W do, matches whole characters outside ASCII instead, so that
+    // caf. finds café. Bytes that cannot start a character still match one at a time.
+    Node ByteClass(const std::bitset<256>& bytes) {
+        if (m_encoding != TextEncoding::Utf8) {
+            return Node::Byte(bytes);
+        }
+        for (int c = 0x80; c < 0x100; ++c) {
+            if (!bytes.test(static_cast<size_t>(c))) {
+                return Node::Byte(bytes);
+            }
+        }
+
+        std::bitset<256> continuation;
+        for (int c = 0x80; c < 0xc0; ++c) {
+            continuation.set(static_cast<size_t>(c));
+        }
+        Node alternatives;
+        alternatives.kind = Node::Kind::Alternate;
+        std::bitset<256> singleBytes = bytes;
+        const struct {
+            int firstLead;
+            int lastLead;
+            size_t length;
+        } kSequences[] = { { 0xc2, 0xdf, 2 }, { 0xe0, 0xef, 3 }, { 0xf0, 0xf4, 4 } };
+        for (const auto& sequence : kSequences) {
+            std::bitset<256> leads;
+            for (int c = sequence.firstLead; c <= sequence.lastLead; ++c) {
+                leads.set(static_cast<size_t>(c));
+                singleBytes.reset(static_cast<size_t>(c));
+            }
+            Node characters;
+            characters.kind = Node::Kind::Concat;
+            characters.children.push_back(Node::Byte(leads));
+            for (size_t i = 1; i < sequence.length; ++i) {
+                characters.children.push_back(Node::Byte(continuation));
+            }
+            alternatives.children.push_back(std::move(characters));
+        }
+        alternatives.children.push_back(Node::Byte(singleBytes));
+        return alternatives;
+    }
+
+    // Parses the escape after a backslash into bytes.
+    bool ParseEscape(std::bitset<256>& bytes, size_t start) {
+        if (m_position >= m_pattern.size()) {
+            return Fail("the pattern ends with a backslash", start);
+        }
+        const unsigned char c = static_cast<unsigned char>(m_pattern[m_position++]);
+        switch (c) {
+        case 'd':
+        case 'D':
+            for (int d = '0'; d <= '9'; ++d) {
+                bytes.set(d);
+            }
+            break;
+        case 'w':
+        case 'W':
+            for (int l = 'a'; l <= 'z'; ++l) {
+                AddFolded(bytes, static_cast<unsigned char>(l));
+            }
+            for (int d = '0'; d <= '9'; ++d) {
+                bytes.set(d);
+            }
+            bytes.set('_');
+            break;
+        case 's':
+        case 'S':
+            for (unsigned char space : { ' ', '\t', '\n', '\r', '\f', '\v' }) {
+                bytes.set(space);
+            }
+            break;
+        case 't': bytes.set('\t'); return true;
+        case 'n': bytes.set('\n'); return true;
+        case 'r': bytes.set('\r'); return true;
+        case 'f': bytes.set('\f'); return true;
+        case 'v': bytes.set('\v'); return true;
+        case 'x': {
+            int value = 0;
+            for (int digit = 0; digit < 2; ++digit) {
+                const int nibble = m_position < m_pattern.size() ? HexValue(m_pattern[m_position]) : -1;
+                if (nibble < 0) {
+                    return Fail("\\x needs two hex digits", start);
+                }
+                value = value * 16 + nibble;
+                ++m_position;
+            }
+            AddFolded(bytes, static_cast<unsigned char>(value));
+            return true;
+        }
+        default:
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+                return Fail(std::string("unknown escape \\") + static_cast<char>(c), start);
+            }
+            // Any other escaped character stands for itself.
+            bytes.set(c);
+            return true;
+        }
+        if (c >= 'A' && c <= 'Z') {
+            bytes.flip();
+        }
+        return true;
+    }
+
+    static int HexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    static size_t FirstByte(const std::bitset<256>& bytes) {
+        size_t c = 0;
+        while (!bytes.test(c)) {
+            ++c;
+        }
+        return c;
+    }
+
+    bool Peek(char c) const {
+        return m_position < m_pattern.size() && m_pattern[m_position] == c;
+    }
+
+    bool Fail(const std::string& message, size_t position = std::string::npos) {
+        if (m_error.empty()) {
+            m_error = message;
+            m_errorPosition = position != std::string::npos ? position : m_position;
+        }
+        return false;
+    }
+
+    const std::string& m_pattern;
+    MatchMode m_mode;
+    TextEncoding m_encoding;
+    size_t m_position = 0;
+    int m_depth = 0;
+    std::string m_error;
+    size_t m_errorPosition = 0;
+};
+
+// A thread's share of the lazily built DFA. Searches are shared by every worker, so each thread
+// grows its own table and the scan never takes a lock. The cache belongs to one search at a time
+// and starts over when a thread moves on to another one.
+struct PatternSearch::DfaCache {
+    uint64_t owner = 0;
+    // Every DFA state is a sorted set of NFA states; ids finds a set's state.
+    std::unordered_map<std::string, int32_t> ids;
+    std::vector<std::vector<int32_t>> sets;
+    // One row of classCount entries per state; kUnknownTransition until the text takes the edge.
+    std::vector<int32_t> transitions;
+    // The patterns that end in each state.
+    std::vector<std::vector<uint32_t>> accepts;
+    std::vector<uint8_t> accepting;
+    int32_t start = 0;
+    std::vector<int32_t> startStates;
+
+    // Scratch space for computing transitions.
+    std::vector<int32_t> pending;
+    std::vector<int32_t> backward;
+    std::vector<uint32_t> visited;
+    uint32_t mark = 0;
+
+    void NextMark() {
+        if (++mark == 0) {
+            std::fill(visited.begin(), visited.end(), 0);
+            mark = 1;
+        }
+    }
+
+    void Clear() {
+        ids.clear();
+        sets.clear();
+        transitions.clear();
+        accepts.clear();
+        accepting.clear();
+    }
+};
+
+PatternSearch::PatternSearch(const std::vector<std::string>& patterns, MatchMode mode, TextEncoding encoding)
+    : m_patternCount(patterns.size())
+    , m_id(nextSearchId.fetch_add(1))
+{
+    bool bounded = true;
+    m_reverseStarts.assign(patterns.size(), -1);
+    for (size_t patternIndex = 0; patternIndex < patterns.size(); ++patternIndex) {
+        Node root;
+        std::string error;
+        if (!Parser(patterns[patternIndex], mode, encoding).Parse(root, error)) {
+            // Check turns malformed patterns away before this point; one that slips through never matches.
+            continue;
+        }
+        root.TrimForContainment(true, true);
+
+        const size_t length = root.MaxLength();
+        if (length == std::numeric_limits<size_t>::max()) {
+            bounded = false;
+        }
+        else {
+            m_maxMatchLength = std::max(m_maxMatchLength, length);
+        }
+
+        NfaState accept;
+        accept.kind = NfaState::Kind::Accept;
+        accept.patternIndex = static_cast<uint32_t>(patternIndex);
+        m_starts.push_back(Compile(root, AddState(accept)));
+
+        // Run backwards from where a match ends, the reversed pattern finds where it starts.
+        root.Reverse();
+        m_reverseStarts[patternIndex] = Compile(root, AddState(std::move(accept)));
+    }
+    if (!bounded) {
+        m_maxMatchLength = 0;
+    }
+
+    // Split the bytes into classes by which byte sets contain them.
+    std::unordered_map<std::string, uint8_t> classBySignature;
+    for (int c = 0; c < 256; ++c) {
+        std::string signature(m_byteSets.size(), '0');
+        for (size_t set = 0; set < m_byteSets.size(); ++set) {
+            if (m_byteSets[set].test(static_cast<size_t>(c))) {
+                signature[set] = '1';
+            }
+        }
+        const auto found = classBySignature.emplace(signature, static_cast<uint8_t>(m_classBytes.size()));
+        if (found.second) {
+            m_classBytes.push_back(static_cast<uint8_t>(c));
+        }
+        m_byteClasses[c] = found.first->second;
+    }
+    m_classCount = m_classBytes.size();
+}
+
+PatternSearch::~PatternSearch() = default;
+
+bool PatternSearch::Check(const std::string& pattern, MatchMode mode, std::string& error)
+{
+    Node root;
+    if (!Parser(pattern, mode, TextEncoding::Utf8).Parse(root, error)) {
+        return false;
+    }
+    root.TrimForContainment(true, true);
+    if (root.Nullable()) {
+        error = "the pattern matches empty text, so it would match every file";
+        return false;
+    }
+    if (root.StateCount() > kMaxNfaStates) {
+        error = "the pattern is too large";
+        return false;
+    }
+    return true;
+}
+
+int32_t PatternSearch::AddState(NfaState state)
+{
+    m_states.push_back(std::move(state));
+    return static_cast<int32_t>(m_states.size() - 1);
+}
+
+// Builds the NFA back to front: returns the first state of the node, whose matches continue at next.
+int32_t PatternSearch::Compile(const Node& node, int32_t next)
+{
+    switch (node.kind) {
+    case Node::Kind::Empty:
+        return next;
+    case Node::Kind::Byte: {
+        NfaState state;
+        state.kind = NfaState::Kind::Byte;
+        state.byteSet = static_cast<uint32_t>(m_byteSets.size());
+        state.next.push_back(next);
+        m_byteSets.push_back(node.bytes);
+        return AddState(std::move(state));
+    }
+    case Node::Kind::Concat:
+        for (size_t i = node.children.size(); i-- > 0;) {
+            next = Compile(node.children[i], next);
+        }
+        return next;
+    case Node::Kind::Alternate: {
+        NfaState split;
+        for (const Node& child : node.children) {
+            split.next.push_back(Compile(child, next));
+        }
+        return AddState(std::move(split));
+    }
+    case Node::Kind::Repeat: {
+        const Node& child = node.children[0];
+        int32_t start = next;
+        if (node.max == kUnbounded) {
+            // A loop that either goes round the child once more or leaves.
+            const int32_t loop = AddState(NfaState());
+            const int32_t body = Compile(child, loop);
+            m_states[loop].next = { body, next };
+            start = loop;
+        }
+        else {
+            // Each optional copy either matches the child and goes on to the next one, or leaves.
+            for (int i = node.min; i < node.max; ++i) {
+                NfaState optional;
+                optional.next = { Compile(child, start), next };
+                start = AddState(std::move(optional));
+            }
+        }
+        for (int i = 0; i < node.min; ++i) {
+            start = Compile(child, start);
+        }
+        return start;
+    }
+    }
+    return next;
+}
+
+PatternSearch::DfaCache& PatternSearch::ThreadCache() const
+{
+    thread_local DfaCache cache;
+    if (cache.owner != m_id) {
+        cache.Clear();
+        cache.owner = m_id;
+        cache.visited.assign(m_states.size(), 0);
+        cache.mark = 0;
+        cache.startStates.clear();
+        ++cache.mark;
+        for (int32_t start : m_starts) {
+            AddClosure(start, cache.startStates, cache.visited, cache.mark);
+        }
+        std::vector<int32_t> startStates = cache.startStates;
+        cache.start = Intern(cache, startStates);
+    }
+    return cache;
+}
+
+void PatternSearch::AddClosure(int32_t state, std::vector<int32_t>& states, std::vector<uint32_t>& visited,
+    uint32_t mark) const
+{
+    if (visited[state] == mark) {
+        return;
+    }
+    visited[state] = mark;
+    const NfaState& nfaState = m_states[state];
+    if (nfaState.kind != NfaState::Kind::Split) {
+        states.push_back(state);
+        return;
+    }
+    for (int32_t next : nfaState.next) {
+        AddClosure(next, states, visited, mark);
+    }
+}
+
+int32_t PatternSearch::Intern(DfaCache& cache, std::vector<int32_t>& states) const
+{
+    std::sort(states.begin(), states.end());
+    std::string key(reinterpret_cast<const char*>(states.data()), states.size() * sizeof(int32_t));
+    const auto found = cache.ids.find(key);
+    if (found != cache.ids.end()) {
+        return found->second;
+    }
+
+    const int32_t dfaState = static_cast<int32_t>(cache.sets.size());
+    std::vector<uint32_t> accepts;
+    for (int32_t state : states) {
+        if (m_states[state].kind == NfaState::Kind::Accept) {
+            accepts.push_back(m_states[state].patternIndex);
+        }
+    }
+    cache.ids.emplace(std::move(key), dfaState);
+    cache.sets.push_back(states);
+    cache.transitions.resize(cache.transitions.size() + m_classCount, kUnknownTransition);
+    cache.accepting.push_back(accepts.empty() ? 0 : 1);
+    cache.accepts.push_back(std::move(accepts));
+    return dfaState;
+}
+
+int32_t PatternSearch::Transition(DfaCache& cache, int32_t dfaState, uint8_t byteClass) const
+{
+    cache.NextMark();
+    const unsigned char byte = m_classBytes[byteClass];
+    cache.pending.clear();
+    for (int32_t state : cache.sets[dfaState]) {
+        const NfaState& nfaState = m_states[state];
+        if (nfaState.kind == NfaState::Kind::Byte && m_byteSets[nfaState.byteSet].test(byte)) {
+            AddClosure(nfaState.next[0], cache.pending, cache.visited, cache.mark);
+        }
+    }
+    // Unanchored: a match can start at every byte.
+    for (int32_t state : cache.startStates) {
+        if (cache.visited[state] != cache.mark) {
+            cache.visited[state] = cache.mark;
+            cache.pending.push_back(state);
+        }
+    }
+
+    if (cache.sets.size() >= kMaxDfaStates) {
+        // Start over rather than grow without bound; the states in use are rebuilt as needed.
+        std::vector<int32_t> target = cache.pending;
+        std::vector<int32_t> startStates = cache.startStates;
+        cache.Clear();
+        cache.start = Intern(cache, startStates);
+        return Intern(cache, target);
+    }
+
+    const int32_t next = Intern(cache, cache.pending);
+    cache.transitions[static_cast<size_t>(dfaState) * m_classCount + byteClass] = next;
+    return next;
+}
+
+int32_t PatternSearch::Run(DfaCache& cache, int32_t dfaState, const char* data, size_t size, KeywordHits& hits) const
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        const uint8_t byteClass = m_byteClasses[bytes[i]];
+        int32_t next = cache.transitions[static_cast<size_t>(dfaState) * m_classCount + byteClass];
+        if (next == kUnknownTransition) {
+            next = Transition(cache, dfaState, byteClass);
+        }
+        dfaState = next;
+        if (cache.accepting[dfaState]) {
+            for (uint32_t patternIndex : cache.accepts[dfaState]) {
+                if (hits.Mark(patternIndex) && hits.Complete()) {
+                    return dfaState;
+                }
+            }
+        }
+    }
+    return dfaState;
+}
+
+void PatternSearch::Scan(const char* data, size_t size, KeywordHits& hits) const
+{
+    DfaCache& cache = ThreadCache();
+    Run(cache, cache.start, data, size, hits);
+}
+
+void PatternSearch::Scan(Cursor& cursor, const char* data, size_t size, KeywordHits& hits) const
+{
+    DfaCache& cache = ThreadCache();
+    int32_t dfaState = cursor.states.empty() ? cache.start : Intern(cache, cursor.states);
+    dfaState = Run(cache, dfaState, data, size, hits);
+    if (dfaState == cache.start) {
+        cursor.states.clear();
+    }
+    else {
+        cursor.states = cache.sets[dfaState];
+    }
+}
+
+void PatternSearch::FindAll(Cursor& cursor, const char* data, size_t size, const MatchFound& found) const
+{
+    DfaCache& cache = ThreadCache();
+    int32_t dfaState = cursor.states.empty() ? cache.start : Intern(cache, cursor.states);
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        const uint8_t byteClass = m_byteClasses[bytes[i]];
+        int32_t next = cache.transitions[static_cast<size_t>(dfaState) * m_classCount + byteClass];
+        if (next == kUnknownTransition) {
+            next = Transition(cache, dfaState, byteClass);
+        }
+        dfaState = next;
+        if (cache.accepting[dfaState]) {
+            for (uint32_t patternIndex : cache.accepts[dfaState]) {
+                found(patternIndex, i + 1);
+            }
+        }
+    }
+    if (dfaState == cache.start) {
+        cursor.states.clear();
+    }
+    else {
+        cursor.states = cache.sets[dfaState];
+    }
+}
+
+size_t PatternSearch::MatchStart(size_t patternIndex, const char* data, size_t end) const
+{
+    if (m_reverseStarts[patternIndex] < 0) {
+        return end;
+    }
+
+    DfaCache& cache = ThreadCache();
+    std::vector<int32_t>& current = cache.backward;
+    std::vector<int32_t>& next = cache.pending;
+    current.clear();
+    cache.NextMark();
+    AddClosure(m_reverseStarts[patternIndex], current, cache.visited, cache.mark);
+
+    // The reversed NFA is anchored at end, so no state is re-entered along the way, and the first
+    // accept seen is the latest start.
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    for (size_t i = end; i-- > 0 && !current.empty();) {
+        cache.NextMark();
+        next.clear();
+        for (int32_t state : current) {
+            const NfaState& nfaState = m_states[state];
+            if (nfaState.kind == NfaState::Kind::Byte && m_byteSets[nfaState.byteSet].test(bytes[i])) {
+                AddClosure(nfaState.next[0], next, cache.visited, cache.mark);
+            }
+        }
+        for (int32_t state : next) {
+            if (m_states[state].kind == NfaState::Kind::Accept) {
+                return i;
+            }
+        }
+        current.swap(next);
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Wildcard and regular expression keywords, matched by a lazily built DFA.
+// All patterns are compiled together into one Thompson NFA. The DFA over its state sets is built
+// on the fly: a transition is computed the first time the text takes it and looked up in a table
+// from then on, so a file is scanned in one linear pass with a table lookup per byte and the DFA
+// only ever holds the states the text actually reaches. Matching is case-insensitive for ASCII,
+// like the literal engines, and a keyword counts as found as soon as any match of it ends.
+// Characters outside ASCII are matched in the encoding the search was built for, with each letter
+// standing for all of its case variants, which is also how literal keywords with such letters are
+// searched for.
+//
+// Wildcards take * for any run of characters and ? for a single one. Regular expressions take
+// literals, ., [...] and [^...] classes with ranges, the \d \w \s escapes and their negations,
+// groups, |, and the *, +, ? and {m,n} quantifiers. Neither . nor a wildcard matches a line break.
+// Anchors and back-references are not supported: a pattern matches anywhere in the text. In UTF-8,
+// ., ?, \W and negated classes match whole characters, and a class matches the characters listed
+// in it; \x escapes and bytes that are not UTF-8 match single bytes.
+
+#pragma once
+
+#include "KeywordHits.h"
+#include "TextEncoding.h"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// How the keywords on the command line are read.
+enum class MatchMode {
+    // Plain text.
+    Literal,
+    // * and ? wildcards.
+    Wildcard,
+    // Regular expressions.
+    Regex,
+};
+
+// Parses a /match value: literal, wildcard or regex. Returns false for anything else.
+bool ParseMatchMode(const std::string& name, MatchMode& mode);
+
+// The /match name of a mode, for diagnostics and index signatures.
+const char* MatchModeName(MatchMode mode);
+
+class PatternSearch {
+public:
+    // Where a scan stopped, for matching a stream that arrives in several buffers. A default
+    // cursor is the start of a stream.
+    struct Cursor {
+        // The NFA states the scan was in, empty at the start of the stream. DFA states are private
+        // to the thread that built them, so the position is carried in NFA terms.
+        std::vector<int32_t> states;
+    };
+
+    // Checks that a pattern is well formed. Returns false, with the reason in error, if it is not.
+    static bool Check(const std::string& pattern, MatchMode mode, std::string& error);
+
+    // Compiles the patterns, which must all pass Check, for text in encoding. Patterns are UTF-8,
+    // and only literal ones can be searched for in UTF-16.
+    PatternSearch(const std::vector<std::string>& patterns, MatchMode mode,
+        TextEncoding encoding = TextEncoding::Utf8);
+    ~PatternSearch();
+
+    PatternSearch(const PatternSearch&) = delete;
+    PatternSearch& operator=(const PatternSearch&) = delete;
+
+    // Marks every pattern that matches inside the text. Returns early once every pattern has been
+    // found; check hits.Complete() to stop reading the file.
+    void Scan(const char* data, size_t size, KeywordHits& hits) const;
+
+    // Like Scan, but starts where cursor left off and leaves it after the last byte, so a match can
+    // span any number of buffers.
+    void Scan(Cursor& cursor, const char* data, size_t size, KeywordHits& hits) const;
+
+    // Like Scan with a cursor, but reports every match to found instead of marking the first one
+    // of each pattern. Matches ending at the same byte are reported once per pattern.
+    void FindAll(Cursor& cursor, const char* data, size_t size, const MatchFound& found) const;
+
+    // Where the shortest match of the pattern that ends at offset end of data starts. Returns 0 if
+    // no match starts inside data, as when it began in an earlier buffer.
+    size_t MatchStart(size_t patternIndex, const char* data, size_t end) const;
+
+    size_t PatternCount() const { return m_patternCount; }
+
+    // The longest text any pattern needs to be found, or 0 if a pattern can need text of any
+    // length, such as a*b. A pattern is found in a buffer split into pieces that overlap by this
+    // much less one byte, matched independently, as long as it is non-zero.
+    size_t MaxMatchLength() const { return m_maxMatchLength; }
+
+    size_t NfaStateCount() const { return m_states.size(); }
+
+private:
+    struct NfaState {
+        enum class Kind : uint8_t {
+            // Consumes a byte of m_byteSets[byteSet] and moves to next.
+            Byte,
+            // Moves to every state in next without consuming anything.
+            Split,
+            // patternIndex has matched.
+            Accept,
+        };
+        Kind kind = Kind::Split;
+        uint32_t byteSet = 0;
+        uint32_t patternIndex = 0;
+        std::vector<int32_t> next;
+    };
+
+    struct DfaCache;
+    struct Node;
+    class Parser;
+
+    int32_t Compile(const Node& node, int32_t next);
+    int32_t AddState(NfaState state);
+
+    DfaCache& ThreadCache() const;
+    int32_t Intern(DfaCache& cache, std::vector<int32_t>& states) const;
+    int32_t Transition(DfaCache& cache, int32_t dfaState, uint8_t byteClass) const;
+    void AddClosure(int32_t state, std::vector<int32_t>& states, std::vector<uint32_t>& visited, uint32_t mark) const;
+    int32_t Run(DfaCache& cache, int32_t dfaState, const char* data, size_t size, KeywordHits& hits) const;
+
+    std::vector<NfaState> m_states;
+    std::vector<std::bitset<256>> m_byteSets;
+    // Every pattern's first state. The search is unanchored, so they are re-entered at every byte.
+    std::vector<int32_t> m_starts;
+    // Every pattern's first state in its reversed NFA, indexed by pattern, or -1 if it has none.
+    std::vector<int32_t> m_reverseStarts;
+    // Bytes that no pattern tells apart share a class, and DFA rows have one entry per class.
+    uint8_t m_byteClasses[256] = {};
+    size_t m_classCount = 0;
+    std::vector<uint8_t> m_classBytes;
+
+    size_t m_patternCount = 0;
+    size_t m_maxMatchLength = 0;
+    // Identifies this search to the per-thread DFA caches.
+    uint64_t m_id = 0;
+};
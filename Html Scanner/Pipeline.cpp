@@ -0,0 +1,468 @@
+#include "Pipeline.h"
+
+#include "AsyncReader.h"
+#include "BlockReader.h"
+#include "BoundedQueue.h"
+#include "BufferPool.h"
+#include "DirectoryWalker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+    // A file whose buffers are still being read or matched.
+    struct PendingFile {
+        FileId fileId = 0;
+        std::filesystem::path path;
+        // The search for the file's encoding, set by the reader from the first buffer.
+        const KeywordSearch* search = nullptr;
+        std::mutex mutex;
+        KeywordHits hits;
+        // Buffers not yet matched, plus one while the reader is still reading the file.
+        std::atomic<size_t> outstanding{ 1 };
+        // Set once every keyword has been found, so the reader can stop early.
+        std::atomic<bool> complete{ false };
+    };
+
+    struct PathItem {
+        FileId fileId = 0;
+        std::filesystem::path path;
+    };
+
+    struct Chunk {
+        std::shared_ptr<PendingFile> file;
+        char* buffer = nullptr;
+        size_t size = 0;
+        // Where the buffer starts in the file. Only UTF-16 files need it, and those are never
+        // scope filtered, so it is a plain file offset.
+        uint64_t offset = 0;
+    };
+
+    // How many buffers the pool holds, how big they are, and how many async reads are kept in flight.
+    struct PoolShape {
+        size_t bufferCount = 0;
+        size_t bufferSize = 0;
+        size_t asyncQueueDepth = 0;
+    };
+
+    PoolShape ShapePool(const PipelineOptions& options, size_t overlap) {
+        // Make sure each buffer has room for a sizeable amount of new data next to the overlap.
+        const size_t minimumSize = 2 * overlap + 4096;
+        PoolShape shape;
+        shape.bufferSize = std::max(options.bufferSize, minimumSize);
+        shape.asyncQueueDepth = options.asyncQueueDepth;
+        size_t matcherShare = options.bufferCount != 0 ? options.bufferCount : 4 * std::max<size_t>(options.matcherThreads, 1);
+        if (options.limits != nullptr && options.limits->memory.Limited()) {
+            // Half the budget goes to the pool and the rest is left to the results. The pool keeps
+            // at least one buffer for the matchers and, with async reads, one for a read.
+            const uint64_t poolBytes = options.limits->memory.Limit() / 2;
+            const size_t minimumCount = shape.asyncQueueDepth != 0 ? 2 : 1;
+            const size_t count = static_cast<size_t>(std::clamp<uint64_t>(poolBytes / shape.bufferSize,
+                minimumCount, matcherShare + shape.asyncQueueDepth));
+            if (count * shape.bufferSize > poolBytes) {
+                shape.bufferSize = std::max(static_cast<size_t>(poolBytes / count), minimumSize);
+            }
+            if (shape.asyncQueueDepth != 0) {
+                shape.asyncQueueDepth = std::min(shape.asyncQueueDepth, count - 1);
+            }
+            matcherShare = count - shape.asyncQueueDepth;
+        }
+        shape.bufferCount = matcherShare + shape.asyncQueueDepth;
+        return shape;
+    }
+
+    // Runs a call that may block and adds the time it took to idleSeconds.
+    template <typename Call>
+    auto TimeWaiting(double& idleSeconds, Call&& call) {
+        const Stopwatch wait;
+        auto result = call();
+        idleSeconds += wait.Seconds();
+        return result;
+    }
+
+    class Pipeline {
+    public:
+        Pipeline(const std::filesystem::path& root, const KeywordSearch& matcher,
+            const PipelineOptions& options, PathTable& paths, const PipelineCallbacks& callbacks)
+            : m_root(root)
+            , m_matcher(matcher)
+            , m_options(options)
+            , m_paths(paths)
+            , m_callbacks(callbacks)
+            // Enough for the search of any encoding a file turns out to be in.
+            , m_overlap(matcher.MaxEncodedLength() > 0 ? matcher.MaxEncodedLength() - 1 : 0)
+            , m_shape(ShapePool(options, m_overlap))
+            , m_pool(m_shape.bufferCount, m_shape.bufferSize)
+            , m_pathQueue(options.pathQueueCapacity)
+            , m_chunkQueue(m_pool.BufferCount())
+        {
+            if (m_options.limits != nullptr) {
+                m_options.limits->memory.Hold(static_cast<uint64_t>(m_pool.BufferCount()) * m_pool.BufferSize());
+            }
+        }
+
+        PipelineStats Run() {
+            const bool asyncReads = m_options.asyncQueueDepth != 0;
+            const size_t readerCount = asyncReads ? 1 : std::max<size_t>(m_options.readerThreads, 1);
+            const size_t matcherCount = std::max<size_t>(m_options.matcherThreads, 1);
+            m_activeReaders = readerCount;
+            m_stats.threads.resize(matcherCount + readerCount);
+
+            std::vector<std::thread> threads;
+            threads.emplace_back(&Pipeline::Walk, this);
+            for (size_t i = 0; i < readerCount; ++i) {
+                threads.emplace_back(asyncReads ? &Pipeline::ReadAsync : &Pipeline::Read, this, matcherCount + i);
+            }
+            for (size_t i = 0; i < matcherCount; ++i) {
+                threads.emplace_back(&Pipeline::Match, this, i);
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+
+            m_stats.bytesRead = m_bytesRead.load();
+            return m_stats;
+        }
+
+    private:
+        void Walk() {
+            const Stopwatch walkTime;
+            // A single-threaded walk, so paths reach the readers as soon as they are listed.
+            WalkHtmlFiles(m_root, 1, m_options.fileFilter,
+                [this](const std::filesystem::path& filePath) {
+                    if (m_options.limits != nullptr) {
+                        // The table keeps every path until the scan is over.
+                        m_options.limits->memory.Hold(filePath.native().size() * sizeof(PathTable::CharType) + sizeof(PathTable::View));
+                    }
+                    const FileId fileId = m_paths.Add(filePath);
+                    m_pathQueue.Push({ fileId, filePath });
+                },
+                [this](const std::string& message) {
+                    if (m_callbacks.walkFailed) {
+                        m_callbacks.walkFailed(message);
+                    }
+                },
+                &m_stats.walk);
+            m_pathQueue.Close();
+            m_stats.walkSeconds = walkTime.Seconds();
+        }
+
+        void Read(size_t workerIndex) {
+            const Stopwatch lifetime;
+            double idleSeconds = 0.0;
+            uint64_t bytesReadTotal = 0;
+            BlockReader reader;
+            std::vector<char> tail;
+            PathItem item;
+            while (TimeWaiting(idleSeconds, [&] { return m_pathQueue.Pop(item); })) {
+                if (m_options.limits != nullptr) {
+                    TimeWaiting(idleSeconds, [&] { m_options.limits->openFiles.Acquire(); return true; });
+                }
+                ReadFile(workerIndex, item, reader, tail, idleSeconds, bytesReadTotal);
+                if (m_options.limits != nullptr) {
+                    m_options.limits->openFiles.Release();
+                }
+            }
+
+            m_bytesRead.fetch_add(bytesReadTotal);
+            m_stats.threads[workerIndex] = { "reader", lifetime.Seconds() - idleSeconds, idleSeconds };
+            if (m_activeReaders.fetch_sub(1) == 1) {
+                m_chunkQueue.Close();
+            }
+        }
+
+        // Reads one file with blocking reads, decompressing it if its name says so, and queues its
+        // buffers. The caller holds the open file it takes.
+        void ReadFile(size_t workerIndex, const PathItem& item, BlockReader& reader, std::vector<char>& tail,
+            double& idleSeconds, uint64_t& bytesReadTotal) {
+            if (!reader.Open(item.path)) {
+                if (m_callbacks.openFailed) {
+                    m_callbacks.openFailed(item.path);
+                }
+                return;
+            }
+
+            auto file = std::make_shared<PendingFile>();
+            file->fileId = item.fileId;
+            file->path = item.path;
+            file->hits.Reset(m_matcher.KeywordCount());
+
+            tail.clear();
+            HtmlScopeFilter scopeFilter;
+            uint64_t fileOffset = 0;
+            while (!file->complete.load(std::memory_order_relaxed)) {
+                char* buffer = TimeWaiting(idleSeconds, [&] { return m_pool.Acquire(); });
+                // Start each buffer with the end of the previous one, so matches that straddle
+                // the boundary are still seen. The first buffer of a file has no tail, and an empty
+                // vector's data() may be null, which memcpy does not allow.
+                if (!tail.empty()) {
+                    std::memcpy(buffer, tail.data(), tail.size());
+                }
+                const size_t bytesRead = reader.Read(buffer + tail.size(), m_pool.BufferSize() - tail.size());
+                if (bytesRead == 0) {
+                    m_pool.Release(buffer);
+                    break;
+                }
+                bytesReadTotal += bytesRead;
+                if (m_options.limits != nullptr) {
+                    TimeWaiting(idleSeconds, [&] { m_options.limits->ioRate.Consume(bytesRead); return true; });
+                }
+                if (file->search == nullptr) {
+                    SniffFile(*file, buffer, bytesRead, scopeFilter);
+                }
+
+                const uint64_t offset = fileOffset - tail.size();
+                fileOffset += bytesRead;
+                const size_t size = tail.size() + scopeFilter.Filter(buffer + tail.size(), bytesRead, buffer + tail.size());
+                const size_t carried = std::min(m_overlap, size);
+                tail.assign(buffer + size - carried, buffer + size);
+
+                file->outstanding.fetch_add(1);
+                TimeWaiting(idleSeconds, [&] { return m_chunkQueue.Push({ file, buffer, size, offset }); });
+            }
+            reader.Close();
+
+            // Drop the reader's share; if every buffer has been matched already, finish here.
+            if (file->outstanding.fetch_sub(1) == 1) {
+                Finish(workerIndex, *file);
+            }
+        }
+
+        // Takes the place of the reader threads when asyncQueueDepth is set. Up to that many files are
+        // read at once, with one read in flight per file, and every buffer goes to the matchers as
+        // soon as its read completes. The buffer pool has room for one buffer per read on top of the
+        // matchers' share, so acquiring one here never waits on this thread itself. Compressed files
+        // have to be decoded in order, so they are read and decompressed right here with blocking
+        // reads; corpora that are mostly compressed scale better with several /io reader threads.
+        // Under /maxopen, every open file is one the thread holds until its last read completes, so
+        // it only waits for one when no read is in flight and otherwise starts fewer files.
+        void ReadAsync(size_t workerIndex) {
+            const Stopwatch lifetime;
+            double idleSeconds = 0.0;
+            uint64_t bytesReadTotal = 0;
+            ResourceLimits* limits = m_options.limits;
+            AsyncReader reader(m_shape.asyncQueueDepth);
+            BlockReader blockReader;
+            std::vector<char> blockTail;
+
+            struct ReadSlot {
+                std::shared_ptr<PendingFile> file;
+                AsyncReader::FileHandle handle{};
+                uint64_t size = 0;
+                uint64_t offset = 0;
+                std::vector<char> tail;
+                HtmlScopeFilter scopeFilter;
+                char* buffer = nullptr;
+            };
+            std::vector<ReadSlot> slots(reader.QueueDepth());
+            std::vector<ReadSlot*> freeSlots;
+            for (auto& slot : slots) {
+                freeSlots.push_back(&slot);
+            }
+
+            auto submitNext = [&](ReadSlot& slot) {
+                slot.buffer = TimeWaiting(idleSeconds, [&] { return m_pool.Acquire(); });
+                if (!slot.tail.empty()) {
+                    std::memcpy(slot.buffer, slot.tail.data(), slot.tail.size());
+                }
+                reader.Submit(slot.handle, slot.offset, slot.buffer + slot.tail.size(),
+                    m_pool.BufferSize() - slot.tail.size(), &slot);
+            };
+            auto finishFile = [&](ReadSlot& slot) {
+                reader.CloseFile(slot.handle);
+                if (limits != nullptr) {
+                    limits->openFiles.Release();
+                }
+                if (slot.file->outstanding.fetch_sub(1) == 1) {
+                    Finish(workerIndex, *slot.file);
+                }
+                slot.file.reset();
+                freeSlots.push_back(&slot);
+            };
+
+            bool morePaths = true;
+            while (morePaths || reader.InFlight() > 0) {
+                // Start on new files while there is room. Only wait for the walker when there is no
+                // read in flight that could be handled in the meantime.
+                while (morePaths && !freeSlots.empty()) {
+                    PathItem item;
+                    const bool idle = reader.InFlight() == 0;
+                    if (limits != nullptr) {
+                        if (idle) {
+                            TimeWaiting(idleSeconds, [&] { limits->openFiles.Acquire(); return true; });
+                        }
+                        else if (!limits->openFiles.TryAcquire()) {
+                            break;
+                        }
+                    }
+                    // Gives back the open file taken above for a path that is not read in a slot.
+                    auto releaseOpenFile = [&] {
+                        if (limits != nullptr) {
+                            limits->openFiles.Release();
+                        }
+                    };
+                    if (!(idle ? TimeWaiting(idleSeconds, [&] { return m_pathQueue.Pop(item); }) : m_pathQueue.TryPop(item))) {
+                        releaseOpenFile();
+                        morePaths = !idle;
+                        break;
+                    }
+
+                    if (CompressionFromPath(item.path) != Compression::None) {
+                        ReadFile(workerIndex, item, blockReader, blockTail, idleSeconds, bytesReadTotal);
+                        releaseOpenFile();
+                        continue;
+                    }
+
+                    ReadSlot& slot = *freeSlots.back();
+                    if (!reader.OpenFile(item.path, slot.handle, slot.size)) {
+                        releaseOpenFile();
+                        if (m_callbacks.openFailed) {
+                            m_callbacks.openFailed(item.path);
+                        }
+                        continue;
+                    }
+                    freeSlots.pop_back();
+
+                    slot.file = std::make_shared<PendingFile>();
+                    slot.file->fileId = item.fileId;
+                    slot.file->path = item.path;
+                    slot.file->hits.Reset(m_matcher.KeywordCount());
+                    slot.offset = 0;
+                    slot.tail.clear();
+                    if (slot.size == 0) {
+                        finishFile(slot);
+                        continue;
+                    }
+                    submitNext(slot);
+                }
+
+                AsyncReader::Completion completion;
+                if (!TimeWaiting(idleSeconds, [&] { return reader.WaitCompletion(completion); })) {
+                    continue;
+                }
+
+                ReadSlot& slot = *static_cast<ReadSlot*>(completion.userData);
+                if (completion.bytesRead == 0 || completion.failed) {
+                    // End of file, or a read error, which ends the file just as it does for the
+                    // blocking readers. The hits found before an error are kept, but the file is
+                    // reported, since the rest of it was never matched.
+                    m_pool.Release(slot.buffer);
+                    if (completion.failed && m_callbacks.openFailed) {
+                        m_callbacks.openFailed(slot.file->path);
+                    }
+                    finishFile(slot);
+                    continue;
+                }
+
+                if (slot.file->search == nullptr) {
+                    SniffFile(*slot.file, slot.buffer, completion.bytesRead, slot.scopeFilter);
+                }
+                const uint64_t offset = slot.offset - slot.tail.size();
+                const size_t size = slot.tail.size()
+                    + slot.scopeFilter.Filter(slot.buffer + slot.tail.size(), completion.bytesRead, slot.buffer + slot.tail.size());
+                const size_t carried = std::min(m_overlap, size);
+                slot.tail.assign(slot.buffer + size - carried, slot.buffer + size);
+                slot.offset += completion.bytesRead;
+                bytesReadTotal += completion.bytesRead;
+                if (limits != nullptr) {
+                    TimeWaiting(idleSeconds, [&] { limits->ioRate.Consume(completion.bytesRead); return true; });
+                }
+
+                slot.file->outstanding.fetch_add(1);
+                m_chunkQueue.Push({ slot.file, slot.buffer, size, offset });
+
+                if (slot.offset >= slot.size || slot.file->complete.load(std::memory_order_relaxed)) {
+                    finishFile(slot);
+                }
+                else {
+                    submitNext(slot);
+                }
+            }
+
+            m_bytesRead.fetch_add(bytesReadTotal);
+            m_stats.threads[workerIndex] = { "reader", lifetime.Seconds() - idleSeconds, idleSeconds };
+            if (m_activeReaders.fetch_sub(1) == 1) {
+                m_chunkQueue.Close();
+            }
+        }
+
+        void Match(size_t workerIndex) {
+            const Stopwatch lifetime;
+            double idleSeconds = 0.0;
+            KeywordHits local;
+            Chunk chunk;
+            while (TimeWaiting(idleSeconds, [&] { return m_chunkQueue.Pop(chunk); })) {
+                PendingFile& file = *chunk.file;
+                if (!file.complete.load(std::memory_order_relaxed)) {
+                    // Start from what other buffers of the file already found, so those keywords
+                    // are not searched for again.
+                    {
+                        std::lock_guard<std::mutex> lock(file.mutex);
+                        local = file.hits;
+                    }
+                    ScanBuffer(chunk.buffer, chunk.size, *file.search, m_options.readMode, local, chunk.offset);
+                    {
+                        std::lock_guard<std::mutex> lock(file.mutex);
+                        file.hits.Merge(local);
+                        if (file.hits.Complete()) {
+                            file.complete.store(true, std::memory_order_relaxed);
+                        }
+                    }
+                }
+
+                m_pool.Release(chunk.buffer);
+                if (file.outstanding.fetch_sub(1) == 1) {
+                    Finish(workerIndex, file);
+                }
+                chunk = Chunk();
+            }
+            m_stats.threads[workerIndex] = { "matcher", lifetime.Seconds() - idleSeconds, idleSeconds };
+        }
+
+        // Picks the search and scope for a file from the start of its first buffer, before any of
+        // its buffers are queued.
+        void SniffFile(PendingFile& file, const char* data, size_t size, HtmlScopeFilter& scopeFilter) {
+            const TextEncoding encoding = SniffEncoding(data, size);
+            file.search = &m_matcher.ForEncoding(encoding);
+            scopeFilter = HtmlScopeFilter(ScopeFor(encoding, m_options.scope));
+        }
+
+        void Finish(size_t workerIndex, const PendingFile& file) {
+            if (m_callbacks.fileScanned) {
+                m_callbacks.fileScanned(workerIndex, file.fileId, file.path, file.hits);
+            }
+        }
+
+        const std::filesystem::path& m_root;
+        const KeywordSearch& m_matcher;
+        const PipelineOptions& m_options;
+        PathTable& m_paths;
+        const PipelineCallbacks& m_callbacks;
+        const size_t m_overlap;
+        const PoolShape m_shape;
+
+        BufferPool m_pool;
+        BoundedQueue<PathItem> m_pathQueue;
+        BoundedQueue<Chunk> m_chunkQueue;
+        std::atomic<size_t> m_activeReaders{ 0 };
+
+        // Each thread writes only its own entry, and the walker only the walk fields.
+        PipelineStats m_stats;
+        std::atomic<uint64_t> m_bytesRead{ 0 };
+    };
+
+}
+
+PipelineStats RunPipeline(const std::filesystem::path& root, const KeywordSearch& matcher,
+    const PipelineOptions& options, PathTable& paths, const PipelineCallbacks& callbacks)
+{
+    Pipeline pipeline(root, matcher, options, paths, callbacks);
+    return pipeline.Run();
+}
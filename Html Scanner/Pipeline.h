@@ -0,0 +1,83 @@
+// Staged scan pipeline: one walker thread, a group of reader threads and a group of matcher threads,
+// connected by bounded queues.
+//
+//   walker --(paths)--> readers --(buffers)--> matchers
+//
+// The walker enumerates the tree while earlier files are still being read, and readers keep
+// filling buffers while matchers work on the ones already read, so disk and CPU time overlap.
+// Buffers come from a fixed BufferPool, which caps the memory in flight. A large file is split into
+// several buffers; consecutive buffers overlap by MaxKeywordLength() - 1 bytes so no match is lost
+// at a boundary, and the buffers of one file may be matched on different threads at the same time.
+// Under a memory budget the pool is sized to fit half of it, with fewer and then smaller buffers.
+// With a scope set, readers run each buffer through the file's HtmlScopeFilter before queueing it,
+// since the tokenizer has to see the file in order; matchers only ever see in-scope bytes.
+// Compressed files are decompressed by the readers for the same reason.
+
+#pragma once
+
+#include "DirectoryWalker.h"
+#include "FileFilter.h"
+#include "KeywordHits.h"
+#include "KeywordSearch.h"
+#include "PathTable.h"
+#include "ResourceLimits.h"
+#include "ScanStats.h"
+#include "Scanner.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+struct PipelineOptions {
+    size_t readerThreads = 2;
+    // When non-zero, a single thread keeps this many reads in flight through AsyncReader in place
+    // of the blocking reader threads, and readerThreads is ignored. Each read holds one buffer, so
+    // the pool grows by the same number of buffers.
+    size_t asyncQueueDepth = 0;
+    size_t matcherThreads = 1;
+    // Number of buffers in flight. 0 picks four per matcher thread.
+    size_t bufferCount = 0;
+    size_t bufferSize = 1 << 20;
+    // Enumerated paths waiting for a reader.
+    size_t pathQueueCapacity = 4096;
+    ReadMode readMode = ReadMode::Lines;
+    ScanScope scope = ScanScope::All;
+    // Which files the walker hands on.
+    FileFilter fileFilter;
+    // With /maxmem, /maxopen or /iorate, the limits the pipeline is held to. The buffer pool is
+    // charged to the memory budget up front, and so are the paths the walker lists; readers wait
+    // for an open file before opening one and pace their reads to the I/O rate.
+    ResourceLimits* limits = nullptr;
+};
+
+struct PipelineCallbacks {
+    // Called once per file that was read, with its final hits. workerIndex identifies the calling
+    // thread and is below matcherThreads + readerThreads, so callers can keep per-thread results.
+    // The path is passed along because the path table is still being filled while files complete.
+    std::function<void(size_t workerIndex, FileId fileId, const std::filesystem::path& filePath,
+        const KeywordHits& hits)> fileScanned;
+    // Called from a reader thread when a file cannot be opened, or when an asynchronous read of it
+    // fails partway.
+    std::function<void(const std::filesystem::path& filePath)> openFailed;
+    // Called from the walker thread if enumeration stops with an error.
+    std::function<void(const std::string& message)> walkFailed;
+};
+
+// Counters and thread times from one pipeline run.
+struct PipelineStats {
+    WalkCounters walk;
+    double walkSeconds = 0.0;
+    uint64_t bytesRead = 0;
+    // One entry per workerIndex. Idle time is time spent waiting on a queue, a buffer or the disk.
+    std::vector<ThreadTime> threads;
+};
+
+// Scans every HTML file below root. Candidate files are added to paths in enumeration order, and
+// the table must not be read by anyone else until the function returns. Returns what the
+// pipeline measured along the way.
+PipelineStats RunPipeline(const std::filesystem::path& root, const KeywordSearch& matcher,
+    const PipelineOptions& options, PathTable& paths, const PipelineCallbacks& callbacks);
@@ -0,0 +1,289 @@
+#include "QueryServer.h"
+
+#include "Log.h"
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+    // A line longer than this is not a sensible query, so the connection is dropped instead of
+    // buffering it.
+    constexpr size_t kMaxLineLength = 1 << 20;
+    // Likewise for a batch of more queries than this.
+    constexpr size_t kMaxBatchQueries = 10000;
+
+    // A client that sends nothing for this long is disconnected, so idle connections do not pile up.
+    constexpr auto kIdleTimeout = std::chrono::minutes(5);
+
+    // Clients beyond this many at once are turned away as soon as they connect.
+    constexpr size_t kMaxClients = 64;
+
+    // How often a wait for a connection or a request wakes up to check the stop flag.
+    constexpr long kPollMicroseconds = 500 * 1000;
+
+#ifdef _WIN32
+    using NativeSocket = SOCKET;
+    constexpr NativeSocket kInvalidSocket = INVALID_SOCKET;
+
+    int LastSocketError() { return WSAGetLastError(); }
+    void CloseSocket(NativeSocket socket) { closesocket(socket); }
+#else
+    using NativeSocket = int;
+    constexpr NativeSocket kInvalidSocket = -1;
+
+    int LastSocketError() { return errno; }
+    void CloseSocket(NativeSocket socket) { close(socket); }
+#endif
+
+#ifdef MSG_NOSIGNAL
+    // A client that goes away mid-answer must not kill the server with SIGPIPE.
+    constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+    constexpr int kSendFlags = 0;
+#endif
+
+    class Socket {
+    public:
+        explicit Socket(NativeSocket socket = kInvalidSocket) : m_socket(socket) {}
+        ~Socket() {
+            if (m_socket != kInvalidSocket) {
+                CloseSocket(m_socket);
+            }
+        }
+
+        Socket(const Socket&) = delete;
+        Socket& operator=(const Socket&) = delete;
+
+        NativeSocket Get() const { return m_socket; }
+        bool Valid() const { return m_socket != kInvalidSocket; }
+
+    private:
+        NativeSocket m_socket;
+    };
+
+    std::string SocketMessage(const char* what) {
+        return std::string(what) + ": " + std::error_code(LastSocketError(), std::system_category()).message();
+    }
+
+    // Waits until the socket is readable. Returns false if the wait timed out.
+    bool WaitReadable(NativeSocket socket) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(socket, &readable);
+        timeval timeout = { 0, kPollMicroseconds };
+        return select(static_cast<int>(socket + 1), &readable, nullptr, nullptr, &timeout) > 0;
+    }
+
+    bool SendAll(NativeSocket socket, const std::string& data) {
+        for (size_t sent = 0; sent < data.size();) {
+            const auto result = send(socket, data.data() + sent, static_cast<int>(data.size() - sent), kSendFlags);
+            if (result <= 0) {
+                return false;
+            }
+            sent += static_cast<size_t>(result);
+        }
+        return true;
+    }
+
+    Query SplitQuery(const std::string& line) {
+        Query query;
+        size_t start = 0;
+        for (;;) {
+            const size_t tab = line.find('\t', start);
+            const std::string keyword = line.substr(start, tab == std::string::npos ? std::string::npos : tab - start);
+            if (!keyword.empty()) {
+                query.push_back(keyword);
+            }
+            if (tab == std::string::npos) {
+                return query;
+            }
+            start = tab + 1;
+        }
+    }
+
+    // Answers one batch and sends the blocks. Returns false if the client is gone. The handler
+    // answers one batch at a time; each batch already has every worker to itself.
+    bool AnswerBatch(NativeSocket client, const BatchHandler& handler, std::mutex& handlerMutex,
+        const std::vector<Query>& queries) {
+        std::vector<std::string> answers(queries.size());
+        std::string error;
+        bool answered;
+        {
+            std::lock_guard<std::mutex> lock(handlerMutex);
+            answered = handler(queries, answers, error);
+        }
+        if (!answered) {
+            for (auto& answer : answers) {
+                answer = "ERROR\t" + error + '\n';
+            }
+        }
+
+        std::string response;
+        for (const auto& answer : answers) {
+            response += answer;
+            response += '\n';
+        }
+        return SendAll(client, response);
+    }
+
+    // Reads batches from one client until it disconnects, goes idle or the server is stopped.
+    void ServeClient(NativeSocket client, const BatchHandler& handler, std::mutex& handlerMutex,
+        const volatile std::sig_atomic_t& stop) {
+        std::string pending;
+        std::vector<Query> batch;
+        std::vector<char> buffer(64 * 1024);
+        auto lastReceived = std::chrono::steady_clock::now();
+        while (!stop) {
+            if (!WaitReadable(client)) {
+                if (std::chrono::steady_clock::now() - lastReceived > kIdleTimeout) {
+                    LogLine(LogLevel::Debug) << "[DEBUG] Dropping an idle client";
+                    return;
+                }
+                continue;
+            }
+            const auto received = recv(client, buffer.data(), static_cast<int>(buffer.size()), 0);
+            if (received <= 0) {
+                return;
+            }
+            lastReceived = std::chrono::steady_clock::now();
+            pending.append(buffer.data(), static_cast<size_t>(received));
+
+            size_t lineStart = 0;
+            for (size_t lineEnd; (lineEnd = pending.find('\n', lineStart)) != std::string::npos; lineStart = lineEnd + 1) {
+                std::string line = pending.substr(lineStart, lineEnd - lineStart);
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                if (line.size() > kMaxLineLength) {
+                    LogLine(LogLevel::Warning) << "Warning: Dropping a client that sent a line of more than " << kMaxLineLength << " bytes.";
+                    return;
+                }
+                if (!line.empty()) {
+                    if (batch.size() == kMaxBatchQueries) {
+                        LogLine(LogLevel::Warning) << "Warning: Dropping a client that sent a batch of more than " << kMaxBatchQueries << " queries.";
+                        return;
+                    }
+                    batch.push_back(SplitQuery(line));
+                    continue;
+                }
+                if (!batch.empty()) {
+                    LogLine(LogLevel::Debug) << "[DEBUG] Answering a batch of " << batch.size() << " queries";
+                    if (!AnswerBatch(client, handler, handlerMutex, batch)) {
+                        return;
+                    }
+                    batch.clear();
+                }
+            }
+            pending.erase(0, lineStart);
+            if (pending.size() > kMaxLineLength) {
+                LogLine(LogLevel::Warning) << "Warning: Dropping a client that sent a line of more than " << kMaxLineLength << " bytes.";
+                return;
+            }
+        }
+    }
+
+}
+
+bool RunQueryServer(uint16_t port, const BatchHandler& handler, const volatile std::sig_atomic_t& stop,
+    std::string& error)
+{
+#ifdef _WIN32
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+        error = "cannot initialize Winsock";
+        return false;
+    }
+    struct WinsockCleanup {
+        ~WinsockCleanup() { WSACleanup(); }
+    } winsockCleanup;
+#endif
+
+    Socket listener(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+    if (!listener.Valid()) {
+        error = SocketMessage("cannot create socket");
+        return false;
+    }
+    const int reuse = 1;
+    setsockopt(listener.Get(), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    // Only the local machine can connect: the server hands out file paths and has no authentication.
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener.Get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        error = SocketMessage(("cannot listen on port " + std::to_string(port)).c_str());
+        return false;
+    }
+    if (listen(listener.Get(), SOMAXCONN) != 0) {
+        error = SocketMessage("cannot listen");
+        return false;
+    }
+
+    // Every client has its own thread, so one that sits idle does not hold up the others.
+    struct Connection {
+        std::thread thread;
+        std::atomic<bool> done{ false };
+    };
+    std::list<Connection> connections;
+    std::mutex handlerMutex;
+    auto joinFinished = [&](bool all) {
+        for (auto it = connections.begin(); it != connections.end();) {
+            if (all || it->done.load()) {
+                it->thread.join();
+                it = connections.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    };
+
+    while (!stop) {
+        const bool readable = WaitReadable(listener.Get());
+        joinFinished(false);
+        if (!readable) {
+            continue;
+        }
+        auto client = std::make_unique<Socket>(accept(listener.Get(), nullptr, nullptr));
+        if (!client->Valid()) {
+            continue;
+        }
+        if (connections.size() >= kMaxClients) {
+            LogLine(LogLevel::Warning) << "Warning: Turning away a client; " << kMaxClients << " are already connected.";
+            continue;
+        }
+        LogLine(LogLevel::Debug) << "[DEBUG] Client connected";
+        Connection& connection = connections.emplace_back();
+        connection.thread = std::thread([&handler, &handlerMutex, &stop, &connection, client = std::move(client)] {
+            ServeClient(client->Get(), handler, handlerMutex, stop);
+            LogLine(LogLevel::Debug) << "[DEBUG] Client disconnected";
+            connection.done = true;
+        });
+    }
+    // Clients notice the stop flag within one poll interval.
+    joinFinished(true);
+    return true;
+}
@@ -0,0 +1,29 @@
+// Line-based query server on a loopback TCP port, for /serve.
+// A client sends one query per line, the keywords of a query separated by tabs, and ends a batch
+// with an empty line. The whole batch is handed to the handler at once, so every query in it is
+// answered by the same pass over the data. The answers come back in the order of the queries,
+// each one as "keyword<TAB>path" lines, the format of /format tsv, ended by an empty line. A
+// client may send any number of batches before closing the connection. Clients are served side by
+// side; one that stays silent for five minutes, or sends an overlong line or batch, is dropped.
+
+#pragma once
+
+#include <csignal>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+using Query = std::vector<std::string>;
+
+// Fills answers[i] with the records answering queries[i]. Returns false, with the reason in error,
+// if the batch cannot be answered; every query of the batch then gets an "ERROR<TAB>reason" line.
+using BatchHandler = std::function<bool(const std::vector<Query>& queries, std::vector<std::string>& answers,
+    std::string& error)>;
+
+// Listens on 127.0.0.1 at the given port and serves each client on its own thread until stop
+// becomes non-zero. The handler is called for one batch at a time. Returns false, with the reason
+// in error, if the port cannot be opened.
+bool RunQueryServer(uint16_t port, const BatchHandler& handler, const volatile std::sig_atomic_t& stop,
+    std::string& error);
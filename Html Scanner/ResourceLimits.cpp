@@ -0,0 +1,151 @@
+#include "ResourceLimits.h"
+
+#include <thread>
+
+
+namespace {
+
+    // Reads after a quiet spell may get this far ahead of the rate before anyone sleeps.
+    constexpr std::chrono::milliseconds kIoBurst{ 100 };
+
+    uint64_t NanosecondsSince(std::chrono::steady_clock::time_point start) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+}
+
+bool ParseByteSize(const std::string& text, uint64_t& bytes)
+{
+    size_t digits = 0;
+    uint64_t value = 0;
+    for (; digits < text.size() && text[digits] >= '0' && text[digits] <= '9'; ++digits) {
+        if (value > (UINT64_MAX - 9) / 10) {
+            return false;
+        }
+        value = value * 10 + static_cast<uint64_t>(text[digits] - '0');
+    }
+    if (digits == 0 || value == 0 || text.size() > digits + 1) {
+        return false;
+    }
+
+    unsigned shift = 20;
+    if (digits < text.size()) {
+        switch (text[digits]) {
+        case 'k': case 'K': shift = 10; break;
+        case 'm': case 'M': shift = 20; break;
+        case 'g': case 'G': shift = 30; break;
+        default: return false;
+        }
+    }
+    if (value > (UINT64_MAX >> shift)) {
+        return false;
+    }
+    bytes = value << shift;
+    return true;
+}
+
+void MemoryBudget::Acquire(uint64_t bytes)
+{
+    if (m_limit == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const auto fits = [&] { return m_working == 0 || m_working + m_held + bytes <= m_limit; };
+    if (!fits()) {
+        const auto start = std::chrono::steady_clock::now();
+        m_released.wait(lock, fits);
+        m_waitNanoseconds.fetch_add(NanosecondsSince(start));
+    }
+    m_working += bytes;
+}
+
+void MemoryBudget::Release(uint64_t bytes)
+{
+    if (m_limit == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_working -= bytes;
+    }
+    m_released.notify_all();
+}
+
+void MemoryBudget::Hold(uint64_t bytes)
+{
+    if (m_limit == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_held += bytes;
+}
+
+bool MemoryBudget::Overrun() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_held > m_limit && m_limit != 0;
+}
+
+void OpenFileLimit::Acquire()
+{
+    if (m_limit == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_open >= m_limit) {
+        const auto start = std::chrono::steady_clock::now();
+        m_released.wait(lock, [this] { return m_open < m_limit; });
+        m_waitNanoseconds.fetch_add(NanosecondsSince(start));
+    }
+    ++m_open;
+}
+
+bool OpenFileLimit::TryAcquire()
+{
+    if (m_limit == 0) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_open >= m_limit) {
+        return false;
+    }
+    ++m_open;
+    return true;
+}
+
+void OpenFileLimit::Release()
+{
+    if (m_limit == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_open;
+    }
+    m_released.notify_one();
+}
+
+void IoRateLimit::Consume(uint64_t bytes)
+{
+    if (m_bytesPerSecond == 0 || bytes == 0) {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    const auto cost = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(bytes) / static_cast<double>(m_bytesPerSecond)));
+    std::chrono::steady_clock::time_point due;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Time the scan spent reading less than the rate allows is only banked up to the burst.
+        if (m_due < now - kIoBurst) {
+            m_due = now - kIoBurst;
+        }
+        m_due += cost;
+        due = m_due;
+    }
+    if (due > now) {
+        std::this_thread::sleep_until(due);
+        m_waitNanoseconds.fetch_add(NanosecondsSince(now));
+    }
+}
@@ -0,0 +1,125 @@
+// Limits on what a scan may take from a host it shares with other work: /maxmem, /maxopen and /iorate.
+// Each limit is a gate the scanning threads pass before they take more of the resource. A thread
+// that finds a limit reached waits for the others to give some back, or for the read rate to drop
+// back under the cap, rather than failing, so the scan slows down to what the limits allow instead
+// of competing with everything else on the host. A limit of 0 means unlimited, and passing an
+// unlimited gate costs a branch.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+
+// Parses a /maxmem or /iorate value: a whole number with an optional K, M or G suffix for KiB, MiB
+// or GiB. A bare number is taken as MiB. Returns false for anything else, or for 0.
+bool ParseByteSize(const std::string& text, uint64_t& bytes);
+
+// Memory the scan may hold at once, in two kinds. Working memory, such as the buffer a file is read
+// into, is given back once the file is done; a thread that needs more than is left waits until
+// enough has been given back. Held memory, such as the results kept for the report, stays until the
+// scan ends and never waits, but leaves less room for working memory, so fewer files are read at
+// once as the results pile up. Working memory is always granted when none is taken, so a file
+// bigger than the whole budget is still scanned, just on its own.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(uint64_t limitBytes = 0) : m_limit(limitBytes) {}
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    bool Limited() const { return m_limit != 0; }
+    uint64_t Limit() const { return m_limit; }
+
+    void Acquire(uint64_t bytes);
+    void Release(uint64_t bytes);
+
+    // Charges held memory.
+    void Hold(uint64_t bytes);
+
+    // True if held memory alone has gone over the limit. Working memory is then granted to one
+    // file at a time.
+    bool Overrun() const;
+
+    double WaitSeconds() const { return static_cast<double>(m_waitNanoseconds.load()) / 1e9; }
+
+private:
+    const uint64_t m_limit;
+    uint64_t m_working = 0;
+    uint64_t m_held = 0;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_released;
+    std::atomic<uint64_t> m_waitNanoseconds{ 0 };
+};
+
+// Files the scan may have open for reading at once. Directories being listed are not counted.
+class OpenFileLimit {
+public:
+    explicit OpenFileLimit(size_t limit = 0) : m_limit(limit) {}
+
+    OpenFileLimit(const OpenFileLimit&) = delete;
+    OpenFileLimit& operator=(const OpenFileLimit&) = delete;
+
+    bool Limited() const { return m_limit != 0; }
+
+    // Waits until a file may be opened. Every Acquire or successful TryAcquire is given back with
+    // Release once the file is closed.
+    void Acquire();
+    // Takes a file without waiting, if one is free right now.
+    bool TryAcquire();
+    void Release();
+
+    double WaitSeconds() const { return static_cast<double>(m_waitNanoseconds.load()) / 1e9; }
+
+private:
+    const size_t m_limit;
+    size_t m_open = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+    std::atomic<uint64_t> m_waitNanoseconds{ 0 };
+};
+
+// Bytes per second the scan may read, over all of its threads together.
+class IoRateLimit {
+public:
+    explicit IoRateLimit(uint64_t bytesPerSecond = 0) : m_bytesPerSecond(bytesPerSecond) {}
+
+    IoRateLimit(const IoRateLimit&) = delete;
+    IoRateLimit& operator=(const IoRateLimit&) = delete;
+
+    bool Limited() const { return m_bytesPerSecond != 0; }
+
+    // Accounts for bytes just read and, if the reads so far are ahead of the rate, sleeps until they
+    // are back on it. The further ahead the scan is, the longer each thread sleeps. Reads after a
+    // quiet spell may run up to a tenth of a second's worth ahead, so short bursts are not slowed.
+    void Consume(uint64_t bytes);
+
+    double WaitSeconds() const { return static_cast<double>(m_waitNanoseconds.load()) / 1e9; }
+
+private:
+    const uint64_t m_bytesPerSecond;
+    // When the bytes read so far are paid for at the rate.
+    std::chrono::steady_clock::time_point m_due{};
+    std::mutex m_mutex;
+    std::atomic<uint64_t> m_waitNanoseconds{ 0 };
+};
+
+// The limits of one scan, shared by every thread that reads files for it.
+struct ResourceLimits {
+    ResourceLimits(uint64_t maxMemoryBytes, size_t maxOpenFiles, uint64_t maxBytesPerSecond)
+        : memory(maxMemoryBytes), openFiles(maxOpenFiles), ioRate(maxBytesPerSecond) {}
+
+    bool Any() const { return memory.Limited() || openFiles.Limited() || ioRate.Limited(); }
+
+    // Time threads have spent waiting on any of the limits, summed over the threads.
+    double WaitSeconds() const { return memory.WaitSeconds() + openFiles.WaitSeconds() + ioRate.WaitSeconds(); }
+
+    MemoryBudget memory;
+    OpenFileLimit openFiles;
+    IoRateLimit ioRate;
+};
@@ -0,0 +1,83 @@
+#include "ScanCorpus.h"
+
+#include "DirectoryWalker.h"
+#include "KeywordSearch.h"
+
+#include <algorithm>
+#include <utility>
+
+
+ScanCorpus::ScanCorpus(size_t threadCount, ReadMode readMode, ScanScope scope, MatchMode matchMode)
+    : m_pool(threadCount)
+    , m_readMode(readMode)
+    , m_scope(scope)
+    , m_matchMode(matchMode)
+{
+}
+
+void ScanCorpus::Load(const std::filesystem::path& root, const FileFilter& filter,
+    const std::function<void(const std::string& message)>& walkFailed,
+    const std::function<void(const std::filesystem::path& filePath)>& openFailed)
+{
+    PathTable candidates;
+    WalkHtmlFiles(root, m_pool.ThreadCount(), filter,
+        [&](const std::filesystem::path& filePath) { candidates.Add(filePath); }, walkFailed);
+
+    std::vector<std::vector<char>> contents(candidates.Size());
+    std::vector<TextEncoding> encodings(candidates.Size(), TextEncoding::Utf8);
+    std::vector<char> loaded(candidates.Size(), 0);
+    std::vector<ScanContext> workerContexts(m_pool.ThreadCount());
+    for (FileId fileId = 0; fileId < candidates.Size(); ++fileId) {
+        m_pool.Submit([&, fileId](size_t workerIndex) {
+            loaded[fileId] = LoadFileContent(candidates.Path(fileId), m_scope, workerContexts[workerIndex],
+                contents[fileId], encodings[fileId]);
+        });
+    }
+    m_pool.Wait();
+
+    // Files that could not be read are dropped here, so the IDs of the corpus stay dense.
+    for (FileId fileId = 0; fileId < candidates.Size(); ++fileId) {
+        if (!loaded[fileId]) {
+            openFailed(candidates.Path(fileId));
+            continue;
+        }
+        m_paths.Add(candidates.Path(fileId));
+        m_contentBytes += contents[fileId].size();
+        m_contents.push_back(std::move(contents[fileId]));
+        m_encodings.push_back(encodings[fileId]);
+    }
+}
+
+void ScanCorpus::Match(const std::vector<std::string>& keywords, std::vector<std::vector<FileId>>& filesByKeyword)
+{
+    filesByKeyword.assign(keywords.size(), {});
+    if (keywords.empty()) {
+        return;
+    }
+
+    const KeywordSearch matcher(keywords, m_matchMode);
+    std::vector<KeywordHits> workerHits(m_pool.ThreadCount());
+    std::vector<std::vector<std::pair<FileId, uint32_t>>> workerResults(m_pool.ThreadCount());
+    for (FileId fileId = 0; fileId < m_contents.size(); ++fileId) {
+        m_pool.Submit([&, fileId](size_t workerIndex) {
+            KeywordHits& hits = workerHits[workerIndex];
+            hits.Reset(keywords.size());
+            ScanBuffer(m_contents[fileId].data(), m_contents[fileId].size(), matcher.ForEncoding(m_encodings[fileId]),
+                m_readMode, hits);
+            hits.ForEach([&](size_t keywordIndex) {
+                workerResults[workerIndex].emplace_back(fileId, static_cast<uint32_t>(keywordIndex));
+            });
+        });
+    }
+    m_pool.Wait();
+
+    // Every file was matched by exactly one worker, so sorting by file puts each list in ID order.
+    std::vector<std::pair<FileId, uint32_t>> allResults;
+    for (const auto& results : workerResults) {
+        allResults.insert(allResults.end(), results.begin(), results.end());
+    }
+    std::sort(allResults.begin(), allResults.end());
+    for (const auto& result : allResults) {
+        filesByKeyword[result.second].push_back(result.first);
+    }
+}
@@ -0,0 +1,51 @@
+// The scanned files of a directory tree held in memory, for /serve.
+// The tree is walked and every file read once, up front, in the form the matcher sees it. After
+// that, any number of keyword lists can be matched against the corpus without touching the disk.
+
+#pragma once
+
+#include "FileFilter.h"
+#include "PathTable.h"
+#include "Scanner.h"
+#include "WorkStealingPool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+class ScanCorpus {
+public:
+    // Matching runs on threadCount workers, reading keywords as matchMode says.
+    ScanCorpus(size_t threadCount, ReadMode readMode, ScanScope scope, MatchMode matchMode);
+
+    // Walks root and reads every file the filter accepts. Call it once, before matching.
+    // Directories that cannot be listed go to walkFailed and files that cannot be read to
+    // openFailed; both are left out of the corpus.
+    void Load(const std::filesystem::path& root, const FileFilter& filter,
+        const std::function<void(const std::string& message)>& walkFailed,
+        const std::function<void(const std::filesystem::path& filePath)>& openFailed);
+
+    // Matches every file once against all of keywords together. filesByKeyword[i] receives the IDs
+    // of the files that contain keywords[i], in ascending order. Patterns must have passed
+    // PatternSearch::Check.
+    void Match(const std::vector<std::string>& keywords, std::vector<std::vector<FileId>>& filesByKeyword);
+
+    const PathTable& Paths() const { return m_paths; }
+    size_t FileCount() const { return m_paths.Size(); }
+    uint64_t ContentBytes() const { return m_contentBytes; }
+
+private:
+    WorkStealingPool m_pool;
+    ReadMode m_readMode;
+    ScanScope m_scope;
+    MatchMode m_matchMode;
+    PathTable m_paths;
+    // Indexed by FileId.
+    std::vector<std::vector<char>> m_contents;
+    std::vector<TextEncoding> m_encodings;
+    uint64_t m_contentBytes = 0;
+};
@@ -0,0 +1,189 @@
+#include "ScanIndex.h"
+
+#include <algorithm>
+#include <fstream>
+
+
+namespace {
+
+    // "HSIX" followed by the format version. Bump the version whenever the layout changes.
+    constexpr char kIndexMagic[4] = { 'H', 'S', 'I', 'X' };
+    constexpr uint32_t kIndexVersion = 1;
+
+    // Integers are stored in the byte order of the machine that wrote the index.
+    // The index is a local cache, not an interchange format, so this is never a problem in practice.
+    template <typename T>
+    void WriteValue(std::ostream& stream, T value) {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void WriteString(std::ostream& stream, const std::string& value) {
+        WriteValue(stream, static_cast<uint32_t>(value.size()));
+        stream.write(value.data(), static_cast<std::streamsize>(value.size()));
+    }
+
+    // Reads an index file, keeping count of the bytes left in it so that no length or count read
+    // from a damaged file can make it allocate more than the file could possibly hold.
+    class IndexReader {
+    public:
+        IndexReader(std::istream& stream, uint64_t size) : m_stream(stream), m_remaining(size) {}
+
+        template <typename T>
+        bool ReadValue(T& value) {
+            return Take(sizeof(value)) && m_stream.read(reinterpret_cast<char*>(&value), sizeof(value));
+        }
+
+        bool ReadString(std::string& value) {
+            uint32_t length = 0;
+            if (!ReadValue(length) || !Take(length)) {
+                return false;
+            }
+            value.resize(length);
+            return static_cast<bool>(m_stream.read(value.data(), length));
+        }
+
+        // True if count items of itemSize bytes each could still follow.
+        bool Fits(uint64_t count, uint64_t itemSize) const { return count <= m_remaining / itemSize; }
+
+    private:
+        bool Take(uint64_t bytes) {
+            if (bytes > m_remaining) {
+                return false;
+            }
+            m_remaining -= bytes;
+            return true;
+        }
+
+        std::istream& m_stream;
+        uint64_t m_remaining;
+    };
+
+}
+
+ScanIndex::ScanIndex(std::string configSignature, size_t keywordCount)
+    : m_configSignature(std::move(configSignature))
+    , m_keywordCount(keywordCount)
+{
+}
+
+bool ScanIndex::Load(const std::filesystem::path& indexPath)
+{
+    m_entries.clear();
+
+    std::ifstream stream(indexPath, std::ios::binary);
+    if (!stream.is_open()) {
+        return false;
+    }
+    std::error_code error;
+    const uint64_t fileSize = std::filesystem::file_size(indexPath, error);
+    if (error) {
+        return false;
+    }
+    IndexReader reader(stream, fileSize);
+
+    char magic[sizeof(kIndexMagic)];
+    uint32_t version = 0;
+    std::string signature;
+    uint64_t entryCount = 0;
+    if (!reader.ReadValue(magic) || !std::equal(magic, magic + sizeof(magic), kIndexMagic) ||
+        !reader.ReadValue(version) || version != kIndexVersion ||
+        !reader.ReadString(signature) || signature != m_configSignature ||
+        !reader.ReadValue(entryCount)) {
+        return false;
+    }
+
+    std::string filePath;
+    for (uint64_t i = 0; i < entryCount; ++i) {
+        IndexEntry entry;
+        uint32_t hitCount = 0;
+        bool valid = reader.ReadString(filePath) &&
+            reader.ReadValue(entry.fileSize) &&
+            reader.ReadValue(entry.modifiedTime) &&
+            reader.ReadValue(entry.contentHash) &&
+            reader.ReadValue(hitCount) &&
+            reader.Fits(hitCount, sizeof(uint32_t));
+        if (valid) {
+            entry.keywordIndices.resize(hitCount);
+            for (uint32_t& keywordIndex : entry.keywordIndices) {
+                if (!reader.ReadValue(keywordIndex) || keywordIndex >= m_keywordCount) {
+                    valid = false;
+                    break;
+                }
+            }
+        }
+        if (!valid) {
+            m_entries.clear();
+            return false;
+        }
+        m_entries[filePath] = std::move(entry);
+    }
+    return true;
+}
+
+bool ScanIndex::Save(const std::filesystem::path& indexPath) const
+{
+    // Write to a temporary file first so a failed run never leaves a truncated index behind.
+    std::filesystem::path temporaryPath = indexPath;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!stream.is_open()) {
+            return false;
+        }
+
+        stream.write(kIndexMagic, sizeof(kIndexMagic));
+        WriteValue(stream, kIndexVersion);
+        WriteString(stream, m_configSignature);
+        WriteValue(stream, static_cast<uint64_t>(m_entries.size()));
+
+        for (const auto& pair : m_entries) {
+            const IndexEntry& entry = pair.second;
+            WriteString(stream, pair.first);
+            WriteValue(stream, entry.fileSize);
+            WriteValue(stream, entry.modifiedTime);
+            WriteValue(stream, entry.contentHash);
+            WriteValue(stream, static_cast<uint32_t>(entry.keywordIndices.size()));
+            for (uint32_t keywordIndex : entry.keywordIndices) {
+                WriteValue(stream, keywordIndex);
+            }
+        }
+
+        if (!stream.flush()) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, indexPath, error);
+    return !error;
+}
+
+const IndexEntry* ScanIndex::Find(const std::string& filePath) const
+{
+    auto it = m_entries.find(filePath);
+    return it == m_entries.end() ? nullptr : &it->second;
+}
+
+void ScanIndex::Set(const std::string& filePath, IndexEntry entry)
+{
+    m_entries[filePath] = std::move(entry);
+}
+
+uint64_t HashContent(const char* data, size_t size, uint64_t seed)
+{
+    constexpr uint64_t kPrime = 1099511628211ull;
+    uint64_t hash = seed;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= kPrime;
+    }
+    return hash;
+}
+
+int64_t FileModifiedTime(const std::filesystem::path& filePath)
+{
+    std::error_code error;
+    const auto modifiedTime = std::filesystem::last_write_time(filePath, error);
+    return error ? 0 : static_cast<int64_t>(modifiedTime.time_since_epoch().count());
+}
@@ -0,0 +1,60 @@
+// Persistent record of the previous scan, used to skip files that have not changed.
+// For every scanned file the index stores its size, modification time, content hash and the
+// keywords it matched. The index is only reused when it was built with the same keyword list
+// and read mode; otherwise it starts out empty and is rebuilt from scratch. A file that is
+// truncated or corrupt counts as no index at all.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+struct IndexEntry {
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+    uint64_t contentHash = 0;
+    // Indices into the keyword list the index was built with.
+    std::vector<uint32_t> keywordIndices;
+};
+
+class ScanIndex {
+public:
+    // configSignature identifies everything besides file contents that affects the hits,
+    // such as the keywords and the read mode. Entries recorded under a different signature are ignored.
+    // keywordCount is the length of the keyword list every stored keyword index refers to.
+    ScanIndex(std::string configSignature, size_t keywordCount);
+
+    // Loads the index from disk. Returns false if the file is missing, unreadable, damaged or was
+    // built with a different configuration; the index is left empty in that case.
+    bool Load(const std::filesystem::path& indexPath);
+
+    // Writes the index to disk, replacing the previous file. Returns false on I/O errors.
+    bool Save(const std::filesystem::path& indexPath) const;
+
+    // Returns the entry recorded for the path, or nullptr if there is none.
+    const IndexEntry* Find(const std::string& filePath) const;
+
+    void Set(const std::string& filePath, IndexEntry entry);
+
+    // Drops every entry, e.g. before recording the results of a new scan.
+    void Clear() { m_entries.clear(); }
+
+    size_t Size() const { return m_entries.size(); }
+
+private:
+    std::string m_configSignature;
+    size_t m_keywordCount;
+    std::unordered_map<std::string, IndexEntry> m_entries;
+};
+
+// 64-bit FNV-1a hash of a buffer. Pass the previous result as seed to hash data in pieces.
+uint64_t HashContent(const char* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+// Modification time of a file in the file clock's native ticks, or 0 if it cannot be read, as
+// when the file has just been removed.
+int64_t FileModifiedTime(const std::filesystem::path& filePath);
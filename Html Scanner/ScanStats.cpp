@@ -0,0 +1,119 @@
+#include "ScanStats.h"
+
+#include "Log.h"
+
+#include <cstdio>
+#include <fstream>
+
+
+namespace {
+
+    double Milliseconds(double seconds) {
+        return seconds * 1000.0;
+    }
+
+    double Mebibytes(uint64_t bytes) {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
+    }
+
+    std::string JsonString(const std::string& text) {
+        std::string quoted = "\"";
+        for (unsigned char c : text) {
+            switch (c) {
+            case '"': quoted += "\\\""; break;
+            case '\\': quoted += "\\\\"; break;
+            case '\n': quoted += "\\n"; break;
+            case '\r': quoted += "\\r"; break;
+            case '\t': quoted += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    quoted += escaped;
+                }
+                else {
+                    quoted += static_cast<char>(c);
+                }
+            }
+        }
+        quoted += '"';
+        return quoted;
+    }
+
+}
+
+void LogScanStats(const ScanStats& stats)
+{
+    if (!LogEnabled(LogLevel::Debug)) {
+        return;
+    }
+
+    LogLine(LogLevel::Debug) << "[DEBUG] Directories listed: " << stats.directoriesListed
+        << ", files seen: " << stats.filesSeen
+        << ", skipped by extension: " << stats.filesSkippedByExtension
+        << ", excluded: " << stats.filesExcluded << " files and " << stats.directoriesExcluded << " directories"
+        << ", in other shards: " << stats.filesInOtherShards
+        << ", candidates: " << stats.candidateFiles;
+    LogLine(LogLevel::Debug) << "[DEBUG] Files matched: " << stats.filesMatched
+        << " (" << stats.keywordHits << " keyword hits), opens failed: " << stats.opensFailed
+        << ", reused from index: " << stats.filesReusedFromIndex;
+    LogLine(LogLevel::Debug) << "[DEBUG] Bytes read: " << Mebibytes(stats.bytesRead) << " MiB ("
+        << (stats.scanSeconds > 0.0 ? Mebibytes(stats.bytesRead) / stats.scanSeconds : 0.0) << " MiB/s during the scan)"
+        << ", waiting on resource limits: " << Milliseconds(stats.limitWaitSeconds) << " ms";
+    LogLine(LogLevel::Debug) << "[DEBUG] Phases (ms): enumeration " << Milliseconds(stats.enumerationSeconds)
+        << ", scan " << Milliseconds(stats.scanSeconds)
+        << ", merge " << Milliseconds(stats.mergeSeconds)
+        << ", index " << Milliseconds(stats.indexSeconds)
+        << ", output " << Milliseconds(stats.outputSeconds)
+        << ", total " << Milliseconds(stats.totalSeconds);
+    for (size_t i = 0; i < stats.threads.size(); ++i) {
+        const ThreadTime& thread = stats.threads[i];
+        LogLine(LogLevel::Debug) << "[DEBUG] Thread " << i << " (" << thread.role << "): busy "
+            << Milliseconds(thread.busySeconds) << " ms, idle " << Milliseconds(thread.idleSeconds) << " ms";
+    }
+}
+
+bool WriteScanStatsJson(const std::filesystem::path& outputPath, const std::string& rootDirectory, const ScanStats& stats)
+{
+    std::ofstream output(outputPath);
+    if (!output.is_open()) {
+        return false;
+    }
+
+    output << "{\n";
+    output << "  \"directory\": " << JsonString(rootDirectory) << ",\n";
+    output << "  \"directoriesListed\": " << stats.directoriesListed << ",\n";
+    output << "  \"filesSeen\": " << stats.filesSeen << ",\n";
+    output << "  \"filesSkippedByExtension\": " << stats.filesSkippedByExtension << ",\n";
+    output << "  \"filesExcluded\": " << stats.filesExcluded << ",\n";
+    output << "  \"directoriesExcluded\": " << stats.directoriesExcluded << ",\n";
+    output << "  \"filesInOtherShards\": " << stats.filesInOtherShards << ",\n";
+    output << "  \"candidateFiles\": " << stats.candidateFiles << ",\n";
+    output << "  \"opensFailed\": " << stats.opensFailed << ",\n";
+    output << "  \"filesReusedFromIndex\": " << stats.filesReusedFromIndex << ",\n";
+    output << "  \"filesMatched\": " << stats.filesMatched << ",\n";
+    output << "  \"keywordHits\": " << stats.keywordHits << ",\n";
+    output << "  \"bytesRead\": " << stats.bytesRead << ",\n";
+    output << "  \"limitWaitSeconds\": " << stats.limitWaitSeconds << ",\n";
+    output << "  \"seconds\": {\n";
+    output << "    \"enumeration\": " << stats.enumerationSeconds << ",\n";
+    output << "    \"scan\": " << stats.scanSeconds << ",\n";
+    output << "    \"merge\": " << stats.mergeSeconds << ",\n";
+    output << "    \"index\": " << stats.indexSeconds << ",\n";
+    output << "    \"output\": " << stats.outputSeconds << ",\n";
+    output << "    \"total\": " << stats.totalSeconds << "\n";
+    output << "  },\n";
+    output << "  \"threads\": [";
+    for (size_t i = 0; i < stats.threads.size(); ++i) {
+        const ThreadTime& thread = stats.threads[i];
+        output << (i == 0 ? "\n" : ",\n");
+        output << "    { \"role\": " << JsonString(thread.role)
+            << ", \"busySeconds\": " << thread.busySeconds
+            << ", \"idleSeconds\": " << thread.idleSeconds << " }";
+    }
+    output << (stats.threads.empty() ? "]\n" : "\n  ]\n");
+    output << "}\n";
+
+    output.close();
+    return !output.fail();
+}
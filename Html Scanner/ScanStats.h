@@ -0,0 +1,71 @@
+// Counters and phase timings collected during a scan.
+// Shown as a summary with /v and written as a JSON document with /stats, so slow scans can be
+// traced to the phase responsible and scan performance can be tracked from run to run.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+// Measures wall-clock time from construction.
+class Stopwatch {
+public:
+    Stopwatch() : m_start(std::chrono::steady_clock::now()) {}
+
+    double Seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// How one thread spent its time during the scan phase.
+struct ThreadTime {
+    // "worker", "reader" or "matcher".
+    std::string role;
+    double busySeconds = 0.0;
+    double idleSeconds = 0.0;
+};
+
+struct ScanStats {
+    // Enumeration.
+    size_t directoriesListed = 0;
+    size_t filesSeen = 0;
+    size_t filesSkippedByExtension = 0;
+    size_t filesExcluded = 0;
+    size_t directoriesExcluded = 0;
+    size_t filesInOtherShards = 0;
+    size_t candidateFiles = 0;
+
+    // Scanning.
+    size_t opensFailed = 0;
+    size_t filesReusedFromIndex = 0;
+    size_t filesMatched = 0;
+    size_t keywordHits = 0;
+    uint64_t bytesRead = 0;
+    // Time threads spent waiting on /maxmem, /maxopen and /iorate, summed over the threads.
+    double limitWaitSeconds = 0.0;
+
+    // Phase times in seconds. With /pipeline, enumeration runs alongside the scan rather than
+    // before it.
+    double enumerationSeconds = 0.0;
+    double scanSeconds = 0.0;
+    double mergeSeconds = 0.0;
+    double indexSeconds = 0.0;
+    double outputSeconds = 0.0;
+    double totalSeconds = 0.0;
+
+    std::vector<ThreadTime> threads;
+};
+
+// Logs the statistics as a short summary at LogLevel::Debug.
+void LogScanStats(const ScanStats& stats);
+
+// Writes the statistics as a JSON object. Returns false if the file could not be written.
+bool WriteScanStatsJson(const std::filesystem::path& outputPath, const std::string& rootDirectory, const ScanStats& stats);
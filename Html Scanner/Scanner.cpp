@@ -0,0 +1,373 @@
+#include "Scanner.h"
+
+#include "Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+
+
+namespace {
+
+    // Size of the blocks files are read in when they are not memory-mapped.
+    constexpr size_t kReadBlockSize = 1 << 20;
+
+    // Matches a buffer of UTF-16 text, or part of it, with a search built for it. A keyword is only
+    // found by a match that starts at an even offset into the file; offset is where data starts.
+    void ScanCodeUnits(const char* data, size_t size, const KeywordSearch& matcher, ReadMode readMode,
+        KeywordHits& hits, uint64_t offset)
+    {
+        const auto scanPiece = [&](const char* piece, size_t pieceSize) {
+            const uint64_t pieceOffset = offset + static_cast<uint64_t>(piece - data);
+            const MatchFound found = [&](size_t keywordIndex, size_t end) {
+                if (!hits.Found(keywordIndex) && (pieceOffset + matcher.MatchStart(keywordIndex, piece, end)) % 2 == 0) {
+                    hits.Mark(keywordIndex);
+                }
+            };
+            if (const PatternSearch* patterns = matcher.Patterns()) {
+                PatternSearch::Cursor cursor;
+                patterns->FindAll(cursor, piece, pieceSize, found);
+            }
+            else {
+                matcher.FindAll(piece, pieceSize, found);
+            }
+        };
+
+        if (readMode == ReadMode::Mapped) {
+            scanPiece(data, size);
+            return;
+        }
+        const char* end = data + size;
+        for (const char* lineStart = data; lineStart < end && !hits.Complete();) {
+            const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', static_cast<size_t>(end - lineStart)));
+            if (lineEnd == nullptr) {
+                lineEnd = end;
+            }
+            scanPiece(lineStart, static_cast<size_t>(lineEnd - lineStart));
+            lineStart = lineEnd + 1;
+        }
+    }
+
+    // Holds the scan to the /iorate cap, if there is one, for bytes just read.
+    void ConsumeRead(const ScanContext& context, size_t bytes)
+    {
+        if (context.limits != nullptr) {
+            context.limits->ioRate.Consume(bytes);
+        }
+    }
+
+    // Every mode below stops reading as soon as all keywords have been seen, since the rest of the
+    // file cannot change the result.
+
+    // Reads large blocks, decompressed if need be, into a reusable buffer, filters each one down to
+    // the scope in place and feeds it to the streaming matcher, which finds the matches that span
+    // a block boundary. This reads every file in line mode, and in mapped mode those that are
+    // compressed, scoped or cannot be mapped. Neither the blocks nor the matcher allocate once the
+    // context has been used for a file. The encoding is sniffed from the first block.
+    bool ScanBlocks(const std::filesystem::path& filePath, const KeywordSearch& matcher, ReadMode readMode,
+        ScanScope scope, ScanContext& context)
+    {
+        BlockReader& reader = context.blockReader;
+        if (!reader.Open(filePath)) {
+            return false;
+        }
+
+        context.readBuffer.resize(kReadBlockSize);
+        char* buffer = context.readBuffer.data();
+        size_t bytesRead = reader.Read(buffer, kReadBlockSize);
+        ConsumeRead(context, bytesRead);
+        const TextEncoding encoding = SniffEncoding(buffer, bytesRead);
+        context.scopeFilter = HtmlScopeFilter(ScopeFor(encoding, scope));
+        KeywordMatcher& keywordMatcher = context.keywordMatcher;
+        keywordMatcher.Reset(matcher.ForEncoding(encoding), readMode == ReadMode::Lines, context.positions, context.countHits);
+        while (bytesRead > 0 && !keywordMatcher.Complete()) {
+            context.bytesRead += bytesRead;
+            keywordMatcher.Feed(buffer, context.scopeFilter.Filter(buffer, bytesRead, buffer));
+            if (keywordMatcher.Complete()) {
+                break;
+            }
+            bytesRead = reader.Read(buffer, kReadBlockSize);
+            ConsumeRead(context, bytesRead);
+        }
+        keywordMatcher.Finish();
+        context.hits = keywordMatcher.Hits();
+        if (context.countHits) {
+            context.counts = keywordMatcher.Counts();
+        }
+        reader.Close();
+        return true;
+    }
+
+    bool ScanMapped(const std::filesystem::path& filePath, const KeywordSearch& matcher, ScanContext& context)
+    {
+        if (!context.mappedFile.Open(filePath)) {
+            return ScanBlocks(filePath, matcher, ReadMode::Mapped, ScanScope::All, context);
+        }
+
+        // Zero-copy: the matcher reads the mapped pages directly. Pages past the point where the
+        // last keyword matched are never touched.
+        const char* data = context.mappedFile.Data();
+        const size_t size = context.mappedFile.Size();
+        ConsumeRead(context, size);
+        ScanBuffer(data, size, matcher.ForEncoding(SniffEncoding(data, size)), ReadMode::Mapped, context.hits);
+        context.bytesRead += context.mappedFile.Size();
+        context.mappedFile.Close();
+        return true;
+    }
+
+    // Loads a whole file for hashing: memory-mapped when possible, otherwise read into the context's
+    // buffer. The view stays valid until the mapping is closed or the buffer is reused.
+    bool LoadWholeFile(const std::filesystem::path& filePath, ScanContext& context, const char*& data, size_t& size)
+    {
+        if (context.mappedFile.Open(filePath)) {
+            data = context.mappedFile.Data();
+            size = context.mappedFile.Size();
+            return true;
+        }
+
+        std::ifstream fileStream(filePath, std::ios::binary);
+        if (!fileStream.is_open()) {
+            return false;
+        }
+        context.readBuffer.clear();
+        size_t filled = 0;
+        while (fileStream) {
+            context.readBuffer.resize(filled + kReadBlockSize);
+            fileStream.read(context.readBuffer.data() + filled, static_cast<std::streamsize>(kReadBlockSize));
+            filled += static_cast<size_t>(fileStream.gcount());
+        }
+        data = context.readBuffer.data();
+        size = filled;
+        return true;
+    }
+
+    // Gives back what a whole file took in the context's buffers, so that under a memory budget a
+    // worker keeps no more than a block between files.
+    void TrimBuffers(ScanContext& context)
+    {
+        for (std::vector<char>* buffer : { &context.readBuffer, &context.decompressedBuffer, &context.scopeBuffer }) {
+            if (buffer->capacity() > kReadBlockSize) {
+                std::vector<char>().swap(*buffer);
+            }
+        }
+    }
+
+    // The part of ScanFileIncremental that reads the file, once it is known to need reading.
+    bool HashAndScan(const std::filesystem::path& filePath, const KeywordSearch& matcher, ReadMode readMode,
+        ScanScope scope, const IndexEntry* cached, ScanContext& context, IndexEntry& entry, bool& reusedCache)
+    {
+        // The content hash needs every byte, so the whole file is loaded even if the keywords
+        // are all found early.
+        const char* data = nullptr;
+        size_t size = 0;
+        if (!LoadWholeFile(filePath, context, data, size)) {
+            return false;
+        }
+        ConsumeRead(context, size);
+        context.bytesRead += size;
+        entry.fileSize = size;
+        entry.contentHash = HashContent(data, size);
+        entry.keywordIndices.clear();
+
+        if (cached != nullptr && cached->fileSize == size && cached->contentHash == entry.contentHash) {
+            // Only the timestamp changed; keep the cached hits.
+            entry.keywordIndices = cached->keywordIndices;
+            reusedCache = true;
+        }
+        else {
+            const Compression compression = CompressionFromPath(filePath);
+            if (compression != Compression::None) {
+                // The hash covers the file as stored; the matcher sees it decompressed. A corrupt
+                // stream is matched as far as it could be decoded.
+                DecompressBuffer(compression, data, size, context.decompressedBuffer);
+                data = context.decompressedBuffer.data();
+                size = context.decompressedBuffer.size();
+            }
+            const TextEncoding encoding = SniffEncoding(data, size);
+            if (ScopeFor(encoding, scope) != ScanScope::All) {
+                // The file may be mapped read-only, so the in-scope bytes go to a buffer of their own.
+                context.scopeBuffer.resize(size);
+                context.scopeFilter = HtmlScopeFilter(scope);
+                size = context.scopeFilter.Filter(data, size, context.scopeBuffer.data());
+                data = context.scopeBuffer.data();
+            }
+            context.hits.Reset(matcher.KeywordCount());
+            ScanBuffer(data, size, matcher.ForEncoding(encoding), readMode, context.hits);
+            context.hits.ForEach([&](size_t keywordIndex) {
+                entry.keywordIndices.push_back(static_cast<uint32_t>(keywordIndex));
+            });
+        }
+
+        context.mappedFile.Close();
+        return true;
+    }
+
+}
+
+ScanScope ScopeFor(TextEncoding encoding, ScanScope scope)
+{
+    if (CodeUnitSize(encoding) == 1) {
+        return scope;
+    }
+    // Matching the whole page can find hits the scope was asked to leave out, so say so, once.
+    static std::atomic<bool> warned{ false };
+    if (scope != ScanScope::All && !warned.exchange(true)) {
+        LogLine(LogLevel::Warning) << "Warning: UTF-16 pages are matched in full; /scope " << ScanScopeName(scope)
+            << " only applies to pages in other encodings.";
+    }
+    return ScanScope::All;
+}
+
+void ScanBuffer(const char* data, size_t size, const KeywordSearch& matcher, ReadMode readMode, KeywordHits& hits,
+    uint64_t offset)
+{
+    if (matcher.CodeUnitSize() > 1) {
+        ScanCodeUnits(data, size, matcher, readMode, hits, offset);
+        return;
+    }
+
+    if (readMode == ReadMode::Mapped) {
+        matcher.Scan(data, size, hits);
+        return;
+    }
+
+    const char* end = data + size;
+    for (const char* lineStart = data; lineStart < end && !hits.Complete();) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', static_cast<size_t>(end - lineStart)));
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+        matcher.Scan(lineStart, static_cast<size_t>(lineEnd - lineStart), hits);
+        lineStart = lineEnd + 1;
+    }
+}
+
+bool ScanFile(const std::filesystem::path& filePath, const KeywordSearch& matcher,
+    ReadMode readMode, ScanScope scope, ScanContext& context)
+{
+    context.hits.Reset(matcher.KeywordCount());
+
+    const bool mapped = readMode == ReadMode::Mapped && scope == ScanScope::All
+        && CompressionFromPath(filePath) == Compression::None && context.positions == nullptr && !context.countHits;
+    ResourceLimits* limits = context.limits;
+    if (limits == nullptr) {
+        return mapped
+            ? ScanMapped(filePath, matcher, context)
+            : ScanBlocks(filePath, matcher, readMode, scope, context);
+    }
+
+    // A mapped file may end up wholly in memory; one read in blocks takes a block at a time. Memory
+    // is always taken before the open file, so no two threads wait on each other.
+    uint64_t workingBytes = kReadBlockSize;
+    if (mapped) {
+        std::error_code error;
+        const uint64_t fileSize = std::filesystem::file_size(filePath, error);
+        workingBytes = error ? kReadBlockSize : std::max<uint64_t>(fileSize, 1);
+    }
+    limits->memory.Acquire(workingBytes);
+    limits->openFiles.Acquire();
+    const bool scanned = mapped
+        ? ScanMapped(filePath, matcher, context)
+        : ScanBlocks(filePath, matcher, readMode, scope, context);
+    limits->openFiles.Release();
+    limits->memory.Release(workingBytes);
+    return scanned;
+}
+
+bool ScanFileIncremental(const std::filesystem::path& filePath, const KeywordSearch& matcher,
+    ReadMode readMode, ScanScope scope, const ScanIndex& previousIndex, ScanContext& context,
+    IndexEntry& entry, bool& reusedCache)
+{
+    reusedCache = false;
+
+    std::error_code error;
+    entry.fileSize = std::filesystem::file_size(filePath, error);
+    if (error) {
+        return false;
+    }
+    entry.modifiedTime = FileModifiedTime(filePath);
+
+    const IndexEntry* cached = previousIndex.Find(filePath.string());
+    if (cached != nullptr && cached->fileSize == entry.fileSize && cached->modifiedTime == entry.modifiedTime) {
+        entry = *cached;
+        reusedCache = true;
+        return true;
+    }
+
+    ResourceLimits* limits = context.limits;
+    if (limits == nullptr) {
+        return HashAndScan(filePath, matcher, readMode, scope, cached, context, entry, reusedCache);
+    }
+
+    // The whole file is in memory while it is hashed and matched, and once more if it is
+    // decompressed or reduced to the scope.
+    const uint64_t workingBytes = std::max<uint64_t>(entry.fileSize, 1) * (scope != ScanScope::All
+        || CompressionFromPath(filePath) != Compression::None ? 2 : 1);
+    limits->memory.Acquire(workingBytes);
+    limits->openFiles.Acquire();
+    const bool scanned = HashAndScan(filePath, matcher, readMode, scope, cached, context, entry, reusedCache);
+    limits->openFiles.Release();
+    if (limits->memory.Limited()) {
+        TrimBuffers(context);
+    }
+    limits->memory.Release(workingBytes);
+    return scanned;
+}
+
+bool LoadFileContent(const std::filesystem::path& filePath, ScanScope scope, ScanContext& context,
+    std::vector<char>& content, TextEncoding& encoding)
+{
+    const char* data = nullptr;
+    size_t size = 0;
+    if (!LoadWholeFile(filePath, context, data, size)) {
+        return false;
+    }
+    context.bytesRead += size;
+
+    const Compression compression = CompressionFromPath(filePath);
+    if (compression != Compression::None) {
+        DecompressBuffer(compression, data, size, context.decompressedBuffer);
+        data = context.decompressedBuffer.data();
+        size = context.decompressedBuffer.size();
+    }
+    encoding = SniffEncoding(data, size);
+    if (ScopeFor(encoding, scope) != ScanScope::All) {
+        content.resize(size);
+        context.scopeFilter = HtmlScopeFilter(scope);
+        content.resize(context.scopeFilter.Filter(data, size, content.data()));
+    }
+    else {
+        content.assign(data, data + size);
+    }
+
+    context.mappedFile.Close();
+    return true;
+}
+
+std::string IndexSignature(const std::vector<std::string>& keywords, ReadMode readMode, ScanScope scope,
+    MatchMode matchMode)
+{
+    // Length-prefix each keyword so that no two different keyword lists produce the same signature.
+    // Indexes written before scopes and patterns existed matched everything literally, so those
+    // defaults add nothing.
+    std::string signature = (readMode == ReadMode::Mapped) ? "mapped" : "lines";
+    if (scope != ScanScope::All) {
+        signature += '+';
+        signature += ScanScopeName(scope);
+    }
+    if (matchMode != MatchMode::Literal) {
+        signature += '/';
+        signature += MatchModeName(matchMode);
+    }
+    // Hits cached before encodings were sniffed matched UTF-16 and Windows-1252 pages byte for
+    // byte, so those indexes must not be reused.
+    signature += "@encoded";
+    for (const auto& keyword : keywords) {
+        signature += ';';
+        signature += std::to_string(keyword.size());
+        signature += ':';
+        signature += keyword;
+    }
+    return signature;
+}
@@ -0,0 +1,97 @@
+// Per-file keyword scanning shared by the sequential and parallel scan paths.
+
+#pragma once
+
+#include "BlockReader.h"
+#include "HtmlScope.h"
+#include "KeywordHits.h"
+#include "KeywordMatcher.h"
+#include "KeywordSearch.h"
+#include "MappedFile.h"
+#include "MatchPositions.h"
+#include "PatternSearch.h"
+#include "ResourceLimits.h"
+#include "ScanIndex.h"
+#include "TextEncoding.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+// How file contents are handed to the matcher.
+enum class ReadMode {
+    // Read in blocks and matched one line at a time. Keywords never match across a newline.
+    Lines,
+    // The whole file is memory-mapped and matched in one pass, newlines included.
+    // Files that cannot be mapped are read in large blocks instead.
+    Mapped,
+};
+
+// Buffers reused from one file to the next. Each worker thread owns one, so scanning
+// never allocates in the hot loop and never shares mutable state between threads.
+struct ScanContext {
+    KeywordHits hits;
+    KeywordMatcher keywordMatcher;
+    std::vector<char> readBuffer;
+    BlockReader blockReader;
+    MappedFile mappedFile;
+    // The decompressed contents of a whole compressed file, for the incremental scan.
+    std::vector<char> decompressedBuffer;
+    HtmlScopeFilter scopeFilter;
+    // Holds the in-scope bytes of a whole file when the file itself cannot be filtered in place.
+    std::vector<char> scopeBuffer;
+    // Running total of file bytes read through this context, for the scan statistics.
+    uint64_t bytesRead = 0;
+    // With /positions, where this worker records its hits. Files are then always read in blocks.
+    PositionLog* positions = nullptr;
+    // With /count, every match is counted into counts, one entry per keyword, and files are read
+    // to the end in blocks.
+    bool countHits = false;
+    std::vector<uint32_t> counts;
+    // With /maxmem, /maxopen or /iorate, the limits every file scanned through this context is held
+    // to. Each file takes its working memory and an open file for as long as it is scanned.
+    ResourceLimits* limits = nullptr;
+};
+
+// The scope a file in encoding is matched in. The scope tokenizer reads ASCII-compatible text, so
+// UTF-16 pages are matched whole; the first such page with a narrower scope logs a warning.
+ScanScope ScopeFor(TextEncoding encoding, ScanScope scope);
+
+// Matches a buffer that holds all or part of a file. In line mode every line is matched on its
+// own, just as if it had been read with std::getline. matcher is the search for the file's
+// encoding; for UTF-16, offset is where data starts in the file, so that matches that do not
+// start on a code unit boundary can be told apart.
+void ScanBuffer(const char* data, size_t size, const KeywordSearch& matcher, ReadMode readMode, KeywordHits& hits,
+    uint64_t offset = 0);
+
+// Scans a single file and leaves the keywords it contains in context.hits. With a
+// scope other than ScanScope::All, only that part of the HTML is matched, and the file is read in
+// blocks that are filtered in place rather than memory-mapped. The same goes for compressed files,
+// which are decompressed block by block on the calling thread. The file's encoding is sniffed
+// from its start, and the keywords are matched as encoded for it.
+// Returns false if the file could not be opened.
+bool ScanFile(const std::filesystem::path& filePath, const KeywordSearch& matcher,
+    ReadMode readMode, ScanScope scope, ScanContext& context);
+
+// Scans a single file unless the previous index shows it is unchanged, and fills entry with the
+// file's metadata, content hash and keyword hits. A file whose size and modification time match
+// its cached entry is not opened at all; one whose timestamp changed but whose content hash still
+// matches is read and hashed but not matched. Sets reusedCache when the cached hits were kept.
+// Returns false if the file could not be read.
+bool ScanFileIncremental(const std::filesystem::path& filePath, const KeywordSearch& matcher,
+    ReadMode readMode, ScanScope scope, const ScanIndex& previousIndex, ScanContext& context,
+    IndexEntry& entry, bool& reusedCache);
+
+// Reads a whole file into content exactly as the matcher would see it: decompressed, and reduced
+// to the scope. For keeping files in memory to match them again and again, as /serve does. The
+// encoding sniffed from the file goes to encoding, since the reduced content may no longer show it.
+// Returns false if the file could not be read.
+bool LoadFileContent(const std::filesystem::path& filePath, ScanScope scope, ScanContext& context,
+    std::vector<char>& content, TextEncoding& encoding);
+
+// Builds the ScanIndex signature for a keyword list, read mode, scope and match mode, so a changed
+// configuration never reuses stale hits.
+std::string IndexSignature(const std::vector<std::string>& keywords, ReadMode readMode, ScanScope scope,
+    MatchMode matchMode);
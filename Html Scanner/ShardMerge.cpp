@@ -0,0 +1,131 @@
+#include "ShardMerge.h"
+
+#include "BinaryIndex.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+
+
+bool MergeShards(const std::vector<std::filesystem::path>& shardPaths, MergedResults& results, std::string& error)
+{
+    if (shardPaths.empty()) {
+        error = "no shard indexes were given";
+        return false;
+    }
+
+    std::vector<std::unique_ptr<BinaryIndexReader>> shards;
+    for (const auto& shardPath : shardPaths) {
+        auto shard = std::make_unique<BinaryIndexReader>();
+        if (!shard->Open(shardPath)) {
+            error = shardPath.string() + " is not a binary index";
+            return false;
+        }
+        shards.push_back(std::move(shard));
+    }
+
+    // Each shard of the split exactly once; anything else would drop or double-count files.
+    const uint32_t shardCount = shards.front()->ShardCount();
+    std::vector<bool> shardSeen(shardCount, false);
+    for (size_t i = 0; i < shards.size(); ++i) {
+        const BinaryIndexReader& shard = *shards[i];
+        if (shard.ShardCount() != shardCount) {
+            error = shardPaths[i].string() + " is shard " + std::to_string(shard.ShardIndex()) + "/" +
+                std::to_string(shard.ShardCount()) + ", but " + shardPaths.front().string() + " is one of " +
+                std::to_string(shardCount);
+            return false;
+        }
+        if (shardSeen[shard.ShardIndex()]) {
+            error = "shard " + std::to_string(shard.ShardIndex()) + "/" + std::to_string(shardCount) +
+                " is given more than once";
+            return false;
+        }
+        shardSeen[shard.ShardIndex()] = true;
+        // Keywords without hits are left out of an index, so only the signature shows that a shard
+        // searched for something else.
+        if (shard.Signature() != shards.front()->Signature()) {
+            error = shardPaths[i].string() + " was scanned with different keywords or options than " +
+                shardPaths.front().string();
+            return false;
+        }
+        if (shard.RootDirectory() != shards.front()->RootDirectory()) {
+            LogLine(LogLevel::Warning) << "Warning: " << shardPaths[i].string() << " was scanned from "
+                << shard.RootDirectory() << ", not " << shards.front()->RootDirectory();
+        }
+    }
+    const auto missing = std::find(shardSeen.begin(), shardSeen.end(), false);
+    if (missing != shardSeen.end()) {
+        error = "shard " + std::to_string(missing - shardSeen.begin()) + "/" + std::to_string(shardCount) + " is missing";
+        return false;
+    }
+
+    // Collect the keywords and paths of every shard, then number them in sorted order. The views
+    // point into the mapped indexes, so nothing is copied until the path table is built.
+    auto damaged = [&](size_t shardIndex) {
+        error = shardPaths[shardIndex].string() + " is damaged";
+        return false;
+    };
+    std::vector<std::string_view> paths;
+    std::vector<std::string_view> keywords;
+    // The paths of each shard, by its file IDs, for translating its posting lists.
+    std::vector<std::vector<std::string_view>> shardFilePaths(shards.size());
+    for (size_t i = 0; i < shards.size(); ++i) {
+        const BinaryIndexReader& shard = *shards[i];
+        for (uint32_t fileId = 0; fileId < shard.PathCount(); ++fileId) {
+            std::string_view path;
+            if (!shard.Path(fileId, path)) {
+                return damaged(i);
+            }
+            paths.push_back(path);
+            shardFilePaths[i].push_back(path);
+        }
+        for (size_t keywordIndex = 0; keywordIndex < shard.KeywordCount(); ++keywordIndex) {
+            std::string_view keyword;
+            if (!shard.Keyword(keywordIndex, keyword)) {
+                return damaged(i);
+            }
+            keywords.push_back(keyword);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+    std::sort(keywords.begin(), keywords.end());
+    keywords.erase(std::unique(keywords.begin(), keywords.end()), keywords.end());
+
+    results.rootDirectory = std::string(shards.front()->RootDirectory());
+    results.signature = std::string(shards.front()->Signature());
+    for (const auto& path : paths) {
+        results.paths.Add(std::filesystem::path(std::string(path)));
+    }
+    results.keywords.assign(keywords.begin(), keywords.end());
+    results.filesByKeyword.assign(keywords.size(), {});
+
+    // Translate each posting list into the merged numbering. Paths and keywords are sorted, so both
+    // lookups are binary searches.
+    std::vector<uint32_t> fileIds;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        const BinaryIndexReader& shard = *shards[i];
+        for (size_t keywordIndex = 0; keywordIndex < shard.KeywordCount(); ++keywordIndex) {
+            std::string_view keyword;
+            if (!shard.Keyword(keywordIndex, keyword) || !shard.Postings(keywordIndex, fileIds)) {
+                return damaged(i);
+            }
+            const size_t mergedKeyword = static_cast<size_t>(
+                std::lower_bound(keywords.begin(), keywords.end(), keyword) - keywords.begin());
+            std::vector<FileId>& files = results.filesByKeyword[mergedKeyword];
+            for (uint32_t fileId : fileIds) {
+                files.push_back(static_cast<FileId>(
+                    std::lower_bound(paths.begin(), paths.end(), shardFilePaths[i][fileId]) - paths.begin()));
+            }
+        }
+    }
+
+    // A file can only be in two shards if the same path was scanned twice, but keep the lists
+    // strictly ascending either way, as the report writers expect.
+    for (auto& files : results.filesByKeyword) {
+        std::sort(files.begin(), files.end());
+        files.erase(std::unique(files.begin(), files.end()), files.end());
+    }
+    return true;
+}
@@ -0,0 +1,33 @@
+// Combines the binary indexes written by the nodes of a sharded scan, for the merge subcommand.
+// Every node walks the same tree with /shard i/N and writes the files of its share with
+// /format bin; merging the N indexes gives the results of scanning the whole tree, without
+// reading any of the files again.
+
+#pragma once
+
+#include "PathTable.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+struct MergedResults {
+    // The root recorded by the first shard.
+    std::string rootDirectory;
+    // The keywords and options every shard was scanned with.
+    std::string signature;
+    // Every file with a hit in any shard, sorted by path. No walk order spans all the shards, so
+    // path order is the one that does not depend on how the tree was split.
+    PathTable paths;
+    // The union of the keywords of all shards, sorted.
+    std::vector<std::string> keywords;
+    // filesByKeyword[i] lists the files that contain keywords[i], in ascending order.
+    std::vector<std::vector<FileId>> filesByKeyword;
+};
+
+// Reads the indexes at shardPaths and combines them into results. The indexes must be the shards
+// of one split, each given once and none missing, and all scanned with the same keywords and
+// options. Returns false, with the reason in error, if an index cannot be read, the set is
+// incomplete or the shards come from different scans.
+bool MergeShards(const std::vector<std::filesystem::path>& shardPaths, MergedResults& results, std::string& error);
@@ -0,0 +1,236 @@
+#include "SimdSearch.h"
+
+#include "CaseFold.h"
+
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define HTMLSCANNER_SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define HTMLSCANNER_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(HTMLSCANNER_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define HTMLSCANNER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define HTMLSCANNER_TARGET_AVX2
+#endif
+
+
+namespace SimdSearch {
+
+    namespace {
+
+        bool IsAsciiLetter(unsigned char c) {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        }
+
+        // Setting bit 0x20 maps an ASCII letter to lowercase. Applying it to non-letter bytes
+        // can produce false candidates (such as '@' and '`'), but never misses a real match,
+        // and every candidate is verified against the folding table anyway.
+        unsigned char CaseMask(unsigned char c) {
+            return IsAsciiLetter(c) ? 0x20 : 0x00;
+        }
+
+        unsigned CountTrailingZeros(uint64_t value) {
+#ifdef _MSC_VER
+            unsigned long index;
+#if defined(_M_X64) || defined(_M_ARM64)
+            _BitScanForward64(&index, value);
+#else
+            if (!_BitScanForward(&index, static_cast<unsigned long>(value))) {
+                _BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+                index += 32;
+            }
+#endif
+            return static_cast<unsigned>(index);
+#else
+            return static_cast<unsigned>(__builtin_ctzll(value));
+#endif
+        }
+
+        // Checks the candidate at text + offset. The first and last bytes only passed the filter
+        // up to the 0x20 bit, so the whole needle is compared through the folding table.
+        bool Verify(const unsigned char* text, size_t offset, const unsigned char* needle, size_t needleSize) {
+            for (size_t i = 0; i < needleSize; ++i) {
+                if (CaseFold::Fold(text[offset + i]) != needle[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        size_t FindScalar(const unsigned char* text, size_t size, const unsigned char* needle, size_t needleSize, size_t start) {
+            for (size_t i = start; i + needleSize <= size; ++i) {
+                if (CaseFold::Fold(text[i]) == needle[0] && Verify(text, i, needle, needleSize)) {
+                    return i;
+                }
+            }
+            return npos;
+        }
+
+        using Kernel = size_t (*)(const unsigned char*, size_t, const unsigned char*, size_t);
+
+        constexpr size_t kScalarCutoff = 64;
+
+#ifdef HTMLSCANNER_SIMD_X86
+
+        size_t Sse2Kernel(const unsigned char* text, size_t size, const unsigned char* needle, size_t needleSize) {
+            constexpr size_t kWidth = 16;
+            const size_t lastOffset = needleSize - 1;
+            const __m128i first = _mm_set1_epi8(static_cast<char>(needle[0]));
+            const __m128i last = _mm_set1_epi8(static_cast<char>(needle[lastOffset]));
+            const __m128i firstMask = _mm_set1_epi8(static_cast<char>(CaseMask(needle[0])));
+            const __m128i lastMask = _mm_set1_epi8(static_cast<char>(CaseMask(needle[lastOffset])));
+
+            size_t i = 0;
+            for (; i + lastOffset + kWidth <= size; i += kWidth) {
+                const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+                const __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + lastOffset));
+                const __m128i eqFirst = _mm_cmpeq_epi8(first, _mm_or_si128(blockFirst, firstMask));
+                const __m128i eqLast = _mm_cmpeq_epi8(last, _mm_or_si128(blockLast, lastMask));
+                uint64_t candidates = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(eqFirst, eqLast)));
+                while (candidates != 0) {
+                    const size_t offset = i + CountTrailingZeros(candidates);
+                    if (Verify(text, offset, needle, needleSize)) {
+                        return offset;
+                    }
+                    candidates &= candidates - 1;
+                }
+            }
+            return FindScalar(text, size, needle, needleSize, i);
+        }
+
+        HTMLSCANNER_TARGET_AVX2
+        size_t Avx2Kernel(const unsigned char* text, size_t size, const unsigned char* needle, size_t needleSize) {
+            constexpr size_t kWidth = 32;
+            const size_t lastOffset = needleSize - 1;
+            const __m256i first = _mm256_set1_epi8(static_cast<char>(needle[0]));
+            const __m256i last = _mm256_set1_epi8(static_cast<char>(needle[lastOffset]));
+            const __m256i firstMask = _mm256_set1_epi8(static_cast<char>(CaseMask(needle[0])));
+            const __m256i lastMask = _mm256_set1_epi8(static_cast<char>(CaseMask(needle[lastOffset])));
+
+            size_t i = 0;
+            for (; i + lastOffset + kWidth <= size; i += kWidth) {
+                const __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+                const __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + lastOffset));
+                const __m256i eqFirst = _mm256_cmpeq_epi8(first, _mm256_or_si256(blockFirst, firstMask));
+                const __m256i eqLast = _mm256_cmpeq_epi8(last, _mm256_or_si256(blockLast, lastMask));
+                uint64_t candidates = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(eqFirst, eqLast)));
+                while (candidates != 0) {
+                    const size_t offset = i + CountTrailingZeros(candidates);
+                    if (Verify(text, offset, needle, needleSize)) {
+                        return offset;
+                    }
+                    candidates &= candidates - 1;
+                }
+            }
+            return FindScalar(text, size, needle, needleSize, i);
+        }
+
+        bool CpuSupportsAvx2() {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) {
+                return false;
+            }
+            // AVX2 needs both the CPU flag and OS support for saving the YMM registers.
+            __cpuid(info, 1);
+            const bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+            __cpuidex(info, 7, 0);
+            return osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+#endif
+
+#ifdef HTMLSCANNER_SIMD_NEON
+
+        size_t NeonKernel(const unsigned char* text, size_t size, const unsigned char* needle, size_t needleSize) {
+            constexpr size_t kWidth = 16;
+            const size_t lastOffset = needleSize - 1;
+            const uint8x16_t first = vdupq_n_u8(needle[0]);
+            const uint8x16_t last = vdupq_n_u8(needle[lastOffset]);
+            const uint8x16_t firstMask = vdupq_n_u8(CaseMask(needle[0]));
+            const uint8x16_t lastMask = vdupq_n_u8(CaseMask(needle[lastOffset]));
+
+            size_t i = 0;
+            for (; i + lastOffset + kWidth <= size; i += kWidth) {
+                const uint8x16_t eqFirst = vceqq_u8(first, vorrq_u8(vld1q_u8(text + i), firstMask));
+                const uint8x16_t eqLast = vceqq_u8(last, vorrq_u8(vld1q_u8(text + i + lastOffset), lastMask));
+                // NEON has no movemask; narrowing by 4 bits packs one nibble per byte into 64 bits.
+                const uint8x8_t packed = vshrn_n_u16(vreinterpretq_u16_u8(vandq_u8(eqFirst, eqLast)), 4);
+                uint64_t candidates = vget_lane_u64(vreinterpret_u64_u8(packed), 0);
+                while (candidates != 0) {
+                    const size_t offset = i + CountTrailingZeros(candidates) / 4;
+                    if (Verify(text, offset, needle, needleSize)) {
+                        return offset;
+                    }
+                    candidates &= ~(static_cast<uint64_t>(0xF) << ((offset - i) * 4));
+                }
+            }
+            return FindScalar(text, size, needle, needleSize, i);
+        }
+
+#endif
+
+        struct KernelChoice {
+            Kernel kernel;
+            const char* name;
+        };
+
+        KernelChoice SelectKernel() {
+#if defined(HTMLSCANNER_SIMD_X86)
+            if (CpuSupportsAvx2()) {
+                return { Avx2Kernel, "AVX2" };
+            }
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+            return { Sse2Kernel, "SSE2" };
+#else
+            return { nullptr, "scalar" };
+#endif
+#elif defined(HTMLSCANNER_SIMD_NEON)
+            return { NeonKernel, "NEON" };
+#else
+            return { nullptr, "scalar" };
+#endif
+        }
+
+        const KernelChoice& SelectedKernel() {
+            static const KernelChoice choice = SelectKernel();
+            return choice;
+        }
+
+    }
+
+    size_t FindFolded(const char* text, size_t size, const char* needle, size_t needleSize) {
+        if (needleSize == 0) {
+            return 0;
+        }
+        if (needleSize > size) {
+            return npos;
+        }
+
+        const unsigned char* textBytes = reinterpret_cast<const unsigned char*>(text);
+        const unsigned char* needleBytes = reinterpret_cast<const unsigned char*>(needle);
+        // Texts shorter than a couple of vectors are not worth the setup; short lines go straight to the scalar loop.
+        const Kernel kernel = SelectedKernel().kernel;
+        if (kernel == nullptr || size < kScalarCutoff) {
+            return FindScalar(textBytes, size, needleBytes, needleSize, 0);
+        }
+        return kernel(textBytes, size, needleBytes, needleSize);
+    }
+
+    const char* KernelName() {
+        return SelectedKernel().name;
+    }
+
+}
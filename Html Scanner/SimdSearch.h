@@ -0,0 +1,23 @@
+// Vectorized case-insensitive substring search for small keyword sets.
+// Candidate positions are found by comparing the first and last keyword byte against a whole
+// vector of text at once (SSE2/AVX2 on x86, NEON on ARM); only candidates are then verified
+// byte by byte. The widest kernel the CPU supports is picked once at runtime.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+namespace SimdSearch {
+
+    constexpr size_t npos = static_cast<size_t>(-1);
+
+    // Returns the offset of the first case-insensitive occurrence of needle in the text, or npos.
+    // The needle must already be folded to lowercase.
+    size_t FindFolded(const char* text, size_t size, const char* needle, size_t needleSize);
+
+    // Name of the kernel selected for this CPU, for diagnostics.
+    const char* KernelName();
+
+}
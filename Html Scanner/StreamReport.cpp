@@ -0,0 +1,109 @@
+#include "StreamReport.h"
+
+#include <map>
+#include <vector>
+
+
+RecordWriter::~RecordWriter()
+{
+    Close();
+}
+
+bool RecordWriter::Open(const std::filesystem::path& outputPath)
+{
+    Close();
+    m_stream.open(outputPath, std::ios::binary | std::ios::trunc);
+    m_buffer.reserve(kFlushBytes + 4096);
+    return m_stream.is_open();
+}
+
+void RecordWriter::Write(const std::string& keyword, const std::string& filePath)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer += keyword;
+    m_buffer += '\t';
+    m_buffer += filePath;
+    m_buffer += '\n';
+    if (m_buffer.size() >= kFlushBytes) {
+        FlushLocked();
+    }
+}
+
+void RecordWriter::Write(const std::string& keyword, const std::string& filePath, uint32_t count)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer += keyword;
+    m_buffer += '\t';
+    m_buffer += filePath;
+    m_buffer += '\t';
+    m_buffer += std::to_string(count);
+    m_buffer += '\n';
+    if (m_buffer.size() >= kFlushBytes) {
+        FlushLocked();
+    }
+}
+
+void RecordWriter::FlushLocked()
+{
+    if (m_stream.is_open() && !m_buffer.empty()) {
+        m_stream.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+        // Push the records past the stream's own buffer too, so they survive a crash.
+        m_stream.flush();
+    }
+    m_buffer.clear();
+}
+
+bool RecordWriter::Close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_stream.is_open()) {
+        return true;
+    }
+    FlushLocked();
+    m_stream.close();
+    return !m_stream.fail();
+}
+
+bool WriteGroupedReport(const std::filesystem::path& recordsPath, const std::filesystem::path& outputPath,
+    const std::string& rootDirectory)
+{
+    std::ifstream records(recordsPath, std::ios::binary);
+    if (!records.is_open()) {
+        return false;
+    }
+
+    // Keywords cannot contain a tab, so the first one on a line ends the keyword.
+    std::map<std::string, std::vector<std::string>> filesByKeyword;
+    std::string record;
+    while (std::getline(records, record)) {
+        const size_t separator = record.find('\t');
+        if (separator == std::string::npos) {
+            continue;
+        }
+        filesByKeyword[record.substr(0, separator)].push_back(record.substr(separator + 1));
+    }
+
+    std::ofstream outputFile(outputPath);
+    if (!outputFile.is_open()) {
+        return false;
+    }
+
+    outputFile << "Scan results for directory: " << rootDirectory << '\n';
+
+    if (filesByKeyword.empty()) {
+        outputFile << "\nNo files were found containing the specified keywords." << '\n';
+    }
+    else {
+        for (const auto& pair : filesByKeyword) {
+            outputFile << "\n==================================================" << '\n';
+            outputFile << "Files containing keyword: \"" << pair.first << "\"" << '\n';
+            outputFile << "==================================================" << '\n';
+            for (const auto& filePath : pair.second) {
+                outputFile << filePath << '\n';
+            }
+        }
+    }
+
+    outputFile.close();
+    return !outputFile.fail();
+}
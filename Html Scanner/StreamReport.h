@@ -0,0 +1,51 @@
+// Streaming output as one "keyword<TAB>path" record per line.
+// Records are appended while the scan runs, as each file completes, so nothing has to be held in
+// memory until the end and a scan that dies late still leaves everything found so far on disk.
+// The grouped-by-keyword report can be produced from the records afterwards.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+
+class RecordWriter {
+public:
+    RecordWriter() = default;
+    ~RecordWriter();
+
+    RecordWriter(const RecordWriter&) = delete;
+    RecordWriter& operator=(const RecordWriter&) = delete;
+
+    // Creates or truncates the output file. Returns false if it cannot be opened.
+    bool Open(const std::filesystem::path& outputPath);
+
+    // Appends one record. Safe to call from several threads; records are written whole, and the
+    // buffer goes to disk whenever it fills up.
+    void Write(const std::string& keyword, const std::string& filePath);
+
+    // Appends a record with the hit count as a third field, for /count.
+    void Write(const std::string& keyword, const std::string& filePath, uint32_t count);
+
+    // Writes out whatever is buffered and closes the file. Returns false if any write failed.
+    bool Close();
+
+private:
+    static constexpr size_t kFlushBytes = 64 * 1024;
+
+    void FlushLocked();
+
+    std::mutex m_mutex;
+    std::ofstream m_stream;
+    std::string m_buffer;
+};
+
+// Post-pass that reads the records in recordsPath and writes the grouped report in the same format
+// as WriteTextReport. Keywords come out in sorted order, and the files under each keyword in the
+// order their records were written. Returns false if either file cannot be opened or written.
+bool WriteGroupedReport(const std::filesystem::path& recordsPath, const std::filesystem::path& outputPath,
+    const std::string& rootDirectory);
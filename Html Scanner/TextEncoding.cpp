@@ -0,0 +1,267 @@
+#include "TextEncoding.h"
+
+#include "CaseFold.h"
+
+#include <algorithm>
+
+
+namespace {
+
+    // Zero bytes are looked for in this much of the start of a file without a byte order mark.
+    constexpr size_t kZeroSniffBytes = 512;
+
+    // What Windows-1252 puts at 0x80-0x9f. The five unused bytes are mapped to the C1 controls of
+    // the same value, as browsers do.
+    constexpr uint16_t kWindows1252High[32] = {
+        0x20ac, 0x0081, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+        0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008d, 0x017d, 0x008f,
+        0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+        0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x009d, 0x017e, 0x0178,
+    };
+
+    // The charset labels browsers read as Windows-1252.
+    const char* const kWindows1252Labels[] = {
+        "windows-1252", "cp1252", "x-cp1252", "iso-8859-1", "iso8859-1", "iso88591", "iso_8859-1",
+        "iso_8859-1:1987", "iso-ir-100", "latin1", "l1", "cp819", "ibm819", "csisolatin1",
+    };
+
+    bool IsLabelByte(unsigned char c) {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == ':' || c == '.';
+    }
+
+    // Looks for a charset=... declaration in the text and returns its label, lowercased, or an
+    // empty string if there is none.
+    std::string DeclaredCharset(const char* data, size_t size) {
+        static const char kName[] = "charset";
+        const size_t nameLength = sizeof(kName) - 1;
+        for (size_t i = 0; i + nameLength <= size; ++i) {
+            size_t matched = 0;
+            while (matched < nameLength
+                && CaseFold::Fold(static_cast<unsigned char>(data[i + matched])) == kName[matched]) {
+                ++matched;
+            }
+            if (matched < nameLength) {
+                continue;
+            }
+            size_t position = i + nameLength;
+            while (position < size && (data[position] == ' ' || data[position] == '\t')) {
+                ++position;
+            }
+            if (position >= size || data[position] != '=') {
+                continue;
+            }
+            ++position;
+            while (position < size && (data[position] == ' ' || data[position] == '\t'
+                || data[position] == '"' || data[position] == '\'')) {
+                ++position;
+            }
+            std::string label;
+            while (position < size) {
+                const unsigned char c = CaseFold::Fold(static_cast<unsigned char>(data[position++]));
+                if (!IsLabelByte(c)) {
+                    break;
+                }
+                label += static_cast<char>(c);
+            }
+            return label;
+        }
+        return std::string();
+    }
+
+    bool IsWindows1252Label(const std::string& label) {
+        return std::any_of(std::begin(kWindows1252Labels), std::end(kWindows1252Labels),
+            [&](const char* known) { return label == known; });
+    }
+
+    void AppendUnit(uint32_t unit, bool bigEndian, std::string& out) {
+        const char low = static_cast<char>(unit & 0xff);
+        const char high = static_cast<char>(unit >> 8);
+        out += bigEndian ? high : low;
+        out += bigEndian ? low : high;
+    }
+
+}
+
+TextEncoding SniffEncoding(const char* data, size_t size)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    if (size >= 3 && bytes[0] == 0xef && bytes[1] == 0xbb && bytes[2] == 0xbf) {
+        return TextEncoding::Utf8;
+    }
+    if (size >= 2 && bytes[0] == 0xff && bytes[1] == 0xfe) {
+        return TextEncoding::Utf16LE;
+    }
+    if (size >= 2 && bytes[0] == 0xfe && bytes[1] == 0xff) {
+        return TextEncoding::Utf16BE;
+    }
+
+    // Markup is ASCII, so UTF-16 without a byte order mark has a zero in nearly every other byte,
+    // and on one side only. Text in other encodings has hardly any zeros.
+    const size_t pairs = std::min(size, kZeroSniffBytes) / 2;
+    if (pairs >= 2) {
+        size_t evenZeros = 0;
+        size_t oddZeros = 0;
+        for (size_t i = 0; i < pairs; ++i) {
+            evenZeros += bytes[2 * i] == 0;
+            oddZeros += bytes[2 * i + 1] == 0;
+        }
+        if (oddZeros * 4 >= pairs * 3 && evenZeros * 8 <= pairs) {
+            return TextEncoding::Utf16LE;
+        }
+        if (evenZeros * 4 >= pairs * 3 && oddZeros * 8 <= pairs) {
+            return TextEncoding::Utf16BE;
+        }
+    }
+
+    if (IsWindows1252Label(DeclaredCharset(data, std::min(size, kEncodingSniffBytes)))) {
+        return TextEncoding::Windows1252;
+    }
+    return TextEncoding::Utf8;
+}
+
+const char* TextEncodingName(TextEncoding encoding)
+{
+    switch (encoding) {
+    case TextEncoding::Windows1252: return "windows-1252";
+    case TextEncoding::Utf16LE: return "UTF-16LE";
+    case TextEncoding::Utf16BE: return "UTF-16BE";
+    default: return "UTF-8";
+    }
+}
+
+bool DecodeUtf8(const std::string& text, size_t& position, uint32_t& codePoint)
+{
+    const unsigned char lead = static_cast<unsigned char>(text[position]);
+    size_t length = 0;
+    uint32_t minimum = 0;
+    if (lead < 0x80) {
+        codePoint = lead;
+        ++position;
+        return true;
+    }
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        length = 2;
+        minimum = 0x80;
+        codePoint = lead & 0x1f;
+    }
+    else if (lead >= 0xe0 && lead <= 0xef) {
+        length = 3;
+        minimum = 0x800;
+        codePoint = lead & 0x0f;
+    }
+    else if (lead >= 0xf0 && lead <= 0xf4) {
+        length = 4;
+        minimum = 0x10000;
+        codePoint = lead & 0x07;
+    }
+    if (length != 0 && position + length <= text.size()) {
+        size_t i = 1;
+        for (; i < length; ++i) {
+            const unsigned char next = static_cast<unsigned char>(text[position + i]);
+            if ((next & 0xc0) != 0x80) {
+                break;
+            }
+            codePoint = (codePoint << 6) | (next & 0x3f);
+        }
+        // Overlong forms, surrogates and values past U+10FFFF are not well formed.
+        if (i == length && codePoint >= minimum && codePoint <= 0x10ffff
+            && !(codePoint >= 0xd800 && codePoint <= 0xdfff)) {
+            position += length;
+            return true;
+        }
+    }
+    codePoint = lead;
+    ++position;
+    return false;
+}
+
+bool AppendEncoded(uint32_t codePoint, TextEncoding encoding, std::string& out)
+{
+    switch (encoding) {
+    case TextEncoding::Windows1252: {
+        if (codePoint < 0x80 || (codePoint >= 0xa0 && codePoint <= 0xff)) {
+            out += static_cast<char>(codePoint);
+            return true;
+        }
+        const uint16_t* const end = std::end(kWindows1252High);
+        const uint16_t* const found = std::find(std::begin(kWindows1252High), end, codePoint);
+        if (found == end) {
+            return false;
+        }
+        out += static_cast<char>(0x80 + (found - kWindows1252High));
+        return true;
+    }
+    case TextEncoding::Utf16LE:
+    case TextEncoding::Utf16BE: {
+        const bool bigEndian = encoding == TextEncoding::Utf16BE;
+        if (codePoint < 0x10000) {
+            AppendUnit(codePoint, bigEndian, out);
+        }
+        else {
+            AppendUnit(0xd800 + ((codePoint - 0x10000) >> 10), bigEndian, out);
+            AppendUnit(0xdc00 + ((codePoint - 0x10000) & 0x3ff), bigEndian, out);
+        }
+        return true;
+    }
+    default:
+        if (codePoint < 0x80) {
+            out += static_cast<char>(codePoint);
+        }
+        else if (codePoint < 0x800) {
+            out += static_cast<char>(0xc0 | (codePoint >> 6));
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        }
+        else if (codePoint < 0x10000) {
+            out += static_cast<char>(0xe0 | (codePoint >> 12));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        }
+        else {
+            out += static_cast<char>(0xf0 | (codePoint >> 18));
+            out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        }
+        return true;
+    }
+}
+
+void AppendAsUtf8(const char* data, size_t size, TextEncoding encoding, std::string& out)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    switch (encoding) {
+    case TextEncoding::Windows1252:
+        for (size_t i = 0; i < size; ++i) {
+            const uint32_t codePoint = bytes[i] >= 0x80 && bytes[i] < 0xa0 ? kWindows1252High[bytes[i] - 0x80] : bytes[i];
+            AppendEncoded(codePoint, TextEncoding::Utf8, out);
+        }
+        return;
+    case TextEncoding::Utf16LE:
+    case TextEncoding::Utf16BE: {
+        const bool bigEndian = encoding == TextEncoding::Utf16BE;
+        const auto unitAt = [&](size_t i) {
+            return bigEndian ? static_cast<uint32_t>(bytes[i] << 8 | bytes[i + 1]) : static_cast<uint32_t>(bytes[i + 1] << 8 | bytes[i]);
+        };
+        for (size_t i = 0; i + 1 < size; i += 2) {
+            uint32_t codePoint = unitAt(i);
+            if (codePoint >= 0xd800 && codePoint < 0xdc00 && i + 3 < size) {
+                const uint32_t low = unitAt(i + 2);
+                if (low >= 0xdc00 && low <= 0xdfff) {
+                    codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                    i += 2;
+                }
+            }
+            AppendEncoded(codePoint, TextEncoding::Utf8, out);
+        }
+        return;
+    }
+    default:
+        out.append(data, size);
+        return;
+    }
+}
+
+bool IsAscii(const std::string& text)
+{
+    return std::none_of(text.begin(), text.end(), [](char c) { return static_cast<unsigned char>(c) >= 0x80; });
+}
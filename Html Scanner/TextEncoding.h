@@ -0,0 +1,52 @@
+// Character encodings of scanned pages.
+// Files are never converted: the encoding of each one is sniffed from its first bytes, and the
+// keywords, which arrive as UTF-8, are encoded the same way once, so the matchers keep running on
+// the raw bytes. A byte order mark settles the encoding; without one, UTF-16 shows itself through
+// the zero bytes of its ASCII characters, and a page that declares a Latin-1 or Windows-1252
+// charset early on is read as Windows-1252. Anything else is taken to be UTF-8, which ASCII
+// keywords match byte for byte in every ASCII-compatible encoding.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+enum class TextEncoding {
+    Utf8,
+    Windows1252,
+    Utf16LE,
+    Utf16BE,
+};
+
+// Callers sniff at least this many bytes from the start of a file, or the whole file if it is
+// shorter. A charset declared any later is not seen.
+constexpr size_t kEncodingSniffBytes = 1024;
+
+TextEncoding SniffEncoding(const char* data, size_t size);
+
+// The encoding's name, for diagnostics.
+const char* TextEncodingName(TextEncoding encoding);
+
+// Bytes per code unit: matches in UTF-16 text only count when they start on a code unit boundary.
+inline size_t CodeUnitSize(TextEncoding encoding) {
+    return encoding == TextEncoding::Utf16LE || encoding == TextEncoding::Utf16BE ? 2 : 1;
+}
+
+// Reads the code point at position of UTF-8 text and moves position past it. A byte that does
+// not start a well-formed sequence is read on its own: codePoint is the byte's value and the
+// result is false.
+bool DecodeUtf8(const std::string& text, size_t& position, uint32_t& codePoint);
+
+// Appends codePoint in encoding. Returns false, appending nothing, if the encoding cannot
+// represent it.
+bool AppendEncoded(uint32_t codePoint, TextEncoding encoding, std::string& out);
+
+// Appends text in encoding to out as UTF-8, for showing it. UTF-16 text must start on a code unit
+// boundary; a trailing odd byte is left out and unpaired surrogates are encoded on their own.
+// UTF-8 text is copied as it is.
+void AppendAsUtf8(const char* data, size_t size, TextEncoding encoding, std::string& out);
+
+// True if no byte of the text has its high bit set.
+bool IsAscii(const std::string& text);
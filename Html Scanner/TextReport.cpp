@@ -0,0 +1,51 @@
+#include "TextReport.h"
+
+#include <algorithm>
+#include <fstream>
+
+
+bool WriteTextReport(const std::filesystem::path& outputPath, const std::string& rootDirectory,
+    const PathTable& paths, const std::vector<std::string>& keywords,
+    const std::vector<std::vector<FileId>>& filesByKeyword,
+    const std::vector<std::vector<uint32_t>>* hitCounts)
+{
+    std::ofstream outputFile(outputPath);
+    if (!outputFile.is_open()) {
+        return false;
+    }
+
+    // Lines end with '\n' rather than std::endl so the stream is not flushed once per path.
+    outputFile << "Scan results for directory: " << rootDirectory << '\n';
+
+    const bool anyFound = std::any_of(filesByKeyword.begin(), filesByKeyword.end(),
+        [](const std::vector<FileId>& files) { return !files.empty(); });
+    if (!anyFound) {
+        outputFile << "\nNo files were found containing the specified keywords." << '\n';
+    }
+    else {
+        for (size_t keywordIndex = 0; keywordIndex < keywords.size(); ++keywordIndex) {
+            const std::string& keyword = keywords[keywordIndex];
+            const std::vector<FileId>& files = filesByKeyword[keywordIndex];
+            if (files.empty()) {
+                continue;
+            }
+
+            outputFile << "\n==================================================" << '\n';
+            outputFile << "Files containing keyword: \"" << keyword << "\"" << '\n';
+            outputFile << "==================================================" << '\n';
+
+            // Paths are only turned back into strings here, one at a time.
+            for (size_t i = 0; i < files.size(); ++i) {
+                outputFile << paths.String(files[i]);
+                if (hitCounts != nullptr) {
+                    const uint32_t count = (*hitCounts)[keywordIndex][i];
+                    outputFile << " (" << count << (count == 1 ? " hit)" : " hits)");
+                }
+                outputFile << '\n';
+            }
+        }
+    }
+
+    outputFile.close();
+    return !outputFile.fail();
+}
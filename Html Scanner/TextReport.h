@@ -0,0 +1,20 @@
+// Writer for the plain-text report, which groups matching files by keyword.
+
+#pragma once
+
+#include "PathTable.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+// Writes the grouped report to outputPath. filesByKeyword[i] lists the files that contain
+// keywords[i]; keywords come out in list order, and those without any files are left out.
+// With hitCounts, laid out like filesByKeyword, every file is followed by its hit count (/count).
+// Returns false if the file could not be opened or written.
+bool WriteTextReport(const std::filesystem::path& outputPath, const std::string& rootDirectory,
+    const PathTable& paths, const std::vector<std::string>& keywords,
+    const std::vector<std::vector<FileId>>& filesByKeyword,
+    const std::vector<std::vector<uint32_t>>* hitCounts = nullptr);
@@ -0,0 +1,123 @@
+#include "WorkStealingPool.h"
+
+#include <chrono>
+
+
+namespace {
+    // Identifies the pool and worker the current thread belongs to, if any.
+    thread_local const WorkStealingPool* currentPool = nullptr;
+    thread_local size_t currentWorkerIndex = 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t threadCount)
+{
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_workers.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    Wait();
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_stopping = true;
+    }
+    m_workAvailable.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::Submit(Task task)
+{
+    const size_t target = (currentPool == this)
+        ? currentWorkerIndex
+        : m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+
+    // Count the task before it becomes visible so a worker that pops it can never drive the
+    // counters below zero. The state mutex makes sure an idle worker cannot miss the wakeup.
+    m_unfinishedTasks.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_queuedTasks.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_queues[target]->mutex);
+        m_queues[target]->tasks.push_back(std::move(task));
+    }
+    m_workAvailable.notify_one();
+}
+
+double WorkStealingPool::BusySeconds(size_t workerIndex) const
+{
+    return static_cast<double>(m_queues[workerIndex]->busyNanoseconds.load(std::memory_order_relaxed)) / 1e9;
+}
+
+void WorkStealingPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_stateMutex);
+    m_allDone.wait(lock, [this] { return m_unfinishedTasks.load() == 0; });
+}
+
+bool WorkStealingPool::TryPopLocal(size_t workerIndex, Task& task)
+{
+    WorkerQueue& queue = *m_queues[workerIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::TrySteal(size_t thiefIndex, Task& task)
+{
+    for (size_t offset = 1; offset < m_queues.size(); ++offset) {
+        WorkerQueue& victim = *m_queues[(thiefIndex + offset) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::WorkerLoop(size_t workerIndex)
+{
+    currentPool = this;
+    currentWorkerIndex = workerIndex;
+
+    for (;;) {
+        Task task;
+        if (TryPopLocal(workerIndex, task) || TrySteal(workerIndex, task)) {
+            m_queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            const auto start = std::chrono::steady_clock::now();
+            task(workerIndex);
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            m_queues[workerIndex]->busyNanoseconds.fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+
+            if (m_unfinishedTasks.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(m_stateMutex);
+                m_allDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_stateMutex);
+        m_workAvailable.wait(lock, [this] { return m_stopping || m_queuedTasks.load() > 0; });
+        if (m_stopping && m_queuedTasks.load() == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+// Fixed-size thread pool where every worker owns a task deque.
+// Workers take tasks from the back of their own deque and, once it runs dry, steal from the
+// front of the other workers' deques. A handful of long tasks (huge files) therefore never
+// leaves the rest of the queue stuck behind them.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class WorkStealingPool {
+public:
+    // A task receives the index of the worker running it, so callers can keep per-worker state.
+    // Tasks must not throw; catch and report errors inside the task.
+    using Task = std::function<void(size_t workerIndex)>;
+
+    explicit WorkStealingPool(size_t threadCount);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Queues a task. Tasks submitted from a worker go to that worker's own deque,
+    // tasks submitted from outside are spread round-robin.
+    void Submit(Task task);
+
+    // Blocks until every submitted task, including tasks submitted by other tasks, has finished.
+    void Wait();
+
+    size_t ThreadCount() const { return m_workers.size(); }
+
+    // Time the worker has spent running tasks since the pool was created. Everything else is idle time.
+    double BusySeconds(size_t workerIndex) const;
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        // Only written by the worker that owns the queue.
+        std::atomic<uint64_t> busyNanoseconds{ 0 };
+    };
+
+    void WorkerLoop(size_t workerIndex);
+    bool TryPopLocal(size_t workerIndex, Task& task);
+    bool TrySteal(size_t thiefIndex, Task& task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_workers;
+
+    std::atomic<size_t> m_nextQueue{ 0 };
+    std::atomic<size_t> m_queuedTasks{ 0 };
+    std::atomic<size_t> m_unfinishedTasks{ 0 };
+    bool m_stopping = false;
+
+    std::mutex m_stateMutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_allDone;
+};